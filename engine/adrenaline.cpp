@@ -6,8 +6,12 @@
 */
 
 #include "adrenaline.h"
+#include "core/profiler.h"
+#include "core/allocations.h"
 #include "tinygltf/stb_image.h"
 #include <cmath>
+#include <cstdio>
+#include <filesystem>
 
 void Adren::Engine::makeWindow() {
     glfwInit();
@@ -24,9 +28,9 @@ void Adren::Engine::makeWindow() {
     std::string appName = "Adrenaline Engine";
     window = glfwCreateWindow(mode->width, mode->height, appName.c_str(), nullptr, nullptr);
 
-    glfwSetWindowUserPointer(window, this);
-  
-    if (camera.toggled) { glfwSetCursorPosCallback(window, camera.callback); }
+    // Keys, buttons and the cursor all go through the renderer's input, so sessions can be recorded and replayed.
+    renderer.input.attach(window);
+    renderer.input.cursor = [this](double x, double y) { camera.look(x, y); };
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
     GLFWimage images[1];
@@ -35,17 +39,34 @@ void Adren::Engine::makeWindow() {
     stbi_image_free(images[0].pixels);
 }
 
+// Input, the editor and the transforms run here on the main thread, one frame ahead of the render thread which
+// culls, records and presents the frame before from the snapshot process hands it.
 void Adren::Engine::loop() {
     while (!glfwWindowShouldClose(window)) {
+        ADREN_PROFILE_SCOPE("Frame");
+        renderer.input.advance();
+        glfwPollEvents();
         renderer.gui.newFrame(window);
         renderer.gui.viewport();
         editor.start();
+
+        if (editor.recordInput != renderer.input.recording()) {
+            if (editor.recordInput) { renderer.record(); } else { renderer.input.save("adrenaline-input.bin"); }
+        }
+
+        if (editor.saveMemory) {
+            renderer.saveMemory("adrenaline-memory.json");
+            editor.saveMemory = false;
+        }
+
         renderer.process(window);
 
-        if (editor.modelPaths.size() > renderer.models.size()) {
-            for (int i = renderer.models.size(); i < editor.modelPaths.size(); i++) {
+        // A path imported again becomes another placement of the model already loaded, not another copy of it.
+        if (editor.modelPaths.size() > imported) {
+            for (size_t i = imported; i < editor.modelPaths.size(); i++) {
                 renderer.addModel(editor.modelPaths[i]);
             }
+            imported = editor.modelPaths.size();
         }
         
         if (objects < renderer.models.size()) {
@@ -54,10 +75,13 @@ void Adren::Engine::loop() {
         }
     }
 
+    renderer.stop();
     renderer.wait();
 }
 
 void Adren::Engine::run() {
+    ADREN_PROFILE_THREAD("Main");
+    Allocations::charge(Allocations::Subsystem::Engine);
 	rpc->initialize();
 	rpc->update();
 
@@ -68,6 +92,79 @@ void Adren::Engine::run() {
     cleanup();
 }
 
+// No window, no editor and no discord. The simulation takes exactly one tick a frame, or the recorded frame times
+// of a replay, so the same model and frame count draw the same frames every run, whatever machine or software
+// driver they run on.
+void Adren::Engine::runHeadless(std::string model, uint32_t frames, uint32_t width, uint32_t height, std::string dumps, uint32_t every, std::string replay) {
+    ADREN_PROFILE_THREAD("Main");
+    Allocations::charge(Allocations::Subsystem::Engine);
+    camera.width = width;
+    camera.height = height;
+    renderer.headless = true;
+    renderer.init(window);
+
+    renderer.addModel(model);
+    renderer.reloadScene(renderer.models);
+
+    // A replay without a frame count runs for as long as the log does.
+    renderer.input.cursor = [this](double x, double y) { camera.look(x, y); };
+    if (!replay.empty()) {
+        if (!renderer.replay(replay)) { throw std::runtime_error("Failed to replay " + replay + "!"); }
+        if (frames == 0) { frames = renderer.input.frames(); }
+    }
+
+    if (!dumps.empty()) {
+        std::filesystem::create_directories(dumps);
+        if (every == 0) { every = frames; }
+    }
+
+    // Stats come back from the render thread two frames late, and the first frames still grow caches and arenas.
+    uint32_t allocating = 0;
+    const uint32_t settled = 8;
+    for (uint32_t frame = 1; frame <= frames; frame++) {
+        ADREN_PROFILE_SCOPE("Frame");
+        if (!dumps.empty() && frame % every == 0) {
+            char name[32];
+            std::snprintf(name, sizeof(name), "frame-%05u.png", frame);
+            renderer.capture((std::filesystem::path(dumps) / name).string());
+        }
+
+        renderer.input.advance();
+        renderer.process(window);
+        if (frame > settled && renderer.stats.allocations > 0) { allocating++; }
+    }
+
+    renderer.stop();
+    renderer.wait();
+
+    Adren::Tools::log("Rendered " + std::to_string(frames) + " frames headless at " + std::to_string(width) + " x " + std::to_string(height) + "..");
+    for (const PassTiming& pass : renderer.stats.gpuTimings) {
+        Adren::Tools::log("GPU " + pass.name + ": " + std::to_string(pass.avg) + " ms avg, " + std::to_string(pass.max) + " ms max..");
+    }
+    for (const PassTiming& stage : renderer.stats.cpuTimings) {
+        Adren::Tools::log("CPU " + stage.name + ": " + std::to_string(stage.avg) + " ms avg, " + std::to_string(stage.max) + " ms max..");
+    }
+
+    const MemoryStats& memory = renderer.stats.gpuMemory;
+    for (size_t i = 0; i < memory.bytes.size(); i++) {
+        Adren::Tools::log("GPU memory, " + std::string(Adren::Memory::name(static_cast<MemoryCategory>(i))) + ": " + std::to_string(memory.bytes[i] / 1024) + " KB in "
+            + std::to_string(memory.counts[i]) + " allocations..");
+    }
+    if (Adren::Allocations::enabled() && frames > settled) {
+        Adren::Tools::log("Something allocated in " + std::to_string(allocating) + " of " + std::to_string(frames - settled) + " settled frames..");
+    }
+    if (Adren::Allocations::tracking()) {
+        for (const Adren::Allocations::Usage& usage : Adren::Allocations::usage()) {
+            if (usage.allocations == 0) { continue; }
+            Adren::Tools::log("CPU memory, " + std::string(usage.name) + ": " + std::to_string(usage.live / 1024) + " KB live, "
+                + std::to_string(usage.peak / 1024) + " KB peak, " + std::to_string(usage.allocations) + " allocations..");
+        }
+    }
+    if (!dumps.empty()) { renderer.saveMemory((std::filesystem::path(dumps) / "memory.json").string()); }
+
+    cleanup();
+}
+
 void Adren::Engine::cleanup() {
     renderer.cleanup();
 }
\ No newline at end of file
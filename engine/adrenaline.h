@@ -15,6 +15,10 @@ namespace Adren {
 class Engine {
 public:
     void run();
+
+    // Renders a model for a fixed number of frames without a window, saving every nth frame into dumps when it is
+    // given, and logs the frame timings at the end. With an input log the camera moves the way it did when recorded.
+    void runHeadless(std::string model, uint32_t frames, uint32_t width, uint32_t height, std::string dumps = "", uint32_t every = 0, std::string replay = "");
 private:
     GLFWwindow* window{};
     void makeWindow();
@@ -22,9 +26,10 @@ private:
     void cleanup();
     Renderer renderer{window};
     Camera& camera = renderer.camera;
-    Editor editor{camera};
+    Editor editor{camera, renderer.settings, renderer.stats, renderer.world};
     RPC* rpc;
 
     uint32_t objects = 0;
+    size_t imported = 0;
 };
 }
@@ -0,0 +1,236 @@
+/*
+    benchmark.cpp
+    Adrenaline Engine
+
+    Definitions for the benchmark suite.
+*/
+
+#include "benchmark.h"
+#include "renderer/renderer.h"
+#include "renderer/tools.h"
+#include "core/profiler.h"
+#include "tinygltf/json.hpp"
+#include <map>
+#include <memory>
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+
+using json = nlohmann::json;
+
+namespace {
+// One measured frame. CPU stages and GPU passes are keyed by the names Timing gives them.
+struct Sample {
+    double frame = 0.0;
+    std::map<std::string, float> cpu;
+    std::map<std::string, float> gpu;
+    uint32_t draws = 0;
+    uint32_t drawn = 0;
+    uint32_t calls = 0;
+    uint64_t memory = 0;
+    uint32_t allocations = 0;
+};
+
+json summarize(std::vector<double> values) {
+    if (values.empty()) { return json::object(); }
+
+    std::sort(values.begin(), values.end());
+    double total = 0.0;
+    for (double value : values) { total += value; }
+
+    auto percentile = [&values](double p) { return values[static_cast<size_t>(p * (values.size() - 1) + 0.5)]; };
+    return { { "avg", total / values.size() }, { "p50", percentile(0.5) }, { "p95", percentile(0.95) }, { "max", values.back() } };
+}
+
+// Every key the samples have under one group, summarized over all of them.
+json summarize(const std::vector<Sample>& samples, std::map<std::string, float> Sample::*group) {
+    std::map<std::string, std::vector<double>> values;
+    for (const Sample& sample : samples) {
+        for (const auto& [name, milliseconds] : sample.*group) { values[name].push_back(milliseconds); }
+    }
+
+    json summary = json::object();
+    for (auto& [name, list] : values) { summary[name] = summarize(list); }
+    return summary;
+}
+
+void applySettings(const json& overrides, Settings& settings) {
+    settings.frustumCulling = overrides.value("frustumCulling", settings.frustumCulling);
+    settings.hierarchicalCulling = overrides.value("hierarchicalCulling", settings.hierarchicalCulling);
+    settings.gpuCulling = overrides.value("gpuCulling", settings.gpuCulling);
+    settings.occlusionCulling = overrides.value("occlusionCulling", settings.occlusionCulling);
+    settings.softwareOcclusion = overrides.value("softwareOcclusion", settings.softwareOcclusion);
+    settings.instancing = overrides.value("instancing", settings.instancing);
+    settings.sortDraws = overrides.value("sortDraws", settings.sortDraws);
+    settings.recordThreads = overrides.value("recordThreads", settings.recordThreads);
+    settings.tickRate = overrides.value("tickRate", settings.tickRate);
+}
+
+// A fresh renderer for every scene, so no scene inherits caches or allocations from the one before.
+json runScene(const json& scene, uint32_t width, uint32_t height, uint32_t warmup) {
+    std::string name = scene.value("name", "unnamed");
+    std::string model = scene.at("model").get<std::string>();
+
+    // The camera follows a recorded input log, a recorded camera path or an orbit, in that order of preference.
+    Adren::CameraPath path;
+    bool replayed = scene.contains("input");
+    if (!replayed && scene.contains("path")) {
+        if (!path.load(scene["path"].get<std::string>())) {
+            throw std::runtime_error("Could not read the camera path of " + name + "!");
+        }
+    } else if (!replayed) {
+        json orbit = scene.value("orbit", json::object());
+        path = Adren::CameraPath::orbit(scene.value("frames", 600u), orbit.value("radius", 10.0f), orbit.value("height", 2.0f));
+    }
+
+    auto renderer = std::make_unique<Adren::Renderer>(nullptr);
+    renderer->camera.width = width;
+    renderer->camera.height = height;
+    renderer->headless = true;
+    applySettings(scene.value("settings", json::object()), renderer->settings);
+    renderer->init(nullptr);
+    renderer->addModel(model);
+    renderer->reloadScene(renderer->models);
+
+    Adren::Camera& camera = renderer->camera;
+    renderer->input.cursor = [&camera](double x, double y) { camera.look(x, y); };
+    if (replayed && !renderer->replay(scene["input"].get<std::string>())) {
+        throw std::runtime_error("Could not read the input log of " + name + "!");
+    }
+
+    uint32_t frames = scene.value("frames", replayed ? renderer->input.frames() : static_cast<uint32_t>(path.poses.size()));
+
+    // Stats come back from the render thread a frame or two late, the warmup frames cover that as well. A replay
+    // holds its first frame until the warmup is over.
+    std::vector<Sample> samples;
+    for (uint32_t frame = 0; frame < warmup + frames; frame++) {
+        if (!replayed) { path.apply(renderer->camera, frame < warmup ? 0 : frame - warmup); } else if (frame >= warmup) { renderer->input.advance(); }
+
+        auto start = std::chrono::steady_clock::now();
+        renderer->process(nullptr);
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (frame < warmup) { continue; }
+
+        const RenderStats& stats = renderer->stats;
+        Sample sample;
+        sample.frame = elapsed;
+        for (const PassTiming& stage : stats.cpuTimings) { sample.cpu[stage.name] = stage.last; }
+        for (const PassTiming& pass : stats.gpuTimings) { sample.gpu[pass.name] = pass.last; }
+        sample.draws = stats.draws;
+        sample.drawn = stats.drawn;
+        sample.calls = stats.recorded.calls;
+        sample.memory = stats.memory;
+        sample.allocations = stats.allocations;
+        samples.push_back(sample);
+    }
+
+    renderer->stop();
+    renderer->wait();
+    renderer->cleanup();
+
+    std::vector<double> frameTimes, draws, drawn, calls, memory, allocations;
+    json perFrame = json::array();
+    for (const Sample& sample : samples) {
+        frameTimes.push_back(sample.frame);
+        draws.push_back(sample.draws);
+        drawn.push_back(sample.drawn);
+        calls.push_back(sample.calls);
+        memory.push_back(static_cast<double>(sample.memory));
+        allocations.push_back(sample.allocations);
+        perFrame.push_back({ { "frame", sample.frame }, { "cpu", sample.cpu }, { "gpu", sample.gpu }, { "draws", sample.draws },
+            { "drawn", sample.drawn }, { "calls", sample.calls }, { "memory", sample.memory }, { "allocations", sample.allocations } });
+    }
+
+    json summary = {
+        { "frame", summarize(frameTimes) },
+        { "cpu", summarize(samples, &Sample::cpu) },
+        { "gpu", summarize(samples, &Sample::gpu) },
+        { "draws", summarize(draws) },
+        { "drawn", summarize(drawn) },
+        { "calls", summarize(calls) },
+        { "memory", summarize(memory) },
+        { "allocations", summarize(allocations) }
+    };
+
+    Adren::Tools::log("Benchmarked " + name + ": " + std::to_string(summary["frame"].value("avg", 0.0)) + " ms a frame on average over "
+        + std::to_string(samples.size()) + " frames..");
+    return { { "name", name }, { "model", model }, { "frames", samples.size() }, { "summary", summary }, { "perFrame", perFrame } };
+}
+
+// Averages and 95th percentiles are compared, a tiny absolute floor keeps sub-microsecond noise from failing runs.
+uint32_t compare(const std::string& scene, const std::string& metric, const json& current, const json& baseline, double threshold) {
+    uint32_t regressions = 0;
+    for (const char* statistic : { "avg", "p95" }) {
+        if (!current.contains(statistic) || !baseline.contains(statistic)) { continue; }
+
+        double now = current[statistic].get<double>();
+        double before = baseline[statistic].get<double>();
+        if (now > before * (1.0 + threshold) && now - before > 0.01) {
+            Adren::Tools::log("Regression in " + scene + ", " + metric + " " + statistic + ": " + std::to_string(before) + " -> " + std::to_string(now));
+            regressions++;
+        }
+    }
+
+    return regressions;
+}
+
+uint32_t compare(const json& results, const json& baseline, double threshold) {
+    uint32_t regressions = 0;
+    for (const json& scene : results["scenes"]) {
+        std::string name = scene["name"].get<std::string>();
+        auto before = std::find_if(baseline["scenes"].begin(), baseline["scenes"].end(), [&name](const json& other) { return other.value("name", "") == name; });
+        if (before == baseline["scenes"].end()) {
+            Adren::Tools::log("The baseline has no results for " + name + ", nothing to compare..");
+            continue;
+        }
+
+        const json& now = scene["summary"];
+        const json& then = (*before)["summary"];
+        regressions += compare(name, "frame", now["frame"], then["frame"], threshold);
+        regressions += compare(name, "memory", now["memory"], then["memory"], threshold);
+        if (now.contains("allocations") && then.contains("allocations")) { regressions += compare(name, "allocations", now["allocations"], then["allocations"], threshold); }
+        for (const char* group : { "cpu", "gpu" }) {
+            for (auto& [metric, values] : now[group].items()) {
+                if (then[group].contains(metric)) { regressions += compare(name, std::string(group) + " " + metric, values, then[group][metric], threshold); }
+            }
+        }
+    }
+
+    return regressions;
+}
+}
+
+bool Adren::Benchmark::run(const Options& options) {
+    ADREN_PROFILE_THREAD("Main");
+    std::ifstream file(options.suite);
+    if (!file) {
+        Adren::Tools::log("Could not open the benchmark suite " + options.suite + "..");
+        return false;
+    }
+
+    json suite = json::parse(file);
+    uint32_t width = suite.value("width", 1280u);
+    uint32_t height = suite.value("height", 720u);
+    uint32_t warmup = suite.value("warmup", 30u);
+
+    json results = { { "suite", options.suite }, { "width", width }, { "height", height }, { "warmup", warmup }, { "scenes", json::array() } };
+    for (const json& scene : suite.at("scenes")) {
+        results["scenes"].push_back(runScene(scene, width, height, warmup));
+    }
+
+    std::ofstream output(options.output);
+    output << results.dump(2) << std::endl;
+    Adren::Tools::log("Wrote the benchmark results to " + options.output + "..");
+
+    if (options.baseline.empty()) { return true; }
+
+    std::ifstream previous(options.baseline);
+    if (!previous) {
+        Adren::Tools::log("Could not open the baseline " + options.baseline + "..");
+        return false;
+    }
+
+    uint32_t regressions = compare(results, json::parse(previous), options.threshold);
+    Adren::Tools::log(std::to_string(regressions) + " regressions past " + std::to_string(options.threshold * 100.0) + "% against " + options.baseline + "..");
+    return regressions == 0;
+}
@@ -0,0 +1,28 @@
+/*
+    benchmark.h
+    Adrenaline Engine
+
+    The benchmark suite. Every scene is rendered headless along a fixed camera path, and what each frame cost on
+    the CPU and GPU, what it drew and how much memory it held is written out as JSON. Results from an earlier
+    commit can be given as a baseline, anything slower than it by more than the threshold fails the run.
+*/
+
+#pragma once
+#include <string>
+
+namespace Adren {
+class Benchmark {
+public:
+    struct Options {
+        std::string suite;
+        std::string output = "adrenaline-bench.json";
+        std::string baseline;
+
+        // How much slower than the baseline a metric may get, 0.1 is ten percent.
+        double threshold = 0.1;
+    };
+
+    // Returns false when the suite could not be run or something regressed past the threshold.
+    static bool run(const Options& options);
+};
+}
@@ -0,0 +1,194 @@
+/*
+    allocations.cpp
+    Adrenaline Engine
+
+    The replaced global operator new and delete, when allocation tracking is built in, and the per-subsystem
+    accounting behind them.
+*/
+
+#include "allocations.h"
+#include <new>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+namespace {
+using Adren::Allocations::Subsystem;
+constexpr size_t subsystemCount = static_cast<size_t>(Subsystem::Count);
+
+const char* names[subsystemCount] = { "Other", "Engine", "glTF documents", "Assets", "Scene", "Renderer", "Vulkan", "Editor", "Workers" };
+
+// Constant initialized, so using it from inside operator new never allocates or needs a guard.
+thread_local Subsystem current = Subsystem::Other;
+
+struct Counters {
+    std::atomic<uint64_t> live{0};
+    std::atomic<uint64_t> peak{0};
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> allocated{0};
+};
+
+Counters counters[subsystemCount];
+
+// Sits right in front of every tracked block. The offset leads back to what malloc returned when the block had
+// to be aligned further than malloc does on its own.
+struct Header {
+    uint64_t size;
+    uint32_t subsystem;
+    uint32_t offset;
+};
+
+static_assert(sizeof(Header) == 16, "The header keeps blocks 16 byte aligned");
+
+void charge(Subsystem subsystem, size_t size) {
+    Counters& counter = counters[static_cast<size_t>(subsystem)];
+    counter.allocations.fetch_add(1, std::memory_order_relaxed);
+    counter.allocated.fetch_add(size, std::memory_order_relaxed);
+
+    uint64_t live = counter.live.fetch_add(size, std::memory_order_relaxed) + size;
+    uint64_t peak = counter.peak.load(std::memory_order_relaxed);
+    while (live > peak && !counter.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+}
+
+void* tracked(size_t size, size_t align, Subsystem subsystem) {
+    align = std::max(align, sizeof(Header));
+    size_t padding = align <= alignof(std::max_align_t) ? sizeof(Header) : sizeof(Header) + align;
+    uint8_t* raw = static_cast<uint8_t*>(std::malloc(size + padding));
+    if (!raw) { return nullptr; }
+
+    uintptr_t user = (reinterpret_cast<uintptr_t>(raw) + sizeof(Header) + align - 1) & ~static_cast<uintptr_t>(align - 1);
+    Header* header = reinterpret_cast<Header*>(user) - 1;
+    header->size = size;
+    header->subsystem = static_cast<uint32_t>(subsystem);
+    header->offset = static_cast<uint32_t>(user - reinterpret_cast<uintptr_t>(raw));
+
+    charge(subsystem, size);
+    return reinterpret_cast<void*>(user);
+}
+
+void untracked(void* data) {
+    if (!data) { return; }
+
+    Header* header = static_cast<Header*>(data) - 1;
+    counters[header->subsystem].live.fetch_sub(header->size, std::memory_order_relaxed);
+    std::free(static_cast<uint8_t*>(data) - header->offset);
+}
+
+#if defined(ADREN_TRACK_ALLOCATIONS) || defined(ADREN_TRACK_MEMORY)
+std::atomic<uint64_t> calls{0};
+
+void* allocate(size_t size, size_t align) {
+    calls.fetch_add(1, std::memory_order_relaxed);
+#ifdef ADREN_TRACK_MEMORY
+    return tracked(size > 0 ? size : 1, align, current);
+#else
+    if (align <= alignof(std::max_align_t)) { return std::malloc(size > 0 ? size : 1); }
+
+    void* data = nullptr;
+#if defined(_MSC_VER) || defined(__MINGW32__)
+    data = _aligned_malloc(size > 0 ? size : 1, align);
+#else
+    if (posix_memalign(&data, align, size > 0 ? size : 1) != 0) { data = nullptr; }
+#endif
+    return data;
+#endif
+}
+
+void release(void* data, [[maybe_unused]] size_t align) {
+#ifdef ADREN_TRACK_MEMORY
+    untracked(data);
+#elif defined(_MSC_VER) || defined(__MINGW32__)
+    if (align <= alignof(std::max_align_t)) { std::free(data); } else { _aligned_free(data); }
+#else
+    std::free(data);
+#endif
+}
+
+void* orThrow(void* data) {
+    if (!data) { throw std::bad_alloc(); }
+    return data;
+}
+#endif
+}
+
+void Adren::Allocations::charge(Subsystem subsystem) { current = subsystem; }
+Adren::Allocations::Subsystem Adren::Allocations::charged() { return current; }
+
+Adren::Allocations::Scope::Scope(Subsystem subsystem) : previous(current) { current = subsystem; }
+Adren::Allocations::Scope::~Scope() { current = previous; }
+
+const char* Adren::Allocations::name(Subsystem subsystem) {
+    return subsystem < Subsystem::Count ? names[static_cast<size_t>(subsystem)] : "Unknown";
+}
+
+Adren::Allocations::Report Adren::Allocations::usage() {
+    Report report;
+    for (size_t i = 0; i < subsystemCount; i++) {
+        report[i].name = names[i];
+        report[i].live = counters[i].live.load(std::memory_order_relaxed);
+        report[i].peak = counters[i].peak.load(std::memory_order_relaxed);
+        report[i].allocations = counters[i].allocations.load(std::memory_order_relaxed);
+        report[i].allocated = counters[i].allocated.load(std::memory_order_relaxed);
+    }
+
+    return report;
+}
+
+void* Adren::Allocations::allocate(size_t size, size_t align, Subsystem subsystem) {
+    return tracked(size, align, subsystem);
+}
+
+void* Adren::Allocations::reallocate(void* data, size_t size, size_t align, Subsystem subsystem) {
+    if (!data) { return tracked(size, align, subsystem); }
+    if (size == 0) {
+        untracked(data);
+        return nullptr;
+    }
+
+    void* moved = tracked(size, align, subsystem);
+    if (moved) {
+        std::memcpy(moved, data, std::min<size_t>(size, (static_cast<Header*>(data) - 1)->size));
+        untracked(data);
+    }
+
+    return moved;
+}
+
+void Adren::Allocations::release(void* data) { untracked(data); }
+
+#if defined(ADREN_TRACK_ALLOCATIONS) || defined(ADREN_TRACK_MEMORY)
+uint64_t Adren::Allocations::count() { return calls.load(std::memory_order_relaxed); }
+bool Adren::Allocations::enabled() { return true; }
+
+void* operator new(size_t size) { return orThrow(allocate(size, alignof(std::max_align_t))); }
+void* operator new[](size_t size) { return orThrow(allocate(size, alignof(std::max_align_t))); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return allocate(size, alignof(std::max_align_t)); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return allocate(size, alignof(std::max_align_t)); }
+void* operator new(size_t size, std::align_val_t align) { return orThrow(allocate(size, static_cast<size_t>(align))); }
+void* operator new[](size_t size, std::align_val_t align) { return orThrow(allocate(size, static_cast<size_t>(align))); }
+void* operator new(size_t size, std::align_val_t align, const std::nothrow_t&) noexcept { return allocate(size, static_cast<size_t>(align)); }
+void* operator new[](size_t size, std::align_val_t align, const std::nothrow_t&) noexcept { return allocate(size, static_cast<size_t>(align)); }
+
+void operator delete(void* data) noexcept { release(data, alignof(std::max_align_t)); }
+void operator delete[](void* data) noexcept { release(data, alignof(std::max_align_t)); }
+void operator delete(void* data, size_t) noexcept { release(data, alignof(std::max_align_t)); }
+void operator delete[](void* data, size_t) noexcept { release(data, alignof(std::max_align_t)); }
+void operator delete(void* data, const std::nothrow_t&) noexcept { release(data, alignof(std::max_align_t)); }
+void operator delete[](void* data, const std::nothrow_t&) noexcept { release(data, alignof(std::max_align_t)); }
+void operator delete(void* data, std::align_val_t align) noexcept { release(data, static_cast<size_t>(align)); }
+void operator delete[](void* data, std::align_val_t align) noexcept { release(data, static_cast<size_t>(align)); }
+void operator delete(void* data, size_t, std::align_val_t align) noexcept { release(data, static_cast<size_t>(align)); }
+void operator delete[](void* data, size_t, std::align_val_t align) noexcept { release(data, static_cast<size_t>(align)); }
+void operator delete(void* data, std::align_val_t align, const std::nothrow_t&) noexcept { release(data, static_cast<size_t>(align)); }
+void operator delete[](void* data, std::align_val_t align, const std::nothrow_t&) noexcept { release(data, static_cast<size_t>(align)); }
+#else
+uint64_t Adren::Allocations::count() { return 0; }
+bool Adren::Allocations::enabled() { return false; }
+#endif
+
+#ifdef ADREN_TRACK_MEMORY
+bool Adren::Allocations::tracking() { return true; }
+#else
+bool Adren::Allocations::tracking() { return false; }
+#endif
@@ -0,0 +1,65 @@
+/*
+    allocations.h
+    Adrenaline Engine
+
+    Counts and tracks heap allocations. With ADREN_TRACK_ALLOCATIONS defined the global operator new and delete
+    are replaced by ones that count every call from every thread, which is how a frame shows it gets through the
+    main thread, the render thread and the workers without touching the heap. ADREN_TRACK_MEMORY goes further and puts a small header in
+    front of every block, so each one is charged to the subsystem that allocated it and the live bytes, peak bytes
+    and allocation rate of every subsystem are known. Without either nothing is replaced and every count reads 0.
+*/
+
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace Adren::Allocations {
+enum class Subsystem : uint8_t { Other, Engine, Documents, Assets, Scene, Renderer, Vulkan, Editor, Workers, Count };
+
+struct Usage {
+    const char* name = "";
+    uint64_t live = 0;
+    uint64_t peak = 0;
+    uint64_t allocations = 0; // Every allocation so far, the rate comes from two reads some time apart.
+    uint64_t allocated = 0;   // Every byte allocated so far.
+};
+
+using Report = std::array<Usage, static_cast<size_t>(Subsystem::Count)>;
+
+// Calls to operator new made by every thread so far.
+uint64_t count();
+
+// Whether the counts mean anything in this build.
+bool enabled();
+
+// Whether blocks are charged to subsystems in this build, without it every usage reads 0.
+bool tracking();
+
+Report usage();
+const char* name(Subsystem subsystem);
+
+// Where the calling thread's allocations go when no scope says otherwise, set once when a thread starts.
+void charge(Subsystem subsystem);
+
+// Where the calling thread's allocations are going right now.
+Subsystem charged();
+
+// Charges everything allocated on this thread to a subsystem until it goes out of scope. Freeing always
+// credits whoever allocated the block, whichever thread or scope frees it.
+class Scope {
+public:
+    Scope(Subsystem subsystem);
+    ~Scope();
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+private:
+    Subsystem previous;
+};
+
+// For allocators that don't go through operator new, like the Vulkan allocation callbacks and ImGui. Blocks from
+// these are only ever freed with release, reallocate follows realloc and copies what fits.
+void* allocate(size_t size, size_t align, Subsystem subsystem);
+void* reallocate(void* data, size_t size, size_t align, Subsystem subsystem);
+void release(void* data);
+}
@@ -0,0 +1,44 @@
+/*
+    arena.cpp
+    Adrenaline Engine
+
+    Definitions for the bump allocator.
+*/
+
+#include "arena.h"
+#include <algorithm>
+
+namespace {
+uintptr_t alignUp(uintptr_t value, size_t align) {
+    return (value + align - 1) & ~static_cast<uintptr_t>(align - 1);
+}
+}
+
+Adren::Arena::Arena(size_t capacity) : block(capacity > 0 ? new uint8_t[capacity] : nullptr), size(capacity) {}
+
+void* Adren::Arena::allocate(size_t bytes, size_t align) {
+    uintptr_t base = reinterpret_cast<uintptr_t>(block.get());
+    uintptr_t start = alignUp(base + offset, align);
+    if (block && start + bytes <= base + size) {
+        offset = start + bytes - base;
+        highest = std::max(highest, used());
+        return reinterpret_cast<void*>(start);
+    }
+
+    // Whatever doesn't fit gets a block of its own, the padding covers the alignment.
+    overflow.emplace_back(new uint8_t[bytes + align]);
+    spilled += bytes + align;
+    highest = std::max(highest, used());
+    return reinterpret_cast<void*>(alignUp(reinterpret_cast<uintptr_t>(overflow.back().get()), align));
+}
+
+void Adren::Arena::reset() {
+    if (!overflow.empty()) {
+        size = std::max(size * 2, alignUp(offset + spilled, 4096));
+        block.reset(new uint8_t[size]);
+        overflow.clear();
+        spilled = 0;
+    }
+
+    offset = 0;
+}
@@ -0,0 +1,73 @@
+/*
+    arena.h
+    Adrenaline Engine
+
+    A bump allocator for temporaries that all die at the same time, like everything one frame needs on the CPU.
+    Allocating moves an offset, nothing is freed on its own and reset drops all of it at once. A frame that needs
+    more than the block holds gets extra blocks from the heap, and the next reset folds them into one block big
+    enough for all of it, so later frames of the same size never touch the heap. Only one thread may use an arena.
+*/
+
+#pragma once
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+namespace Adren {
+class Arena {
+public:
+    explicit Arena(size_t capacity = 64 * 1024);
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t align = alignof(std::max_align_t));
+
+    template <typename T>
+    T* allocate(size_t count) { return static_cast<T*>(allocate(sizeof(T) * count, alignof(T))); }
+
+    // Everything allocated since the last reset is gone after this, destructors are not run.
+    void reset();
+
+    size_t used() const { return offset + spilled; }
+    size_t capacity() const { return size; }
+
+    // The most that was in use at once, across every reset.
+    size_t peak() const { return highest; }
+private:
+    std::unique_ptr<uint8_t[]> block;
+    size_t size = 0;
+    size_t offset = 0;
+
+    // Blocks that had to come from the heap since the last reset, and how much of them was used.
+    std::vector<std::unique_ptr<uint8_t[]>> overflow;
+    size_t spilled = 0;
+    size_t highest = 0;
+};
+
+// Lets standard containers live in an arena. Freeing is a no-op, the memory comes back when the arena resets,
+// so a container that grows a lot leaves its old storage behind until then. Reserve up front where the size is known.
+template <typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+    ArenaAllocator(Arena& arena) : arena(&arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t count) { return arena->allocate<T>(count); }
+    void deallocate(T*, size_t) {}
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+
+    Arena* arena;
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+}
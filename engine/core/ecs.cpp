@@ -0,0 +1,132 @@
+/*
+    ecs.cpp
+    Adrenaline Engine
+
+    Definitions for the archetype storage behind the entity component system.
+*/
+
+#include "ecs.h"
+#include <atomic>
+#include <stdexcept>
+
+uint32_t Adren::ECS::nextComponent() {
+    static std::atomic<uint32_t> next{ 0 };
+    uint32_t id = next++;
+    if (id >= 64) { throw std::runtime_error("More than 64 component types!"); }
+    return id;
+}
+
+int32_t Adren::ECS::World::Archetype::find(uint32_t component) const {
+    for (size_t c = 0; c < columns.size(); c++) {
+        if (columns[c].component == component) { return static_cast<int32_t>(c); }
+    }
+
+    return -1;
+}
+
+Adren::ECS::Entity Adren::ECS::World::create() {
+    uint32_t index;
+    if (!freed.empty()) {
+        index = freed.back();
+        freed.pop_back();
+    } else {
+        index = static_cast<uint32_t>(records.size());
+        records.push_back({});
+    }
+
+    Entity entity{ index, records[index].generation };
+    records[index].archetype = archetype(0);
+    records[index].row = insert(records[index].archetype, entity);
+    count++;
+    return entity;
+}
+
+// Bumping the generation is what turns every handle still pointing at this slot stale.
+void Adren::ECS::World::destroy(Entity entity) {
+    if (!alive(entity)) { return; }
+
+    Record& record = records[entity.index];
+    erase(record.archetype, record.row);
+    record.generation++;
+    freed.push_back(entity.index);
+    count--;
+}
+
+bool Adren::ECS::World::alive(Entity entity) const {
+    return entity.index < records.size() && records[entity.index].generation == entity.generation;
+}
+
+uint32_t Adren::ECS::World::archetype(uint64_t mask) {
+    auto found = lookup.find(mask);
+    if (found != lookup.end()) { return found->second; }
+
+    Archetype archetype{};
+    archetype.mask = mask;
+    for (uint32_t c = 0; c < 64; c++) {
+        if (mask & (1ull << c)) { archetype.columns.push_back({ c, sizes[c], {} }); }
+    }
+
+    archetypes.push_back(std::move(archetype));
+    uint32_t index = static_cast<uint32_t>(archetypes.size() - 1);
+    lookup[mask] = index;
+    return index;
+}
+
+uint32_t Adren::ECS::World::insert(uint32_t index, Entity entity) {
+    Archetype& archetype = archetypes[index];
+    for (Column& column : archetype.columns) {
+        column.bytes.resize(column.bytes.size() + column.size);
+    }
+
+    archetype.entities.push_back(entity);
+    return static_cast<uint32_t>(archetype.entities.size() - 1);
+}
+
+// The last row is moved into the hole so the columns stay packed, and its entity's record follows it.
+void Adren::ECS::World::erase(uint32_t index, uint32_t row) {
+    Archetype& archetype = archetypes[index];
+    uint32_t last = static_cast<uint32_t>(archetype.entities.size() - 1);
+
+    if (row != last) {
+        for (Column& column : archetype.columns) {
+            std::memcpy(&column.bytes[row * column.size], &column.bytes[last * column.size], column.size);
+        }
+
+        archetype.entities[row] = archetype.entities[last];
+        records[archetype.entities[row].index].row = row;
+    }
+
+    for (Column& column : archetype.columns) {
+        column.bytes.resize(column.bytes.size() - column.size);
+    }
+
+    archetype.entities.pop_back();
+}
+
+// Adding or removing a component moves the entity to the archetype for its new set, carrying over what both share.
+void Adren::ECS::World::move(Entity entity, uint64_t mask) {
+    Record& record = records[entity.index];
+    uint32_t from = record.archetype;
+    uint32_t to = archetype(mask);
+    uint32_t row = insert(to, entity);
+
+    Archetype& source = archetypes[from];
+    Archetype& target = archetypes[to];
+    for (Column& column : target.columns) {
+        int32_t shared = source.find(column.component);
+        if (shared < 0) { continue; }
+
+        std::memcpy(&column.bytes[row * column.size], &source.columns[shared].bytes[record.row * column.size], column.size);
+    }
+
+    erase(from, record.row);
+    record.archetype = to;
+    record.row = row;
+}
+
+void* Adren::ECS::World::data(Entity entity, uint32_t component) {
+    const Record& record = records[entity.index];
+    Archetype& archetype = archetypes[record.archetype];
+    Column& column = archetype.columns[archetype.find(component)];
+    return &column.bytes[record.row * column.size];
+}
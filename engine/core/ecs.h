@@ -0,0 +1,178 @@
+/*
+    ecs.h
+    Adrenaline Engine
+
+    An archetype based entity component system. Entities with the same set of components share an archetype,
+    which keeps every component in its own tightly packed column, so a query walks plain arrays.
+    Components have to be trivially copyable since the columns move them around with memcpy.
+*/
+
+#pragma once
+#include <vector>
+#include <tuple>
+#include <algorithm>
+#include <unordered_map>
+#include <type_traits>
+#include <cstdint>
+#include <cstring>
+#include "core/workers.h"
+
+namespace Adren::ECS {
+// The index is a slot that gets reused, the generation tells a stale handle apart from whatever lives there now.
+struct Entity {
+    uint32_t index = UINT32_MAX;
+    uint32_t generation = 0;
+
+    bool operator==(const Entity& other) const { return index == other.index && generation == other.generation; }
+    bool operator!=(const Entity& other) const { return !(*this == other); }
+};
+
+// Every component type gets a bit in a 64 bit mask the first time it is used.
+uint32_t nextComponent();
+
+template <typename T>
+uint32_t component() {
+    static_assert(std::is_trivially_copyable_v<T>, "Components are moved with memcpy");
+    static const uint32_t id = nextComponent();
+    return id;
+}
+
+template <typename... Ts>
+uint64_t mask() { return ((1ull << component<Ts>()) | ... | 0ull); }
+
+class World {
+public:
+    Entity create();
+    void destroy(Entity entity);
+    bool alive(Entity entity) const;
+    uint32_t size() const { return count; }
+
+    template <typename... Ts>
+    Entity create(const Ts&... components) {
+        Entity entity = create();
+        (add(entity, components), ...);
+        return entity;
+    }
+
+    template <typename T>
+    void add(Entity entity, const T& value) {
+        if (!alive(entity)) { return; }
+
+        uint32_t id = component<T>();
+        if (sizes.size() <= id) { sizes.resize(id + 1, 0); }
+        sizes[id] = sizeof(T);
+
+        Record& record = records[entity.index];
+        if (!(archetypes[record.archetype].mask & (1ull << id))) { move(entity, archetypes[record.archetype].mask | (1ull << id)); }
+        std::memcpy(data(entity, id), &value, sizeof(T));
+    }
+
+    template <typename T>
+    void remove(Entity entity) {
+        if (!alive(entity)) { return; }
+
+        uint64_t current = archetypes[records[entity.index].archetype].mask;
+        if (current & mask<T>()) { move(entity, current & ~mask<T>()); }
+    }
+
+    template <typename T>
+    bool has(Entity entity) const { return alive(entity) && (archetypes[records[entity.index].archetype].mask & mask<T>()); }
+
+    // The pointer is only good until the next entity is created, destroyed or changes components.
+    template <typename T>
+    T* get(Entity entity) { return has<T>(entity) ? static_cast<T*>(data(entity, component<T>())) : nullptr; }
+
+    // Calls fn(entity, components...) for every entity that has at least the given components.
+    template <typename... Ts, typename F>
+    void each(F&& fn) {
+        uint64_t wanted = mask<Ts...>();
+        for (Archetype& archetype : archetypes) {
+            if ((archetype.mask & wanted) != wanted || archetype.entities.empty()) { continue; }
+
+            auto columns = std::make_tuple(archetype.column<Ts>()...);
+            for (uint32_t row = 0; row < archetype.entities.size(); row++) {
+                fn(archetype.entities[row], std::get<Ts*>(columns)[row]...);
+            }
+        }
+    }
+
+    // Calls fn(count, entities, columns...) once per matching archetype, for systems that want the raw arrays.
+    template <typename... Ts, typename F>
+    void chunks(F&& fn) {
+        uint64_t wanted = mask<Ts...>();
+        for (Archetype& archetype : archetypes) {
+            if ((archetype.mask & wanted) != wanted || archetype.entities.empty()) { continue; }
+            fn(static_cast<uint32_t>(archetype.entities.size()), archetype.entities.data(), archetype.column<Ts>()...);
+        }
+    }
+
+    // The same as each but split into ranges of at most chunk rows that run on the workers.
+    // Nothing may be created, destroyed or change components until it returns, and fn may not call it again.
+    template <typename... Ts, typename F>
+    void parallel(Workers& workers, uint32_t chunk, F&& fn) {
+        ranges.clear();
+
+        uint64_t wanted = mask<Ts...>();
+        for (Archetype& archetype : archetypes) {
+            if ((archetype.mask & wanted) != wanted) { continue; }
+
+            uint32_t rows = static_cast<uint32_t>(archetype.entities.size());
+            for (uint32_t first = 0; first < rows; first += chunk) {
+                ranges.push_back({ &archetype, first, std::min(rows, first + chunk) });
+            }
+        }
+
+        workers.parallel(static_cast<uint32_t>(ranges.size()), [&](uint32_t r) {
+            Archetype& archetype = *ranges[r].archetype;
+            auto columns = std::make_tuple(archetype.column<Ts>()...);
+            for (uint32_t row = ranges[r].first; row < ranges[r].last; row++) {
+                fn(archetype.entities[row], std::get<Ts*>(columns)[row]...);
+            }
+        });
+    }
+private:
+    struct Column {
+        uint32_t component;
+        uint32_t size;
+        std::vector<uint8_t> bytes;
+    };
+
+    struct Archetype {
+        uint64_t mask = 0;
+        std::vector<Column> columns;
+        std::vector<Entity> entities;
+
+        int32_t find(uint32_t component) const;
+
+        template <typename T>
+        T* column() { return reinterpret_cast<T*>(columns[find(ECS::component<T>())].bytes.data()); }
+    };
+
+    struct Record {
+        uint32_t archetype = 0;
+        uint32_t row = 0;
+        uint32_t generation = 0;
+    };
+
+    uint32_t archetype(uint64_t mask);
+    uint32_t insert(uint32_t archetype, Entity entity);
+    void erase(uint32_t archetype, uint32_t row);
+    void move(Entity entity, uint64_t mask);
+    void* data(Entity entity, uint32_t component);
+
+    // The ranges parallel hands out, kept so a frame's calls reuse the capacity the first ones grew.
+    struct Range {
+        Archetype* archetype;
+        uint32_t first;
+        uint32_t last;
+    };
+
+    std::vector<Archetype> archetypes;
+    std::vector<Range> ranges;
+    std::unordered_map<uint64_t, uint32_t> lookup;
+    std::vector<Record> records;
+    std::vector<uint32_t> freed;
+    std::vector<uint32_t> sizes;
+    uint32_t count = 0;
+};
+}
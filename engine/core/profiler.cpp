@@ -0,0 +1,157 @@
+/*
+    profiler.cpp
+    Adrenaline Engine
+
+    Definitions for the scoped CPU profiler.
+*/
+
+#include "profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+namespace {
+// One writer, the thread it belongs to, and one reader, whoever saves under the registry's lock. The writer never
+// waits, a full ring overwrites its oldest events so a trace always holds the latest ones. The slot of event head
+// is being written while head has not moved past it, so the reader copies first and then throws away whatever
+// head shows could have been overwritten meanwhile.
+struct Ring {
+    struct Event {
+        std::atomic<const char*> name{nullptr};
+        std::atomic<uint64_t> start{0};
+        std::atomic<uint64_t> end{0};
+    };
+
+    static constexpr uint32_t capacity = 1 << 16;
+
+    std::unique_ptr<Event[]> events{new Event[capacity]};
+    std::atomic<uint64_t> head{0};
+    uint64_t tail = 0;
+    std::atomic<const char*> thread{nullptr};
+    uint32_t id = 0;
+};
+
+// Rings are only added, never removed, so a thread that exits leaves its events behind for the next save.
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Ring>> rings;
+    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+};
+
+Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+// The first event a thread records registers its ring, which is the only time recording takes the lock.
+Ring& local() {
+    thread_local Ring* ring = nullptr;
+    if (!ring) {
+        Registry& shared = registry();
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        shared.rings.push_back(std::make_unique<Ring>());
+        ring = shared.rings.back().get();
+        ring->id = static_cast<uint32_t>(shared.rings.size());
+    }
+
+    return *ring;
+}
+
+// Names come from code and are not escaped beyond quotes and backslashes.
+void escape(std::ofstream& file, const char* text) {
+    for (const char* c = text; *c; c++) {
+        if (*c == '"' || *c == '\\') { file << '\\'; }
+        file << *c;
+    }
+}
+}
+
+uint64_t Adren::Profiler::now() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - registry().epoch).count());
+}
+
+void Adren::Profiler::name(const char* thread) {
+    local().thread.store(thread, std::memory_order_release);
+}
+
+void Adren::Profiler::record(const char* name, uint64_t start, uint64_t end) {
+    Ring& ring = local();
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+
+    // Pairs with the fence in save, a reader that sees any of these stores also sees head at least this far.
+    std::atomic_thread_fence(std::memory_order_release);
+    Ring::Event& event = ring.events[head % Ring::capacity];
+    event.name.store(name, std::memory_order_relaxed);
+    event.start.store(start, std::memory_order_relaxed);
+    event.end.store(end, std::memory_order_relaxed);
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+// Complete events in microseconds, plus one metadata event per named thread so the rows read Main, Render and so on.
+size_t Adren::Profiler::save(const std::string& path) {
+    Registry& shared = registry();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+
+    std::ofstream file(path);
+    if (!file) {
+        std::cerr << "Could not write the CPU trace to " << path << std::endl;
+        return 0;
+    }
+
+    size_t written = 0;
+    uint64_t overwritten = 0;
+    struct Copy { const char* name; uint64_t start; uint64_t end; };
+    bool first = true;
+    auto separate = [&file, &first] {
+        file << (first ? "\n" : ",\n");
+        first = false;
+    };
+
+    file << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+    for (auto& ring : shared.rings) {
+        if (const char* thread = ring->thread.load(std::memory_order_acquire)) {
+            separate();
+            file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << ring->id << ",\"args\":{\"name\":\"";
+            escape(file, thread);
+            file << "\"}}";
+        }
+
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t first = std::max(ring->tail, head > Ring::capacity ? head - Ring::capacity : 0);
+        std::vector<Copy> events(head - first);
+        for (uint64_t i = first; i < head; i++) {
+            const Ring::Event& event = ring->events[i % Ring::capacity];
+            events[i - first] = { event.name.load(std::memory_order_relaxed), event.start.load(std::memory_order_relaxed), event.end.load(std::memory_order_relaxed) };
+        }
+
+        // Anything the writer got around to overwriting while the copy was made is older than its slot's new event.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t moved = ring->head.load(std::memory_order_relaxed);
+        uint64_t valid = std::max(first, moved >= Ring::capacity ? moved - Ring::capacity + 1 : 0);
+        overwritten += std::min(valid, head) - ring->tail;
+
+        for (uint64_t i = valid; i < head; i++) {
+            const Copy& event = events[i - first];
+            separate();
+            file << "{\"name\":\"";
+            escape(file, event.name);
+            file << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << ring->id << ",\"ts\":" << event.start / 1000.0
+                << ",\"dur\":" << (event.end - event.start) / 1000.0 << "}";
+            written++;
+        }
+
+        ring->tail = head;
+    }
+
+    file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+    std::cerr << "Wrote " << written << " CPU trace events to " << path;
+    if (overwritten > 0) { std::cerr << ", " << overwritten << " older ones were overwritten before they were saved"; }
+    std::cerr << std::endl;
+    return written;
+}
@@ -0,0 +1,51 @@
+/*
+    profiler.h
+    Adrenaline Engine
+
+    A scoped CPU profiler. Every thread records into its own ring of timed events without locking, and save
+    writes what was recorded since the last save, up to the latest 65536 events of each thread, out as a Chrome
+    trace that chrome://tracing and Perfetto open.
+    Without ADREN_PROFILE defined the scope macros compile to nothing.
+*/
+
+#pragma once
+#include <atomic>
+#include <string>
+#include <cstdint>
+
+namespace Adren::Profiler {
+// Nanoseconds on the steady clock since the profiler was first used.
+uint64_t now();
+
+// Names the calling thread in the trace.
+void name(const char* thread);
+
+// Names have to outlive the trace, string literals are what the macros pass.
+void record(const char* name, uint64_t start, uint64_t end);
+
+// Writes and empties every thread's ring. Returns how many events went out, events a full ring overwrote before
+// they were saved are logged.
+size_t save(const std::string& path);
+
+class Scope {
+public:
+    Scope(const char* name) : name(name), start(now()) {}
+    ~Scope() { record(name, start, now()); }
+private:
+    const char* name;
+    uint64_t start;
+};
+}
+
+#define ADREN_CONCAT_INNER(a, b) a##b
+#define ADREN_CONCAT(a, b) ADREN_CONCAT_INNER(a, b)
+
+#ifdef ADREN_PROFILE
+    #define ADREN_PROFILE_SCOPE(name) Adren::Profiler::Scope ADREN_CONCAT(profilerScope, __LINE__)(name)
+    #define ADREN_PROFILE_FUNCTION() ADREN_PROFILE_SCOPE(__func__)
+    #define ADREN_PROFILE_THREAD(thread) Adren::Profiler::name(thread)
+#else
+    #define ADREN_PROFILE_SCOPE(name) ((void)0)
+    #define ADREN_PROFILE_FUNCTION() ((void)0)
+    #define ADREN_PROFILE_THREAD(thread) ((void)0)
+#endif
@@ -0,0 +1,56 @@
+/*
+    sort.cpp
+    Adrenaline Engine
+
+    Definitions for the radix sort.
+*/
+
+#include "sort.h"
+#include <utility>
+
+// Eight passes of one byte each. All the histograms are counted in a single read of the keys, and a pass whose
+// byte is the same for every key is skipped since it would not move anything.
+void Adren::Sort::radix(std::vector<uint64_t>& keys, std::vector<uint32_t>& values, std::vector<uint64_t>& keyScratch, std::vector<uint32_t>& valueScratch) {
+    size_t count = keys.size();
+    if (count < 2) { return; }
+
+    keyScratch.resize(count);
+    valueScratch.resize(count);
+
+    uint32_t histograms[8][256] = {};
+    for (uint64_t key : keys) {
+        for (int pass = 0; pass < 8; pass++) { histograms[pass][(key >> (pass * 8)) & 0xFF]++; }
+    }
+
+    uint64_t* keysIn = keys.data();
+    uint64_t* keysOut = keyScratch.data();
+    uint32_t* valuesIn = values.data();
+    uint32_t* valuesOut = valueScratch.data();
+
+    for (int pass = 0; pass < 8; pass++) {
+        uint32_t* histogram = histograms[pass];
+        if (histogram[(keysIn[0] >> (pass * 8)) & 0xFF] == count) { continue; }
+
+        uint32_t offset = 0;
+        for (int digit = 0; digit < 256; digit++) {
+            uint32_t size = histogram[digit];
+            histogram[digit] = offset;
+            offset += size;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            uint32_t slot = histogram[(keysIn[i] >> (pass * 8)) & 0xFF]++;
+            keysOut[slot] = keysIn[i];
+            valuesOut[slot] = valuesIn[i];
+        }
+
+        std::swap(keysIn, keysOut);
+        std::swap(valuesIn, valuesOut);
+    }
+
+    // An odd number of passes leaves the result in the scratch vectors.
+    if (keysIn != keys.data()) {
+        keys.swap(keyScratch);
+        values.swap(valueScratch);
+    }
+}
@@ -0,0 +1,17 @@
+/*
+    sort.h
+    Adrenaline Engine
+
+    A least significant digit radix sort over 64 bit keys that carries a 32 bit value along with each key.
+*/
+
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace Adren::Sort {
+// Sorts keys ascending and moves values the same way, it is stable. The scratch vectors are only kept by the
+// caller so sorting every frame does not allocate.
+void radix(std::vector<uint64_t>& keys, std::vector<uint32_t>& values, std::vector<uint64_t>& keyScratch, std::vector<uint32_t>& valueScratch);
+}
@@ -0,0 +1,403 @@
+/*
+    workers.cpp
+    Adrenaline Engine
+
+    Definitions for the work stealing job system.
+*/
+
+#include "workers.h"
+#include "profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+namespace {
+// Which pool the current thread works for and which deque is its own.
+struct Identity {
+    const Adren::Workers* pool = nullptr;
+    uint32_t index = 0;
+};
+
+thread_local Identity identity;
+thread_local uint32_t seed = 0x9E3779B9u ^ static_cast<uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+uint32_t nextRandom() {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+}
+
+Adren::Workers::Workers(uint32_t count) {
+    if (count == 0) {
+        count = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        deques.push_back(std::make_unique<Deque>());
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        threads.emplace_back(&Workers::work, this, i);
+    }
+}
+
+Adren::Workers::~Workers() {
+    wait();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+
+    wake.notify_all();
+    for (auto& thread : threads) { thread.join(); }
+
+    for (uint32_t i = 0; i < blockCount; i++) { delete[] blocks[i].load(); }
+}
+
+void Adren::Workers::Queue::push(Job* job) {
+    if (count == items.size()) {
+        std::vector<Job*> bigger(items.size() * 2);
+        for (size_t i = 0; i < count; i++) { bigger[i] = items[(head + i) % items.size()]; }
+        items.swap(bigger);
+        head = 0;
+    }
+
+    items[(head + count) % items.size()] = job;
+    count++;
+}
+
+Adren::Workers::Job* Adren::Workers::Queue::pop() {
+    Job* job = items[head];
+    head = (head + 1) % items.size();
+    count--;
+    return job;
+}
+
+// Reading next off a job another thread has just taken is harmless, the tag makes the swap fail.
+Adren::Workers::Job* Adren::Workers::acquire() {
+    uint64_t head = spare.load(std::memory_order_acquire);
+
+    while (true) {
+        uint32_t top = static_cast<uint32_t>(head);
+        if (top == 0) {
+            grow();
+            head = spare.load(std::memory_order_acquire);
+            continue;
+        }
+
+        Job* job = slot(top - 1);
+        uint64_t next = job->next.load(std::memory_order_relaxed);
+        if (spare.compare_exchange_weak(head, ((head >> 32) + 1) << 32 | next, std::memory_order_acquire, std::memory_order_acquire)) { return job; }
+    }
+}
+
+void Adren::Workers::recycle(Job* job) {
+    uint64_t head = spare.load(std::memory_order_relaxed);
+
+    do {
+        job->next.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+    } while (!spare.compare_exchange_weak(head, ((head >> 32) + 1) << 32 | (job->index + 1), std::memory_order_release, std::memory_order_relaxed));
+}
+
+// The only place jobs get allocated. Whoever finds the list empty after taking the lock adds a block and
+// pushes all of it in one swap.
+void Adren::Workers::grow() {
+    std::lock_guard<std::mutex> lock(growing);
+    if (static_cast<uint32_t>(spare.load(std::memory_order_acquire)) != 0) { return; }
+
+    uint32_t block = blockCount.load(std::memory_order_relaxed);
+    if (block == maxBlocks) {
+        std::cerr << "Ran out of room for jobs" << std::endl;
+        std::abort();
+    }
+
+    Job* jobs = new Job[blockSize];
+    uint32_t base = block * blockSize;
+    for (uint32_t i = 0; i < blockSize; i++) {
+        jobs[i].index = base + i;
+        jobs[i].next.store(i + 1 < blockSize ? base + i + 2 : 0, std::memory_order_relaxed);
+    }
+
+    blocks[block].store(jobs, std::memory_order_release);
+    blockCount.store(block + 1, std::memory_order_release);
+
+    uint64_t head = spare.load(std::memory_order_relaxed);
+    do {
+        jobs[blockSize - 1].next.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+    } while (!spare.compare_exchange_weak(head, ((head >> 32) + 1) << 32 | (base + 1), std::memory_order_release, std::memory_order_relaxed));
+}
+
+// The owner's end. Releasing the new bottom makes the job visible to any thief that sees it.
+void Adren::Workers::Deque::push(Job* job) {
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+    Ring* current = ring.load(std::memory_order_relaxed);
+
+    if (b - t > current->capacity - 1) { current = grow(current, t, b); }
+
+    current->put(b, job);
+    bottom.store(b + 1, std::memory_order_release);
+}
+
+// Also the owner's end. Only the last job left can be raced for, whoever moves top past it first gets it.
+Adren::Workers::Job* Adren::Workers::Deque::pop() {
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    Ring* current = ring.load(std::memory_order_relaxed);
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+
+    if (t > b) {
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Job* job = current->get(b);
+    if (t == b) {
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) { job = nullptr; }
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    return job;
+}
+
+Adren::Workers::Job* Adren::Workers::Deque::steal() {
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+
+    if (t >= b) { return nullptr; }
+
+    Job* job = ring.load(std::memory_order_acquire)->get(t);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) { return nullptr; }
+    return job;
+}
+
+Adren::Workers::Deque::Ring* Adren::Workers::Deque::grow(Ring* old, int64_t top, int64_t bottom) {
+    rings.push_back(std::make_unique<Ring>(old ? old->capacity * 2 : 256));
+    Ring* bigger = rings.back().get();
+
+    for (int64_t i = top; i < bottom; i++) { bigger->put(i, old->get(i)); }
+
+    ring.store(bigger, std::memory_order_release);
+    return bigger;
+}
+
+// Sleepers are only woken when there are any. Queued is bumped before sleeping is read and a worker bumps
+// sleeping before it reads queued, so one of the two always sees the other and no wakeup gets lost.
+void Adren::Workers::push(Job* job, bool isBackground) {
+    if (isBackground) {
+        std::lock_guard<std::mutex> lock(mutex);
+        background.push(job);
+    } else if (identity.pool == this) {
+        deques[identity.index]->push(job);
+    } else {
+        std::lock_guard<std::mutex> lock(mutex);
+        shared.push(job);
+    }
+
+    queued++;
+    if (sleeping > 0) {
+        { std::lock_guard<std::mutex> lock(mutex); }
+        wake.notify_one();
+    }
+}
+
+// A worker looks in its own deque first, then the shared queue, then steals from a random victim, and only
+// then turns to background work.
+Adren::Workers::Job* Adren::Workers::take(bool withBackground) {
+    Job* job = nullptr;
+    bool worker = identity.pool == this;
+
+    if (worker) { job = deques[identity.index]->pop(); }
+
+    if (!job && queued > 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!shared.empty()) { job = shared.pop(); }
+    }
+
+    if (!job && !deques.empty()) {
+        uint32_t start = nextRandom() % deques.size();
+        for (uint32_t i = 0; i < deques.size() && !job; i++) {
+            uint32_t victim = (start + i) % deques.size();
+            if (worker && victim == identity.index) { continue; }
+            job = deques[victim]->steal();
+        }
+    }
+
+    if (!job && withBackground && queued > 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!background.empty()) { job = background.pop(); }
+    }
+
+    if (job) { queued--; }
+    return job;
+}
+
+void Adren::Workers::execute(Job* job) {
+    Counter* counter = job->counter;
+
+    {
+        Allocations::Scope scope(job->subsystem);
+        job->invoke(job->storage);
+        job->destroy(job->storage);
+    }
+
+    recycle(job);
+    if (counter) { counter->pending.fetch_sub(1, std::memory_order_acq_rel); }
+}
+
+void Adren::Workers::work(uint32_t index) {
+    ADREN_PROFILE_THREAD("Worker");
+    identity = { this, index };
+    Allocations::charge(Allocations::Subsystem::Workers);
+
+    while (true) {
+        Job* job = take(true);
+        if (job) {
+            execute(job);
+            continue;
+        }
+
+        // A short spin catches jobs forked right after this thread ran dry, sleeping is for when it stays dry.
+        for (int spin = 0; spin < 64 && !job; spin++) {
+            std::this_thread::yield();
+            job = take(true);
+        }
+
+        if (job) {
+            execute(job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        sleeping++;
+        wake.wait(lock, [this] { return stopping || queued > 0; });
+        sleeping--;
+
+        if (stopping && queued == 0) { return; }
+    }
+}
+
+void Adren::Workers::submit(std::function<void()> job) {
+    submitted.pending++;
+    push(make(std::move(job), &submitted), true);
+}
+
+// Waiting never picks up background work, a frame waiting on its culling should not end up compiling a pipeline.
+void Adren::Workers::wait(Counter& counter) {
+    while (counter.pending.load(std::memory_order_acquire) > 0) {
+        Job* job = take(false);
+        if (job) {
+            execute(job);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void Adren::Workers::wait() {
+    while (submitted.pending.load(std::memory_order_acquire) > 0) {
+        Job* job = take(true);
+        if (job) {
+            execute(job);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void Adren::Workers::split(Counter& counter, uint32_t first, uint32_t last, uint32_t grain, const std::function<void(uint32_t, uint32_t)>& job) {
+    while (last - first > grain) {
+        uint32_t middle = first + (last - first) / 2;
+        run(counter, [this, &counter, middle, last, grain, &job] { split(counter, middle, last, grain, job); });
+        last = middle;
+    }
+
+    job(first, last);
+}
+
+void Adren::Workers::forRange(uint32_t first, uint32_t last, uint32_t grain, const std::function<void(uint32_t, uint32_t)>& job) {
+    if (first >= last) { return; }
+
+    Counter counter;
+    split(counter, first, last, std::max(grain, 1u), job);
+    wait(counter);
+}
+
+// A stress test that checks nested fork and join gets every answer right, then what a job costs.
+void Adren::Workers::benchmark() {
+    using Clock = std::chrono::steady_clock;
+    auto milliseconds = [](Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    };
+
+    Workers workers;
+    std::cout << "Job system with " << workers.size() << " workers\n";
+
+    // Nested parallel loops from many rounds of jobs at once, with background jobs mixed in.
+    bool correct = true;
+    std::atomic<uint32_t> backgroundRuns{0};
+    for (uint32_t round = 0; round < 50; round++) {
+        std::vector<uint64_t> sums(64, 0);
+        workers.parallel(64, [&](uint32_t outer) {
+            std::atomic<uint64_t> sum{0};
+            workers.parallelFor(0, 10000, 16, [&](uint32_t first, uint32_t last) {
+                uint64_t local = 0;
+                for (uint32_t i = first; i < last; i++) { local += i; }
+                sum += local;
+            });
+            sums[outer] = sum;
+        });
+
+        workers.submit([&backgroundRuns] { backgroundRuns++; });
+        for (uint64_t sum : sums) { correct &= sum == 9999ull * 10000ull / 2; }
+    }
+
+    // A binary tree of forks from inside jobs, every leaf counts once.
+    std::atomic<uint32_t> leaves{0};
+    std::function<void(Counter&, uint32_t)> tree = [&](Counter& counter, uint32_t depth) {
+        if (depth == 0) {
+            leaves++;
+            return;
+        }
+
+        workers.run(counter, [&, depth] { tree(counter, depth - 1); });
+        workers.run(counter, [&, depth] { tree(counter, depth - 1); });
+    };
+
+    Counter treeCounter;
+    tree(treeCounter, 16);
+    workers.wait(treeCounter);
+    workers.wait();
+
+    correct &= leaves == (1u << 16) && backgroundRuns == 50;
+    std::cout << "    stress test " << (correct ? "passed" : "FAILED") << "\n";
+
+    // What forking and joining a single empty job costs.
+    const uint32_t jobs = 1000000;
+    Clock::time_point start = Clock::now();
+    Counter counter;
+    for (uint32_t i = 0; i < jobs; i++) { workers.run(counter, [] {}); }
+    workers.wait(counter);
+    double forked = milliseconds(start);
+
+    // A loop big enough to be worth splitting, against running it on one thread.
+    std::vector<float> values(1 << 24, 1.0f);
+    start = Clock::now();
+    for (float& value : values) { value = value * 1.0001f + 0.5f; }
+    double serial = milliseconds(start);
+
+    start = Clock::now();
+    workers.parallelFor(0, static_cast<uint32_t>(values.size()), 1 << 14, [&values](uint32_t first, uint32_t last) {
+        for (uint32_t i = first; i < last; i++) { values[i] = values[i] * 1.0001f + 0.5f; }
+    });
+    double split = milliseconds(start);
+
+    std::cout << "    " << jobs << " empty jobs from one thread took " << forked << " ms, " << forked * 1e6 / jobs << " ns each\n"
+        << "    parallelFor over " << values.size() << " floats took " << split << " ms against " << serial << " ms on one thread" << std::endl;
+}
@@ -0,0 +1,170 @@
+/*
+    workers.h
+    Adrenaline Engine
+
+    A work stealing job system. Every worker thread owns a Chase-Lev deque it pushes and pops jobs at the bottom
+    of, while idle threads steal from the top of everyone else's. Forked jobs are joined through counters, and a
+    thread waiting on one runs other jobs in the meantime instead of blocking. Jobs carry their callable inline and
+    are recycled through a free list, so once the pool has grown to what a frame forks nothing touches the heap.
+*/
+
+#pragma once
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <cstdint>
+#include "allocations.h"
+
+namespace Adren {
+class Workers {
+public:
+    // The number of jobs started against it that have not finished yet.
+    struct Counter {
+        std::atomic<uint32_t> pending{0};
+    };
+
+    // A count of 0 picks one thread less than the hardware has so the main thread keeps a core.
+    Workers(uint32_t count = 0);
+    ~Workers();
+
+    // Background work like pipeline compiles, which only idle workers pick up so nobody waiting on a counter
+    // gets stuck running it.
+    void submit(std::function<void()> job);
+
+    // Fork and join. A job run from a worker goes on that worker's own deque, from any other thread it goes
+    // on a shared queue. The callable is moved into the job itself, so it has to fit in one.
+    template <typename F>
+    void run(Counter& counter, F&& job) {
+        counter.pending.fetch_add(1, std::memory_order_relaxed);
+        push(make(std::forward<F>(job), &counter), false);
+    }
+
+    void wait(Counter& counter);
+
+    // Splits [first, last) in halves until they are at most grain long, idle threads steal the larger halves.
+    // The callable is only referred to, which keeps the std::function handed down small enough to never allocate.
+    template <typename F>
+    void parallelFor(uint32_t first, uint32_t last, uint32_t grain, F&& job) {
+        forRange(first, last, grain, [&job](uint32_t begin, uint32_t end) { job(begin, end); });
+    }
+
+    // Runs job(0) to job(count - 1) and returns once every one of them is done, the calling thread helps out.
+    template <typename F>
+    void parallel(uint32_t count, F&& job) {
+        parallelFor(0, count, 1, [&job](uint32_t first, uint32_t last) {
+            for (uint32_t i = first; i < last; i++) { job(i); }
+        });
+    }
+
+    // Blocks until every submitted job has finished running.
+    void wait();
+    uint32_t size() const { return static_cast<uint32_t>(threads.size()); }
+
+    static void benchmark();
+private:
+    // The callable lives in storage, invoke and destroy know its type. Next links the job into the free list by
+    // index, plus one so that 0 means the end.
+    struct Job {
+        alignas(std::max_align_t) unsigned char storage[64];
+        void (*invoke)(void*) = nullptr;
+        void (*destroy)(void*) = nullptr;
+        Counter* counter = nullptr;
+        Allocations::Subsystem subsystem = Allocations::Subsystem::Other; // Whoever pushed the job pays for what it allocates.
+        uint32_t index = 0;
+        std::atomic<uint32_t> next{0};
+    };
+
+    template <typename F>
+    Job* make(F&& work, Counter* counter) {
+        using T = std::decay_t<F>;
+        static_assert(sizeof(T) <= sizeof(Job::storage) && alignof(T) <= alignof(std::max_align_t), "Jobs carry their callable inline, capture by reference instead");
+
+        Job* job = acquire();
+        new (job->storage) T(std::forward<F>(work));
+        job->invoke = [](void* storage) { (*std::launder(static_cast<T*>(storage)))(); };
+        job->destroy = [](void* storage) { std::launder(static_cast<T*>(storage))->~T(); };
+        job->counter = counter;
+        job->subsystem = Allocations::charged();
+        return job;
+    }
+
+    // A plain ring of job pointers for the queues behind the mutex, it only allocates when it has to grow.
+    struct Queue {
+        std::vector<Job*> items = std::vector<Job*>(64);
+        size_t head = 0;
+        size_t count = 0;
+
+        bool empty() const { return count == 0; }
+        void push(Job* job);
+        Job* pop();
+    };
+
+    // Only the owner pushes and pops at the bottom, anyone may steal from the top. A full ring is replaced by one
+    // twice as big, the old ones are kept until the end since a thief might still be reading from them.
+    class Deque {
+    public:
+        Deque() { grow(nullptr, 0, 0); }
+
+        void push(Job* job);
+        Job* pop();
+        Job* steal();
+    private:
+        struct Ring {
+            int64_t capacity;
+            std::unique_ptr<std::atomic<Job*>[]> items;
+
+            Ring(int64_t capacity) : capacity(capacity), items(new std::atomic<Job*>[capacity]) {}
+            Job* get(int64_t i) const { return items[i & (capacity - 1)].load(std::memory_order_relaxed); }
+            void put(int64_t i, Job* job) { items[i & (capacity - 1)].store(job, std::memory_order_relaxed); }
+        };
+
+        Ring* grow(Ring* ring, int64_t top, int64_t bottom);
+
+        std::atomic<int64_t> top{0};
+        std::atomic<int64_t> bottom{0};
+        std::atomic<Ring*> ring{nullptr};
+        std::vector<std::unique_ptr<Ring>> rings;
+    };
+
+    void work(uint32_t index);
+    void push(Job* job, bool background);
+    Job* take(bool background);
+    void execute(Job* job);
+    void forRange(uint32_t first, uint32_t last, uint32_t grain, const std::function<void(uint32_t, uint32_t)>& job);
+    void split(Counter& counter, uint32_t first, uint32_t last, uint32_t grain, const std::function<void(uint32_t, uint32_t)>& job);
+
+    // Jobs are handed out and taken back through a lock free stack. The head packs a tag above the slot so a job
+    // popped and pushed again in between is told apart. Blocks are only ever added, and only under growing.
+    Job* acquire();
+    void recycle(Job* job);
+    void grow();
+    Job* slot(uint32_t index) { return &blocks[index / blockSize].load(std::memory_order_acquire)[index % blockSize]; }
+
+    static const uint32_t blockSize = 1024;
+    static const uint32_t maxBlocks = 4096;
+    std::atomic<Job*> blocks[maxBlocks] = {};
+    std::atomic<uint32_t> blockCount{0};
+    std::atomic<uint64_t> spare{0};
+    std::mutex growing;
+
+    std::vector<std::thread> threads;
+    std::vector<std::unique_ptr<Deque>> deques;
+
+    // Jobs from threads outside the pool and background jobs, neither of which has a deque to go on.
+    Queue shared;
+    Queue background;
+    std::mutex mutex;
+    std::condition_variable wake;
+
+    std::atomic<int64_t> queued{0};
+    std::atomic<uint32_t> sleeping{0};
+    std::atomic<bool> stopping{false};
+    Counter submitted;
+};
+}
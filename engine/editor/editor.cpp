@@ -1,20 +1,38 @@
 #include "editor.h"
 #include <imgui.h>
+#include "core/profiler.h"
+#include "renderer/memory.h"
+#include <glm/gtc/type_ptr.hpp>
 
 void Adren::Editor::start() {
+    ADREN_PROFILE_FUNCTION();
+    Allocations::Scope charged(Allocations::Subsystem::Editor);
     //bool yep = true;
     //ImGui::ShowDemoWindow(&yep);
 
     if (showCameraInfo) { cameraInfo(&showCameraInfo); }
+    if (showRenderStats) { renderStats(&showRenderStats); }
+    if (showModelTransforms) { modelTransforms(&showModelTransforms); }
+    if (showFrameTimings) { frameTimings(&showFrameTimings); }
+    if (showGpuMemory) { gpuMemory(&showGpuMemory); }
+    if (showCpuMemory) { cpuMemory(&showCpuMemory); }
+    if (recordingPath) { path.poses.push_back({ camera.pos, camera.front }); }
 
     if (ImGui::BeginMainMenuBar()) {
         if (ImGui::BeginMenu("Debug")) {
             ImGui::MenuItem("Camera Properties", " ", &showCameraInfo);
+            ImGui::MenuItem("Render Statistics", " ", &showRenderStats);
+            ImGui::MenuItem("Model Transforms", " ", &showModelTransforms);
+            ImGui::MenuItem("Frame Timings", " ", &showFrameTimings);
+            ImGui::MenuItem("GPU Memory", " ", &showGpuMemory);
+            ImGui::MenuItem("CPU Memory", " ", &showCpuMemory);
+            ImGui::MenuItem("Record Input", " ", &recordInput);
             ImGui::EndMenu();
         }
 
         if (ImGui::BeginMenu("File")) {
             importModel();
+            ImGui::EndMenu();
         }
 
         ImGui::EndMainMenuBar();
@@ -48,6 +66,17 @@ void Adren::Editor::cameraInfo(bool* open) {
             ImGui::InputFloat3("Camera Position", glm::value_ptr(camera.pos));
             ImGui::Text("Camera Speed");
             ImGui::SliderFloat("0.001 to 100.0", &camera.speed, 0.001f, 100.0f, format);
+
+            // One pose a frame while recording, the benchmarks play the saved path back frame for frame.
+            if (!recordingPath && ImGui::Button("Record Camera Path")) {
+                path.poses.clear();
+                recordingPath = true;
+            } else if (recordingPath && ImGui::Button("Stop and Save Camera Path")) {
+                recordingPath = false;
+                path.save("adrenaline-path.txt");
+            }
+
+            if (recordingPath) { ImGui::Text("Recorded %zu frames", path.poses.size()); }
             ImGui::EndTabItem();
         }
 
@@ -57,6 +86,192 @@ void Adren::Editor::cameraInfo(bool* open) {
     ImGui::End();
 }
 
+// The GPU passes come from timestamps a few frames old, the CPU stages from the render thread's last frames.
+void Adren::Editor::frameTimings(bool* open) {
+    ImGui::Begin("Frame Timings", open);
+
+    auto table = [](const char* id, const std::vector<PassTiming>& timings) {
+        if (!ImGui::BeginTable(id, 5, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV)) { return; }
+
+        ImGui::TableSetupColumn(id);
+        ImGui::TableSetupColumn("Last");
+        ImGui::TableSetupColumn("Min");
+        ImGui::TableSetupColumn("Avg");
+        ImGui::TableSetupColumn("Max");
+        ImGui::TableHeadersRow();
+
+        for (const PassTiming& timing : timings) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn(); ImGui::TextUnformatted(timing.name.c_str());
+            ImGui::TableNextColumn(); ImGui::Text("%.3f", timing.last);
+            ImGui::TableNextColumn(); ImGui::Text("%.3f", timing.min);
+            ImGui::TableNextColumn(); ImGui::Text("%.3f", timing.avg);
+            ImGui::TableNextColumn(); ImGui::Text("%.3f", timing.max);
+        }
+
+        ImGui::EndTable();
+    };
+
+    if (stats.gpuTimings.empty()) { ImGui::Text("No GPU timestamps on this device."); } else { table("GPU (ms)", stats.gpuTimings); }
+    ImGui::Spacing();
+    table("CPU (ms)", stats.cpuTimings);
+
+    ImGui::End();
+}
+
+// Budgets and usage are this frame's, the largest free range only refreshes every so often.
+void Adren::Editor::gpuMemory(bool* open) {
+    ImGui::Begin("GPU Memory", open);
+    const MemoryStats& memory = stats.gpuMemory;
+    auto mb = [](uint64_t bytes) { return bytes / (1024.0 * 1024.0); };
+
+    if (memory.nearBudget) { ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.3f, 1.0f), "A heap is past %.0f%% of its budget!", Memory::warning * 100.0f); }
+
+    if (ImGui::BeginTable("Heaps", 6, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV)) {
+        ImGui::TableSetupColumn("Heap");
+        ImGui::TableSetupColumn("Usage / budget (MB)");
+        ImGui::TableSetupColumn("Blocks (MB)");
+        ImGui::TableSetupColumn("Allocated (MB)");
+        ImGui::TableSetupColumn("Allocations");
+        ImGui::TableSetupColumn("Largest free (MB)");
+        ImGui::TableHeadersRow();
+
+        for (size_t i = 0; i < memory.heaps.size(); i++) {
+            const HeapStats& heap = memory.heaps[i];
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn(); ImGui::Text("%zu%s", i, heap.deviceLocal ? " (device)" : "");
+            ImGui::TableNextColumn();
+            ImGui::ProgressBar(heap.budget ? static_cast<float>(heap.usage) / heap.budget : 0.0f, ImVec2(-1.0f, 0.0f), nullptr);
+            ImGui::SameLine(); ImGui::Text("%.1f / %.1f", mb(heap.usage), mb(heap.budget));
+            ImGui::TableNextColumn(); ImGui::Text("%.1f", mb(heap.blocks));
+            ImGui::TableNextColumn(); ImGui::Text("%.1f", mb(heap.allocated));
+            ImGui::TableNextColumn(); ImGui::Text("%u", heap.allocations);
+            ImGui::TableNextColumn(); ImGui::Text("%.1f", mb(heap.largestFree));
+        }
+
+        ImGui::EndTable();
+    }
+
+    ImGui::Spacing();
+    if (ImGui::BeginTable("Categories", 3, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV)) {
+        ImGui::TableSetupColumn("Category");
+        ImGui::TableSetupColumn("MB");
+        ImGui::TableSetupColumn("Allocations");
+        ImGui::TableHeadersRow();
+
+        for (size_t i = 0; i < memory.bytes.size(); i++) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn(); ImGui::TextUnformatted(Memory::name(static_cast<MemoryCategory>(i)));
+            ImGui::TableNextColumn(); ImGui::Text("%.2f", mb(memory.bytes[i]));
+            ImGui::TableNextColumn(); ImGui::Text("%u", memory.counts[i]);
+        }
+
+        ImGui::EndTable();
+    }
+
+    if (ImGui::Button("Save Memory Report")) { saveMemory = true; }
+    ImGui::End();
+}
+
+// Live and peak bytes are read every frame, the allocation rates are averaged over about a second.
+void Adren::Editor::cpuMemory(bool* open) {
+    ImGui::Begin("CPU Memory", open);
+    if (!Allocations::tracking()) {
+        ImGui::TextWrapped("Build with ADREN_TRACK_MEMORY to see the heap by subsystem.");
+        ImGui::End();
+        return;
+    }
+
+    Allocations::Report usage = Allocations::usage();
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - sampledAt).count();
+    if (elapsed >= 1.0) {
+        for (size_t i = 0; i < usage.size(); i++) { rates[i] = (usage[i].allocations - sampled[i].allocations) / elapsed; }
+        sampled = usage;
+        sampledAt = now;
+    }
+
+    auto mb = [](uint64_t bytes) { return bytes / (1024.0 * 1024.0); };
+    if (ImGui::BeginTable("Subsystems", 4, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV)) {
+        ImGui::TableSetupColumn("Subsystem");
+        ImGui::TableSetupColumn("Live (MB)");
+        ImGui::TableSetupColumn("Peak (MB)");
+        ImGui::TableSetupColumn("Allocations / s");
+        ImGui::TableHeadersRow();
+
+        for (size_t i = 0; i < usage.size(); i++) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn(); ImGui::TextUnformatted(usage[i].name);
+            ImGui::TableNextColumn(); ImGui::Text("%.2f", mb(usage[i].live));
+            ImGui::TableNextColumn(); ImGui::Text("%.2f", mb(usage[i].peak));
+            ImGui::TableNextColumn(); ImGui::Text("%.0f", rates[i]);
+        }
+
+        ImGui::EndTable();
+    }
+
+    ImGui::End();
+}
+
+void Adren::Editor::renderStats(bool* open) {
+    ImGui::Begin("Render Statistics", open);
+    ImGui::Checkbox("Frustum Culling", &settings.frustumCulling);
+    ImGui::Checkbox("Hierarchical Culling (BVH)", &settings.hierarchicalCulling);
+    ImGui::Checkbox("GPU Culling", &settings.gpuCulling);
+    ImGui::Checkbox("Occlusion Culling (GPU only)", &settings.occlusionCulling);
+    ImGui::Checkbox("Occlusion Culling (CPU rasterizer)", &settings.softwareOcclusion);
+    ImGui::Checkbox("Instancing", &settings.instancing);
+    ImGui::Checkbox("Sort Draws", &settings.sortDraws);
+
+    int threads = static_cast<int>(settings.recordThreads);
+    if (ImGui::SliderInt("Recording Threads", &threads, 1, static_cast<int>(stats.recorders))) { settings.recordThreads = static_cast<uint32_t>(threads); }
+    if (!settings.measureRecording && ImGui::Button("Measure Recording Scaling")) { settings.measureRecording = true; }
+    ImGui::Text("Recording: %.3f ms", stats.recording);
+
+#ifdef ADREN_PROFILE
+    // Writes everything the profiler caught since the last save, startup included the first time.
+    if (ImGui::Button("Save CPU Trace")) { Profiler::save("adrenaline-trace.json"); }
+#endif
+
+    ImGui::Checkbox("Fixed Timestep", &settings.fixedStep);
+    int rate = static_cast<int>(settings.tickRate);
+    if (ImGui::SliderInt("Tick Rate (Hz)", &rate, 10, 240)) { settings.tickRate = static_cast<uint32_t>(rate); }
+    ImGui::Text("Ticks this frame: %u", stats.ticks);
+    ImGui::Text("Culled on the %s", stats.gpu ? "GPU" : "CPU");
+    ImGui::Text("Draws: %u", stats.draws);
+    ImGui::Text("Drawn: %u", stats.drawn);
+    ImGui::Text("Culled: %u", stats.culled);
+    ImGui::Text("Occluded: %u", stats.occluded);
+    ImGui::Text("Draw calls: %u", stats.recorded.calls);
+    ImGui::Text("GPU memory: %.1f MB", stats.memory / (1024.0 * 1024.0));
+    ImGui::Text("Allocations per frame: %u, frame arena: %.1f KB", stats.allocations, stats.arena / 1024.0);
+    ImGui::Text("Binds: %u pipelines, %u sets, %u pushes", stats.recorded.pipelines, stats.recorded.sets, stats.recorded.pushes);
+    if (stats.picked >= 0) { ImGui::Text("Picked: draw %d", stats.picked); } else { ImGui::Text("Picked: nothing"); }
+    ImGui::End();
+}
+
+// Any change flags the placement as moved, the renderer then only updates the transforms under it.
+void Adren::Editor::modelTransforms(bool* open) {
+    ImGui::Begin("Model Transforms", open);
+    world.each<Placement, Asset>([](ECS::Entity entity, Placement& placement, Asset& asset) {
+        ImGui::PushID(static_cast<int>(entity.index));
+        ImGui::Text("Entity %u (model %u)", entity.index, asset.model);
+
+        bool changed = false;
+        changed |= ImGui::DragFloat3("Position", glm::value_ptr(placement.position), 0.1f);
+        changed |= ImGui::SliderFloat("Rotation", &placement.rotation, -180.0f, 180.0f);
+        changed |= ImGui::DragFloat("Scale", &placement.scale, 0.01f, 0.001f, 1000.0f);
+        if (changed) { placement.moved = true; }
+
+        ImGui::PopID();
+    });
+
+    uint32_t lights = 0, views = 0;
+    world.each<Light>([&lights](ECS::Entity, Light&) { lights++; });
+    world.each<View>([&views](ECS::Entity, View&) { views++; });
+    ImGui::Text("Entities: %u, lights: %u, cameras: %u", world.size(), lights, views);
+    ImGui::End();
+}
 
 void Adren::Editor::importModel() {
     std::string path = "../engine/resources/models/sponza/Sponza.gltf";
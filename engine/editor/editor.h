@@ -1,22 +1,56 @@
 #pragma once
 #include <vector>
 #include <string>
+#include <array>
+#include <chrono>
 #include <glfw/glfw3.h>
 #include "renderer/camera.h"
+#include "renderer/types.h"
+#include "renderer/components.h"
+#include "core/ecs.h"
+#include "core/allocations.h"
 
 namespace Adren {
 
 class Editor {
 public:
-    Editor(Camera& camera) : camera(camera) {}
+    Editor(Camera& camera, Settings& settings, RenderStats& stats, ECS::World& world) : camera(camera), settings(settings), stats(stats), world(world) {}
 
     void start();
     void cameraInfo(bool* open);
+    void renderStats(bool* open);
+    void modelTransforms(bool* open);
+    void frameTimings(bool* open);
+    void gpuMemory(bool* open);
+    void cpuMemory(bool* open);
     void style();
     void importModel();
     std::vector<std::string> modelPaths;
+
+    // The engine starts recording input when this turns on and saves the log when it turns off.
+    bool recordInput = false;
+
+    // The engine writes the GPU memory report when this is set and clears it again.
+    bool saveMemory = false;
 private:
     Camera& camera;
+    Settings& settings;
+    RenderStats& stats;
+    ECS::World& world;
+
+    bool showCameraInfo = false;
+    bool showRenderStats = false;
+    bool showModelTransforms = false;
+    bool showFrameTimings = false;
+    bool showGpuMemory = false;
+    bool showCpuMemory = false;
+
+    Allocations::Report sampled{};
+    std::array<double, static_cast<size_t>(Allocations::Subsystem::Count)> rates{};
+    std::chrono::steady_clock::time_point sampledAt;
+
+    CameraPath path;
+    bool recordingPath = false;
 };
 }
 
@@ -6,60 +6,83 @@
 */
 
 #include "buffers.h"
+#include <algorithm>
 
+// Only models that aren't resident yet are uploaded. What is already on the GPU is copied across from the old buffers
+// there, so the CPU never gathers or keeps the geometry of the models it uploaded before.
 void Adren::Buffers::createModelBuffers(std::vector<Model>& models, VkCommandPool& commandPool) {
-    std::vector<Vertex> vertices;
-    std::vector<uint32_t> indices;
-
-    for (auto& model : models) {
-        indices.insert(indices.end(), model.indices.begin(), model.indices.end());
-        vertices.insert(vertices.end(), model.vertices.begin(), model.vertices.end());
+    VkDeviceSize vertexBytes = 0;
+    VkDeviceSize indexBytes = 0;
+    for (const Model& model : models) {
+        if (model.resident) { continue; }
+        vertexBytes += sizeof(Vertex) * model.vertices.size();
+        indexBytes += sizeof(uint32_t) * model.indices.size();
     }
 
-    vertex.size = sizeof(vertices[0]) * vertices.size();
-    Buffer vStaging;
-    createBuffer(allocator, vertex.size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, vStaging, VMA_MEMORY_USAGE_AUTO);
-
-    vmaMapMemory(allocator, vStaging.memory, &vStaging.mapped);
-    memcpy(vStaging.mapped, vertices.data(), (size_t)vertex.size);
-    vmaUnmapMemory(allocator, vStaging.memory);
+    if (vertexBytes > 0) {
+        Buffer staging = createStaging(vertexBytes);
+        uint8_t* data = static_cast<uint8_t*>(staging.mapped);
+        for (const Model& model : models) {
+            if (model.resident) { continue; }
+            memcpy(data, model.vertices.data(), sizeof(Vertex) * model.vertices.size());
+            data += sizeof(Vertex) * model.vertices.size();
+        }
 
-    createBuffer(allocator, vertex.size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertex, VMA_MEMORY_USAGE_GPU_ONLY);
+        append(vertex, staging, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, commandPool);
+    }
 
-    copyBuffer(vStaging.buffer, vertex.buffer, vertex.size, commandPool);
+    if (indexBytes > 0) {
+        Buffer staging = createStaging(indexBytes);
+        uint8_t* data = static_cast<uint8_t*>(staging.mapped);
+        for (const Model& model : models) {
+            if (model.resident) { continue; }
+            memcpy(data, model.indices.data(), sizeof(uint32_t) * model.indices.size());
+            data += sizeof(uint32_t) * model.indices.size();
+        }
 
-    vmaDestroyBuffer(allocator, vStaging.buffer, vStaging.memory);
+        append(index, staging, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, commandPool);
+    }
+}
 
-    index.size = sizeof(indices[0]) * indices.size();
+// Left mapped for the caller to fill, append unmaps and destroys it.
+Buffer Adren::Buffers::createStaging(VkDeviceSize size) {
+    Buffer staging;
+    staging.size = size;
+    createBuffer(allocator, staging.size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging, VMA_MEMORY_USAGE_AUTO, MemoryCategory::Staging);
+    vmaMapMemory(allocator, staging.memory, &staging.mapped);
+    return staging;
+}
 
-    Buffer iStaging;
-    createBuffer(allocator, index.size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, iStaging, VMA_MEMORY_USAGE_AUTO);
+// The buffer is replaced by one holding its old contents followed by the staged ones.
+void Adren::Buffers::append(Buffer& buffer, Buffer& staging, VkBufferUsageFlags usage, VkCommandPool& commandPool) {
+    vmaUnmapMemory(allocator, staging.memory);
 
-    vmaMapMemory(allocator, iStaging.memory, &iStaging.mapped);
-    memcpy(iStaging.mapped, indices.data(), (size_t)index.size);
-    vmaUnmapMemory(allocator, iStaging.memory);
+    Buffer grown;
+    grown.size = buffer.size + staging.size;
+    createBuffer(allocator, grown.size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, grown, VMA_MEMORY_USAGE_GPU_ONLY, MemoryCategory::Geometry);
 
-    createBuffer(allocator, index.size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, index, VMA_MEMORY_USAGE_GPU_ONLY);
-    copyBuffer(iStaging.buffer, index.buffer, index.size, commandPool);
+    if (buffer.size > 0) { copyBuffer(buffer.buffer, grown.buffer, buffer.size, commandPool); }
+    copyBuffer(staging.buffer, grown.buffer, staging.size, commandPool, buffer.size);
 
-    vmaDestroyBuffer(allocator, iStaging.buffer, iStaging.memory);
+    Memory::destroyBuffer(allocator, staging.buffer, staging.memory);
+    Memory::destroyBuffer(allocator, buffer.buffer, buffer.memory);
+    buffer = grown;
 }
 
-void Adren::Buffers::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkCommandPool& commandPool) {
+void Adren::Buffers::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkCommandPool& commandPool, VkDeviceSize dstOffset) {
     VkCommandBuffer commandBuffer = Adren::Tools::beginSingleTimeCommands(device, commandPool);
 
     VkBufferCopy copyRegion{};
+    copyRegion.dstOffset = dstOffset;
     copyRegion.size = size;
     vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
 
     Adren::Tools::endSingleTimeCommands(commandBuffer, device, graphicsQueue, commandPool);
 }
 
-void Adren::Buffers::createBuffer(VmaAllocator& allocator, VkDeviceSize& size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, Buffer& buffer, VmaMemoryUsage vmaUsage) {
+void Adren::Buffers::createBuffer(VmaAllocator& allocator, VkDeviceSize& size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, Buffer& buffer, VmaMemoryUsage vmaUsage, MemoryCategory category) {
     VkBufferCreateInfo bufferInfo{};
     bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     bufferInfo.size = size;
@@ -71,25 +94,23 @@ void Adren::Buffers::createBuffer(VmaAllocator& allocator, VkDeviceSize& size, V
     vmaAllocInfo.preferredFlags = properties;
 
     vmaCreateBuffer(allocator, &bufferInfo, &vmaAllocInfo, &buffer.buffer, &buffer.memory, nullptr);
+    Memory::track(allocator, buffer.memory, category);
 }
 
 void Adren::Buffers::createUniformBuffers(std::vector<VkImage>& images, std::vector<Model>& models) {
-    // Uniform buffer creation
+    // The camera gets an aligned region per frame in flight, set n of the descriptor sets reads region n.
     UniformBufferObject ubo;
-    uniform.size = sizeof(ubo);
+    VkPhysicalDeviceProperties gpuProperties{};
+    vkGetPhysicalDeviceProperties(gpu, &gpuProperties);
+    VkDeviceSize minUboAlignment = std::max<VkDeviceSize>(gpuProperties.limits.minUniformBufferOffsetAlignment, 1);
+    uniform.align = (sizeof(ubo) + minUboAlignment - 1) / minUboAlignment * minUboAlignment;
+    uniform.size = uniform.align * maxFramesInFlight;
 
     createBuffer(allocator, uniform.size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        uniform, VMA_MEMORY_USAGE_GPU_ONLY);
+        uniform, VMA_MEMORY_USAGE_GPU_ONLY, MemoryCategory::Uniforms);
     vmaMapMemory(allocator, uniform.memory, &uniform.mapped);
-    memcpy(uniform.mapped, &ubo, uniform.size);
-
-    // Dynamic uniform buffer creation
-    VkPhysicalDeviceProperties gpuProperties{};
-    vkGetPhysicalDeviceProperties(gpu, &gpuProperties);
-    VkDeviceSize minUboAlignment = gpuProperties.limits.minUniformBufferOffsetAlignment;
-    dynamicUniform.align = sizeof(glm::mat4);
-    if (minUboAlignment > 0) {
-        dynamicUniform.align = (dynamicUniform.align + minUboAlignment - 1) & ~(minUboAlignment - 1);
+    for (uint32_t frame = 0; frame < maxFramesInFlight; frame++) {
+        memcpy(static_cast<char*>(uniform.mapped) + uniform.align * frame, &ubo, sizeof(ubo));
     }
 
     uint32_t modelSize = 0;
@@ -100,49 +121,85 @@ void Adren::Buffers::createUniformBuffers(std::vector<VkImage>& images, std::vec
         }
     }
 
-    dynamicUniform.size = dynamicUniform.align * modelSize;
-    uboData.model = (glm::mat4*)Adren::Tools::alignedAlloc(dynamicUniform.size, dynamicUniform.align);
+    createDynamicUniformBuffer(modelSize);
+}
+
+// One aligned slot per node for every frame in flight, placing a model more than once needs more of them so this
+// replaces any old buffer. Nothing is written here, the slots are marked and each frame fills its own copy.
+void Adren::Buffers::createDynamicUniformBuffer(uint32_t slots) {
+    if (dynamicUniform.size > 0) {
+        vmaUnmapMemory(allocator, dynamicUniform.memory);
+        Memory::destroyBuffer(allocator, dynamicUniform.buffer, dynamicUniform.memory);
+    }
+
+    if (uboData.model) { Adren::Tools::alignedFree(uboData.model); }
+
+    VkPhysicalDeviceProperties gpuProperties{};
+    vkGetPhysicalDeviceProperties(gpu, &gpuProperties);
+    VkDeviceSize minUboAlignment = gpuProperties.limits.minUniformBufferOffsetAlignment;
+    dynamicUniform.align = sizeof(glm::mat4);
+    if (minUboAlignment > 0) {
+        dynamicUniform.align = (dynamicUniform.align + minUboAlignment - 1) & ~(minUboAlignment - 1);
+    }
+
+    dynamicRegion = dynamicUniform.align * std::max(slots, 1u);
+    dynamicUniform.size = dynamicRegion * maxFramesInFlight;
+    uboData.model = (glm::mat4*)Adren::Tools::alignedAlloc(dynamicRegion, dynamicUniform.align);
     assert(uboData.model);
 
-    createBuffer(allocator, dynamicUniform.size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, dynamicUniform, VMA_MEMORY_USAGE_AUTO);
+    createBuffer(allocator, dynamicUniform.size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, dynamicUniform, VMA_MEMORY_USAGE_AUTO, MemoryCategory::Uniforms);
     vmaMapMemory(allocator, dynamicUniform.memory, &dynamicUniform.mapped);
-    memcpy(dynamicUniform.mapped, uboData.model, dynamicUniform.size);
+    markDynamicUniformBuffer(0, slots);
 }
 
-void Adren::Buffers::updateUniformBuffer(Camera& camera, VkExtent2D& extent) {
+// Only this frame's region is written, its fence has been waited on while the other frames in flight may still
+// be reading theirs.
+void Adren::Buffers::updateUniformBuffer(Camera& camera, VkExtent2D& extent, uint32_t frame) {
     UniformBufferObject ubo{};
-    ubo.view = glm::lookAt(camera.pos, camera.pos + camera.front, camera.up);
+    ubo.view = camera.view();
+    ubo.proj = camera.projection();
+    memcpy(static_cast<char*>(uniform.mapped) + uniform.align * frame, &ubo, sizeof(ubo));
+}
 
-    float screen = (float)camera.width / (float)camera.height;
-    uint32_t distance = camera.drawDistance * 1000;
-    ubo.proj = glm::perspective(glm::radians((float)camera.fov), screen, 0.1f, (float)distance);
-    ubo.proj[1][1] *= -1;
-    memcpy(uniform.mapped, &ubo, sizeof(ubo));
+// Transforms reports which slots changed, every frame's copy needs them before it is next drawn with.
+void Adren::Buffers::markDynamicUniformBuffer(uint32_t first, uint32_t count) {
+    if (count == 0) { return; }
+
+    for (Dirty& range : dirty) {
+        range.first = std::min(range.first, first);
+        range.end = std::max(range.end, first + count);
+    }
 }
 
-void Adren::Buffers::updateDynamicUniformBuffer(std::vector<Model>& models) {
-    std::vector<glm::mat4> matrices;
-    for (Model& model : models) {
-        for (Model::Node& node : model.nodes) {
-            matrices.push_back(node.matrix);
-            model.count(matrices, node.children);
-        }
+// Writes and flushes only the slots of this frame's copy that changed since it was last drawn with. The frame's
+// fence has been waited on, the copies of the other frames in flight may still be read by the GPU.
+void Adren::Buffers::updateDynamicUniformBuffer(const std::vector<glm::mat4>& matrices, uint32_t frame) {
+    Dirty& range = dirty[frame];
+    uint32_t end = std::min(range.end, static_cast<uint32_t>(matrices.size()));
+    if (range.first >= end) {
+        range = {};
+        return;
+    }
+
+    // Every matrix sits at its own aligned slot, which is what the dynamic offsets in Scene point at.
+    char* region = static_cast<char*>(dynamicUniform.mapped) + frame * dynamicRegion;
+    for (size_t i = range.first; i < end; i++) {
+        memcpy(region + i * dynamicUniform.align, &matrices[i], sizeof(glm::mat4));
     }
 
-    VkDeviceSize alignment = dynamicUniform.align * matrices.size();
-    memcpy(dynamicUniform.mapped, matrices.data(), alignment);
-    vmaFlushAllocation(allocator, dynamicUniform.memory, alignment, sizeof(glm::mat4));
+    vmaFlushAllocation(allocator, dynamicUniform.memory, frame * dynamicRegion + range.first * dynamicUniform.align, dynamicUniform.align * (end - range.first));
+    range = {};
 }
 
 void Adren::Buffers::cleanup() {
     if (uboData.model) { Adren::Tools::alignedFree(uboData.model); }
 
-    vmaDestroyBuffer(allocator, vertex.buffer, vertex.memory);
-    vmaDestroyBuffer(allocator, index.buffer, index.memory);
+    Memory::destroyBuffer(allocator, vertex.buffer, vertex.memory);
+    Memory::destroyBuffer(allocator, index.buffer, index.memory);
 
-    vmaDestroyBuffer(allocator, uniform.buffer, uniform.memory);
     vmaUnmapMemory(allocator, uniform.memory);
+    Memory::destroyBuffer(allocator, uniform.buffer, uniform.memory);
 
-    vmaDestroyBuffer(allocator, dynamicUniform.buffer, dynamicUniform.memory);
     vmaUnmapMemory(allocator, dynamicUniform.memory);
+    Memory::destroyBuffer(allocator, dynamicUniform.buffer, dynamicUniform.memory);
 }
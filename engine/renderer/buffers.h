@@ -11,6 +11,7 @@
 #include "camera.h"
 #include "model.h"
 #include "tools.h"
+#include "memory.h"
 
 namespace Adren {
 class Buffers {
@@ -19,9 +20,11 @@ public:
 
 	void createModelBuffers(std::vector<Model>& models, VkCommandPool& commandPool);
 	void createUniformBuffers(std::vector<VkImage>& images, std::vector<Model>& models);
-	void updateUniformBuffer(Camera& camera, VkExtent2D& extent);
-	void updateDynamicUniformBuffer(std::vector<Model>& models);
-	void createBuffer(VmaAllocator& allocator, VkDeviceSize& size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, Buffer& buffer, VmaMemoryUsage vmaUsage);
+	void createDynamicUniformBuffer(uint32_t slots);
+	void updateUniformBuffer(Camera& camera, VkExtent2D& extent, uint32_t frame);
+	void markDynamicUniformBuffer(uint32_t first, uint32_t count);
+	void updateDynamicUniformBuffer(const std::vector<glm::mat4>& matrices, uint32_t frame);
+	void createBuffer(VmaAllocator& allocator, VkDeviceSize& size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, Buffer& buffer, VmaMemoryUsage vmaUsage, MemoryCategory category);
 	void cleanup();
 
 	Buffer vertex;
@@ -29,8 +32,19 @@ public:
 	Buffer uniform;
 	Buffer dynamicUniform;
 	UboData uboData;
+
+	// Every frame in flight has its own copy of the slots, frame n binds its draws this many bytes times n further in.
+	VkDeviceSize dynamicRegion = 0;
 private:
-	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkCommandPool& commandPool);
+	// The slots changed since each frame's copy was last written, empty once it is up to date.
+	struct Dirty {
+		uint32_t first = UINT32_MAX;
+		uint32_t end = 0;
+	} dirty[maxFramesInFlight];
+
+	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkCommandPool& commandPool, VkDeviceSize dstOffset = 0);
+	Buffer createStaging(VkDeviceSize size);
+	void append(Buffer& buffer, Buffer& staging, VkBufferUsageFlags usage, VkCommandPool& commandPool);
 
 	Devices& devices;
 	VkDevice& device = devices.device;
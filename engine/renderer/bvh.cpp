@@ -0,0 +1,390 @@
+/*
+	bvh.cpp
+	Adrenaline Engine
+
+	Definitions for building, refitting and querying the bounding volume hierarchy.
+*/
+
+#include "bvh.h"
+#include "types.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <random>
+
+namespace {
+const float infinity = std::numeric_limits<float>::infinity();
+
+// Half the surface area, which is all the heuristic needs since only ratios of it are compared.
+float area(const glm::vec3& min, const glm::vec3& max) {
+	glm::vec3 size = max - min;
+	return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+// Returns false when the box is completely outside one of the planes still in the mask. Planes the box is
+// completely inside of are taken out of the mask, so nothing below this box gets tested against them again.
+bool classify(const Adren::Culling::Frustum& frustum, const glm::vec3& min, const glm::vec3& max, uint32_t& mask) {
+	glm::vec3 center = (min + max) * 0.5f;
+	glm::vec3 extent = (max - min) * 0.5f;
+
+	for (uint32_t p = 0; p < 6; p++) {
+		if (!(mask & (1u << p))) { continue; }
+
+		const glm::vec4& plane = frustum.planes[p];
+		float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+		float radius = glm::dot(glm::abs(glm::vec3(plane)), extent);
+
+		if (distance + radius < 0.0f) { return false; }
+		if (distance - radius >= 0.0f) { mask &= ~(1u << p); }
+	}
+
+	return true;
+}
+
+// Slab test, gives the distance the ray enters the box at or infinity if it misses it.
+float intersect(const glm::vec3& min, const glm::vec3& max, const glm::vec3& origin, const glm::vec3& inverse) {
+	glm::vec3 t0 = (min - origin) * inverse;
+	glm::vec3 t1 = (max - origin) * inverse;
+	glm::vec3 lo = glm::min(t0, t1);
+	glm::vec3 hi = glm::max(t0, t1);
+
+	float enter = std::max(std::max(lo.x, lo.y), std::max(lo.z, 0.0f));
+	float exit = std::min(std::min(hi.x, hi.y), hi.z);
+	return enter <= exit ? enter : infinity;
+}
+}
+
+void Adren::BVH::load(const Culling::Bounds& bounds, uint32_t item, Box& box) const {
+	glm::vec3 center(bounds.centerX[item], bounds.centerY[item], bounds.centerZ[item]);
+	glm::vec3 extent(bounds.extentX[item], bounds.extentY[item], bounds.extentZ[item]);
+	box.min = center - extent;
+	box.max = center + extent;
+}
+
+void Adren::BVH::build(const Culling::Bounds& bounds) {
+	nodes.clear();
+	items.resize(bounds.count);
+	boxes.resize(bounds.count);
+	centroids.resize(bounds.count);
+	std::iota(items.begin(), items.end(), 0);
+
+	for (uint32_t i = 0; i < bounds.count; i++) {
+		load(bounds, i, boxes[i]);
+		centroids[i] = (boxes[i].min + boxes[i].max) * 0.5f;
+	}
+
+	if (bounds.count == 0) { return; }
+
+	nodes.reserve(2 * (bounds.count / leafSize + 1));
+	split(0, bounds.count, 0);
+
+	// The boxes were indexed by item while building, afterwards they follow the leaves instead.
+	std::vector<Box> ordered(boxes.size());
+	for (uint32_t k = 0; k < items.size(); k++) {
+		ordered[k] = boxes[items[k]];
+	}
+
+	boxes.swap(ordered);
+	centroids.clear();
+	centroids.shrink_to_fit();
+}
+
+// Builds the node for items[first, first + count) and everything under it, then returns its index.
+// The items get partitioned in place so every subtree ends up owning one contiguous range of them.
+uint32_t Adren::BVH::split(uint32_t first, uint32_t count, uint32_t depth) {
+	uint32_t index = static_cast<uint32_t>(nodes.size());
+	nodes.push_back({});
+
+	glm::vec3 min(infinity), max(-infinity);
+	glm::vec3 centroidMin(infinity), centroidMax(-infinity);
+	for (uint32_t k = first; k < first + count; k++) {
+		const Box& box = boxes[items[k]];
+		min = glm::min(min, box.min);
+		max = glm::max(max, box.max);
+		centroidMin = glm::min(centroidMin, centroids[items[k]]);
+		centroidMax = glm::max(centroidMax, centroids[items[k]]);
+	}
+
+	nodes[index].min = min;
+	nodes[index].max = max;
+
+	auto leaf = [&]() -> uint32_t {
+		nodes[index].index = first;
+		nodes[index].count = count;
+		return index;
+	};
+
+	if (count <= leafSize || depth >= maxDepth) { return leaf(); }
+
+	// Binned SAH: centroids are dropped into a few buckets per axis and every boundary between buckets is costed.
+	struct Bin {
+		glm::vec3 min = glm::vec3(infinity);
+		glm::vec3 max = glm::vec3(-infinity);
+		uint32_t count = 0;
+	};
+
+	float bestCost = infinity;
+	int32_t bestAxis = -1;
+	uint32_t bestBin = 0;
+
+	for (int32_t axis = 0; axis < 3; axis++) {
+		float extent = centroidMax[axis] - centroidMin[axis];
+		if (extent <= 0.0f) { continue; }
+
+		Bin bin[bins];
+		float scale = bins / extent;
+		for (uint32_t k = first; k < first + count; k++) {
+			uint32_t b = std::min(bins - 1, static_cast<uint32_t>((centroids[items[k]][axis] - centroidMin[axis]) * scale));
+			bin[b].min = glm::min(bin[b].min, boxes[items[k]].min);
+			bin[b].max = glm::max(bin[b].max, boxes[items[k]].max);
+			bin[b].count++;
+		}
+
+		// Sweep from the right first so the left sweep can cost every boundary in one pass.
+		float rightArea[bins];
+		uint32_t rightCount[bins];
+		Bin right;
+		for (uint32_t b = bins - 1; b > 0; b--) {
+			right.min = glm::min(right.min, bin[b].min);
+			right.max = glm::max(right.max, bin[b].max);
+			right.count += bin[b].count;
+			rightArea[b] = right.count ? area(right.min, right.max) : 0.0f;
+			rightCount[b] = right.count;
+		}
+
+		Bin left;
+		for (uint32_t b = 0; b < bins - 1; b++) {
+			left.min = glm::min(left.min, bin[b].min);
+			left.max = glm::max(left.max, bin[b].max);
+			left.count += bin[b].count;
+			if (left.count == 0 || rightCount[b + 1] == 0) { continue; }
+
+			float cost = left.count * area(left.min, left.max) + rightCount[b + 1] * rightArea[b + 1];
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestBin = b + 1;
+			}
+		}
+	}
+
+	uint32_t middle = first + count / 2;
+	float parentArea = area(min, max);
+
+	if (bestAxis >= 0) {
+		// Traversing costs about as much as testing one item, so a split only pays off if it saves more than that.
+		float splitCost = 1.0f + (parentArea > 0.0f ? bestCost / parentArea : 0.0f);
+		if (splitCost >= count && count <= maxLeafSize) { return leaf(); }
+
+		float scale = bins / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+		auto goesLeft = [&](uint32_t item) {
+			return std::min(bins - 1, static_cast<uint32_t>((centroids[item][bestAxis] - centroidMin[bestAxis]) * scale)) < bestBin;
+		};
+
+		middle = static_cast<uint32_t>(std::partition(items.begin() + first, items.begin() + first + count, goesLeft) - items.begin());
+	} else if (count <= maxLeafSize) {
+		return leaf();
+	}
+
+	// Every centroid in the same spot, or a split that put everything on one side, just halves the range.
+	if (middle == first || middle == first + count) { middle = first + count / 2; }
+
+	split(first, middle - first, depth + 1);
+	uint32_t second = split(middle, first + count - middle, depth + 1);
+	nodes[index].index = second;
+	nodes[index].count = 0;
+	return index;
+}
+
+// The tree keeps its shape and only the boxes grow or shrink to fit, which is much cheaper than a rebuild but
+// gets slower to query the further things move from where they were when it was built.
+void Adren::BVH::refit(const Culling::Bounds& bounds) {
+	if (nodes.empty() || items.size() != bounds.count) {
+		build(bounds);
+		return;
+	}
+
+	for (uint32_t k = 0; k < items.size(); k++) {
+		load(bounds, items[k], boxes[k]);
+	}
+
+	// Children always come after their parent, so walking backwards finishes them first.
+	for (uint32_t i = static_cast<uint32_t>(nodes.size()); i-- > 0;) {
+		Node& node = nodes[i];
+		if (node.count) {
+			node.min = glm::vec3(infinity);
+			node.max = glm::vec3(-infinity);
+			for (uint32_t k = node.index; k < node.index + node.count; k++) {
+				node.min = glm::min(node.min, boxes[k].min);
+				node.max = glm::max(node.max, boxes[k].max);
+			}
+		} else {
+			node.min = glm::min(nodes[i + 1].min, nodes[node.index].min);
+			node.max = glm::max(nodes[i + 1].max, nodes[node.index].max);
+		}
+	}
+}
+
+void Adren::BVH::cull(const Culling::Frustum& frustum, std::vector<uint32_t>& visible) const {
+	visible.clear();
+	if (nodes.empty()) { return; }
+
+	struct Entry {
+		uint32_t node;
+		uint32_t mask;
+	} stack[maxDepth + 2];
+
+	uint32_t size = 0;
+	stack[size++] = { 0, 0x3F };
+
+	while (size) {
+		Entry entry = stack[--size];
+		const Node& node = nodes[entry.node];
+		uint32_t mask = entry.mask;
+
+		if (!classify(frustum, node.min, node.max, mask)) { continue; }
+
+		// Completely inside, so the whole subtree is visible. Its items are one range that starts at its
+		// leftmost leaf and ends at its rightmost one.
+		if (mask == 0) {
+			uint32_t firstLeaf = entry.node, lastLeaf = entry.node;
+			while (nodes[firstLeaf].count == 0) { firstLeaf++; }
+			while (nodes[lastLeaf].count == 0) { lastLeaf = nodes[lastLeaf].index; }
+
+			visible.insert(visible.end(), items.begin() + nodes[firstLeaf].index, items.begin() + nodes[lastLeaf].index + nodes[lastLeaf].count);
+			continue;
+		}
+
+		if (node.count) {
+			for (uint32_t k = node.index; k < node.index + node.count; k++) {
+				uint32_t itemMask = mask;
+				if (classify(frustum, boxes[k].min, boxes[k].max, itemMask)) { visible.push_back(items[k]); }
+			}
+		} else {
+			stack[size++] = { node.index, mask };
+			stack[size++] = { entry.node + 1, mask };
+		}
+	}
+}
+
+// Returns the draw whose box the ray hits first, or -1 if it hits nothing.
+int32_t Adren::BVH::pick(const glm::vec3& origin, const glm::vec3& direction, float& distance) const {
+	distance = infinity;
+	if (nodes.empty()) { return -1; }
+
+	glm::vec3 inverse = 1.0f / direction;
+	int32_t result = -1;
+
+	struct Entry {
+		uint32_t node;
+		float distance;
+	} stack[maxDepth + 2];
+
+	uint32_t size = 0;
+	float root = intersect(nodes[0].min, nodes[0].max, origin, inverse);
+	if (root == infinity) { return -1; }
+	stack[size++] = { 0, root };
+
+	while (size) {
+		Entry entry = stack[--size];
+		if (entry.distance >= distance) { continue; }
+
+		const Node& node = nodes[entry.node];
+		if (node.count) {
+			for (uint32_t k = node.index; k < node.index + node.count; k++) {
+				float t = intersect(boxes[k].min, boxes[k].max, origin, inverse);
+				if (t < distance) {
+					distance = t;
+					result = static_cast<int32_t>(items[k]);
+				}
+			}
+			continue;
+		}
+
+		// The nearer child goes on top so it is searched first and can rule out the other one.
+		uint32_t closer = entry.node + 1, further = node.index;
+		float closerDistance = intersect(nodes[closer].min, nodes[closer].max, origin, inverse);
+		float furtherDistance = intersect(nodes[further].min, nodes[further].max, origin, inverse);
+		if (furtherDistance < closerDistance) {
+			std::swap(closer, further);
+			std::swap(closerDistance, furtherDistance);
+		}
+
+		if (furtherDistance < distance) { stack[size++] = { further, furtherDistance }; }
+		if (closerDistance < distance) { stack[size++] = { closer, closerDistance }; }
+	}
+
+	return result;
+}
+
+// Times building, refitting, culling and picking over random boxes, with the flat SIMD cull next to it for comparison.
+void Adren::BVH::benchmark(uint32_t count) {
+	using Clock = std::chrono::steady_clock;
+	auto milliseconds = [](Clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	};
+
+	std::mt19937 random(1);
+	float side = std::cbrt(static_cast<float>(count)) * 10.0f;
+	std::uniform_real_distribution<float> position(-side * 0.5f, side * 0.5f);
+	std::uniform_real_distribution<float> size(0.25f, 2.0f);
+	std::uniform_real_distribution<float> jitter(-0.5f, 0.5f);
+
+	Culling::Bounds bounds;
+	bounds.resize(count);
+	std::vector<glm::vec3> centers(count);
+	for (uint32_t i = 0; i < count; i++) {
+		centers[i] = glm::vec3(position(random), position(random), position(random));
+		glm::vec3 half(size(random), size(random), size(random));
+		bounds.set(i, centers[i] - half, centers[i] + half, glm::mat4(1.0f));
+	}
+
+	BVH bvh;
+	Clock::time_point start = Clock::now();
+	bvh.build(bounds);
+	double build = milliseconds(start);
+
+	for (uint32_t i = 0; i < count; i++) {
+		glm::vec3 moved = centers[i] + glm::vec3(jitter(random), jitter(random), jitter(random));
+		bounds.set(i, moved - 1.0f, moved + 1.0f, glm::mat4(1.0f));
+	}
+
+	start = Clock::now();
+	bvh.refit(bounds);
+	double refit = milliseconds(start);
+
+	// A camera on the edge of the volume looking at the middle sees roughly a quarter of it.
+	glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, side);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, side * 0.5f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	Culling::Frustum frustum = Culling::frustum(projection * view);
+
+	std::vector<uint32_t> visible, flat;
+	const uint32_t repeats = 10;
+
+	start = Clock::now();
+	for (uint32_t r = 0; r < repeats; r++) { bvh.cull(frustum, visible); }
+	double cull = milliseconds(start) / repeats;
+
+	start = Clock::now();
+	for (uint32_t r = 0; r < repeats; r++) { Culling::cull(frustum, bounds, flat); }
+	double flatCull = milliseconds(start) / repeats;
+
+	const uint32_t rays = 10000;
+	uint32_t hits = 0;
+	start = Clock::now();
+	for (uint32_t r = 0; r < rays; r++) {
+		glm::vec3 origin(position(random), position(random), side);
+		glm::vec3 direction = glm::normalize(glm::vec3(jitter(random), jitter(random), -1.0f));
+		float distance;
+		if (bvh.pick(origin, direction, distance) >= 0) { hits++; }
+	}
+	double pick = milliseconds(start) * 1000.0 / rays;
+
+	std::cout << "BVH over " << count << " boxes: " << bvh.nodes.size() << " nodes\n"
+		<< "    build " << build << " ms, refit " << refit << " ms\n"
+		<< "    cull " << cull << " ms (" << visible.size() << " visible), flat cull " << flatCull << " ms (" << flat.size() << " visible)\n"
+		<< "    pick " << pick << " us per ray (" << hits << " of " << rays << " hit)" << std::endl;
+}
@@ -0,0 +1,51 @@
+/*
+	bvh.h
+	Adrenaline Engine
+
+	A bounding volume hierarchy over the world space boxes of the scene's draws. It is built with the surface area
+	heuristic, refit in place when boxes move and stored as one flat depth first array of nodes.
+*/
+
+#pragma once
+#include "culling.h"
+
+namespace Adren {
+class BVH {
+public:
+	// The first child of an inner node is the node right after it, so only the second one needs storing.
+	// Two nodes fit in a cache line.
+	struct Node {
+		glm::vec3 min;
+		uint32_t index; // First item of a leaf, second child of an inner node.
+		glm::vec3 max;
+		uint32_t count; // Items in a leaf, 0 for inner nodes.
+	};
+
+	void build(const Culling::Bounds& bounds);
+	void refit(const Culling::Bounds& bounds);
+	void cull(const Culling::Frustum& frustum, std::vector<uint32_t>& visible) const;
+	int32_t pick(const glm::vec3& origin, const glm::vec3& direction, float& distance) const;
+
+	static void benchmark(uint32_t count);
+
+	std::vector<Node> nodes;
+private:
+	// A box in the order the leaves reference them, so a leaf's boxes are next to each other in memory.
+	struct Box {
+		glm::vec3 min;
+		glm::vec3 max;
+	};
+
+	uint32_t split(uint32_t first, uint32_t count, uint32_t depth);
+	void load(const Culling::Bounds& bounds, uint32_t item, Box& box) const;
+
+	std::vector<uint32_t> items;
+	std::vector<Box> boxes;
+	std::vector<glm::vec3> centroids;
+
+	static const uint32_t bins = 16;
+	static const uint32_t leafSize = 4;
+	static const uint32_t maxLeafSize = 16;
+	static const uint32_t maxDepth = 64;
+};
+}
@@ -8,48 +8,129 @@
 #define GLFW_INCLUDE_VULKAN
 #include "camera.h"
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <algorithm>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/constants.hpp>
+#include <cmath>
 
 
-// This function records the cursor's position on the window.
-void Adren::Camera::callback(GLFWwindow* window, double xpos, double ypos) {
-    auto app = reinterpret_cast<Camera*>(glfwGetWindowUserPointer(window));
-
+// This function turns the cursor's position on the window into the direction the camera faces.
+void Adren::Camera::look(double xpos, double ypos) {
     // This statement is for checking if it was the first time the mouse has moved.
-    if (app->firstMouse) {
-        app->lastX = xpos;
-        app->lastY = ypos;
-        app->firstMouse = false;
+    if (firstMouse) {
+        lastX = xpos;
+        lastY = ypos;
+        firstMouse = false;
     }
 
     // This is setting the x and y offset so that the pitch and yaw will be relative to the x and y position
-    float xoffset = xpos - app->lastX;
-    float yoffset = app->lastY - ypos;
+    float xoffset = xpos - lastX;
+    float yoffset = lastY - ypos;
 
-    app->lastX = xpos;
-    app->lastY = ypos;
+    lastX = xpos;
+    lastY = ypos;
 
     float sensitivity = 0.1f;
     xoffset *= sensitivity;
     yoffset *= sensitivity;
 
-    app->yaw += xoffset;
-    app->pitch += yoffset;
+    yaw += xoffset;
+    pitch += yoffset;
 
     // This prevents the view from being 360 vertically.
-    if (app->pitch > 89.0f)
-        app->pitch = 89.0f;
-    if (app->pitch < -89.0f)
-        app->pitch = -89.0f;
+    if (pitch > 89.0f)
+        pitch = 89.0f;
+    if (pitch < -89.0f)
+        pitch = -89.0f;
 
     // This converts the pitch and yaw coordinates into the 3d space by turning it to a vector.
     glm::vec3 direction;
-    direction.x = cos(glm::radians(app->yaw)) * cos(glm::radians(app->pitch));
-    direction.y = sin(glm::radians(app->pitch));
-    direction.z = sin(glm::radians(app->yaw)) * cos(glm::radians(app->pitch));
+    direction.x = cos(glm::radians(yaw)) * cos(glm::radians(pitch));
+    direction.y = sin(glm::radians(pitch));
+    direction.z = sin(glm::radians(yaw)) * cos(glm::radians(pitch));
+
+    if (toggled) {
+        front = glm::normalize(direction);
+    }
+}
+
+Adren::Camera::State Adren::Camera::state() const {
+    return { pos, front, yaw, pitch, lastX, lastY, firstMouse };
+}
+
+void Adren::Camera::restore(const State& state) {
+    pos = state.pos;
+    front = state.front;
+    yaw = state.yaw;
+    pitch = state.pitch;
+    lastX = state.lastX;
+    lastY = state.lastY;
+    firstMouse = state.firstMouse;
+}
+
+glm::mat4 Adren::Camera::view() const {
+    return glm::lookAt(pos, pos + front, up);
+}
+
+// The projection is flipped on Y since Vulkan's clip space points down.
+glm::mat4 Adren::Camera::projection() const {
+    float screen = (float)width / (float)height;
+    uint32_t distance = drawDistance * 1000;
+    glm::mat4 proj = glm::perspective(glm::radians((float)fov), screen, 0.1f, (float)distance);
+    proj[1][1] *= -1;
+    return proj;
+}
+
+bool Adren::CameraPath::load(const std::string& path) {
+    std::ifstream file(path);
+    std::string header;
+    if (!file || !std::getline(file, header) || header != "adrenaline-path 1") { return false; }
+
+    poses.clear();
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream values(line);
+        Pose pose;
+        if (values >> pose.pos.x >> pose.pos.y >> pose.pos.z >> pose.front.x >> pose.front.y >> pose.front.z) {
+            poses.push_back(pose);
+        }
+    }
+
+    return !poses.empty();
+}
+
+bool Adren::CameraPath::save(const std::string& path) const {
+    std::ofstream file(path);
+    if (!file) { return false; }
 
-    if (app->toggled) {
-        app->front = glm::normalize(direction);
+    file << "adrenaline-path 1\n";
+    file.precision(9);
+    for (const Pose& pose : poses) {
+        file << pose.pos.x << ' ' << pose.pos.y << ' ' << pose.pos.z << ' '
+            << pose.front.x << ' ' << pose.front.y << ' ' << pose.front.z << '\n';
     }
-}
\ No newline at end of file
+
+    return static_cast<bool>(file);
+}
+
+Adren::CameraPath Adren::CameraPath::orbit(uint32_t frames, float radius, float height) {
+    CameraPath path;
+    for (uint32_t i = 0; i < frames; i++) {
+        float angle = glm::two_pi<float>() * i / std::max(frames, 1u);
+        glm::vec3 pos = glm::vec3(std::cos(angle) * radius, height, std::sin(angle) * radius);
+        path.poses.push_back({ pos, glm::normalize(-pos) });
+    }
+
+    return path;
+}
+
+void Adren::CameraPath::apply(Camera& camera, uint32_t frame) const {
+    if (poses.empty()) { return; }
+
+    const Pose& pose = poses[std::min<size_t>(frame, poses.size() - 1)];
+    camera.pos = pose.pos;
+    camera.front = pose.front;
+}
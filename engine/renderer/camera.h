@@ -8,6 +8,8 @@
 #pragma once
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
+#include <string>
+#include <vector>
 
 namespace Adren {
 class Camera {
@@ -23,7 +25,26 @@ public:
     float speed = 0.5f;
     int fov = 90;
     int drawDistance = 10;
-	static void callback(GLFWwindow* window, double xpos, double ypos);
+
+    // Turns a cursor position into where the camera looks, Input calls it for every cursor move.
+    void look(double xpos, double ypos);
+
+    // Everything looking around depends on, so a replay starts from exactly where its recording did.
+    struct State {
+        glm::vec3 pos;
+        glm::vec3 front;
+        float yaw;
+        float pitch;
+        double lastX;
+        double lastY;
+        bool firstMouse;
+    };
+
+    State state() const;
+    void restore(const State& state);
+
+    glm::mat4 view() const;
+    glm::mat4 projection() const;
 
     // This puts default position of the mouse at the center of the window
     double lastX = width / 2;
@@ -35,4 +56,25 @@ private:
     float yaw = -90.0f;
     float pitch = 0.0f;
 };
+
+// Where the camera was and where it looked, one pose a frame. Recorded from the editor and played back by the
+// benchmarks in place of input, so every run sees exactly the same frames.
+struct CameraPath {
+    struct Pose {
+        glm::vec3 pos;
+        glm::vec3 front;
+    };
+
+    std::vector<Pose> poses;
+
+    // Plain text, one pose a line after a header. Both return false when the file can't be used.
+    bool load(const std::string& path);
+    bool save(const std::string& path) const;
+
+    // A path for scenes nobody has recorded one for yet, circling the origin while looking at it.
+    static CameraPath orbit(uint32_t frames, float radius, float height);
+
+    // Frames past the end hold the last pose.
+    void apply(Camera& camera, uint32_t frame) const;
+};
 }
\ No newline at end of file
@@ -0,0 +1,78 @@
+/*
+	components.h
+	Adrenaline Engine
+
+	The components the renderer puts on entities. A placed model is a Placement and an Asset, and Scene spawns
+	one entity per drawable primitive plus one per light and camera found in the nodes of every placement.
+*/
+
+#pragma once
+#include "types.h"
+#include "pipeline.h"
+
+namespace Adren {
+// Where a model sits in the world, the editor sets moved whenever it changes any of it.
+struct Placement {
+	glm::vec3 position = glm::vec3(0.0f);
+	float rotation = 0.0f;
+	glm::vec3 axis = ADREN_Y_AXIS;
+	float scale = 1.0f;
+	bool moved = false;
+
+	glm::mat4 matrix() const {
+		return glm::translate(glm::mat4(1.0f), position) * glm::rotate(glm::mat4(1.0f), glm::radians(rotation), axis)
+			* glm::scale(glm::mat4(1.0f), glm::vec3(scale));
+	}
+};
+
+// Which of the renderer's models a placement shows. Several placements can share one model, the instance is the
+// copy of it Transforms made at the last scene build.
+struct Asset {
+	uint32_t model;
+	uint32_t instance = UINT32_MAX;
+};
+
+// The world matrix of a node and its slot in Transforms and the dynamic uniform buffer.
+struct Transform {
+	glm::mat4 world;
+	uint32_t slot;
+};
+
+// A primitive's range in the combined buffers and in its model's own arrays, its local box and the index of
+// its draw in Scene.
+struct Mesh {
+	glm::vec3 min;
+	glm::vec3 max;
+	uint32_t draw;
+	uint32_t model;
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	uint32_t localIndex;
+	uint32_t localVertex;
+	bool occluder;
+};
+
+struct Material {
+	uint32_t texture;
+	Pipeline::State state;
+};
+
+// From KHR_lights_punctual, nothing shades with these yet.
+struct Light {
+	enum Type : uint32_t { Directional, Point, Spot };
+
+	glm::vec3 color;
+	float intensity;
+	float range;
+	Type type;
+};
+
+// A camera from the glTF file, the planes are named so they stay clear of the Windows near and far macros.
+struct View {
+	float fov;
+	float aspect;
+	float nearPlane;
+	float farPlane;
+};
+}
@@ -0,0 +1,137 @@
+/*
+	culling.cpp
+	Adrenaline Engine
+
+	Definitions for the frustum tests. The boxes are tested 8 at a time with AVX, 4 at a time with SSE
+	and one at a time everywhere else.
+*/
+
+#include "culling.h"
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ADREN_SSE
+#include <emmintrin.h>
+#endif
+
+void Adren::Culling::Bounds::resize(uint32_t size) {
+	count = size;
+	uint32_t padded = (size + 7) & ~7u;
+
+	// Padding boxes sit at the origin with a negative extent so they can never pass a test.
+	for (auto* array : { &centerX, &centerY, &centerZ }) { array->assign(padded, 0.0f); }
+	for (auto* array : { &extentX, &extentY, &extentZ }) { array->assign(padded, -1.0e30f); }
+}
+
+// This transforms a local box by the matrix and stores the box that encloses the result (Arvo's method).
+void Adren::Culling::Bounds::set(uint32_t index, const glm::vec3& min, const glm::vec3& max, const glm::mat4& matrix) {
+	glm::vec3 center = (min + max) * 0.5f;
+	glm::vec3 extent = (max - min) * 0.5f;
+
+	glm::vec3 worldCenter = glm::vec3(matrix * glm::vec4(center, 1.0f));
+	glm::vec3 worldExtent;
+	for (int i = 0; i < 3; i++) {
+		worldExtent[i] = std::abs(matrix[0][i]) * extent.x + std::abs(matrix[1][i]) * extent.y + std::abs(matrix[2][i]) * extent.z;
+	}
+
+	centerX[index] = worldCenter.x; centerY[index] = worldCenter.y; centerZ[index] = worldCenter.z;
+	extentX[index] = worldExtent.x; extentY[index] = worldExtent.y; extentZ[index] = worldExtent.z;
+}
+
+// Gribb and Hartmann plane extraction, the near plane is row 2 on its own since Vulkan's depth range is 0 to 1.
+Adren::Culling::Frustum Adren::Culling::frustum(const glm::mat4& viewProj) {
+	glm::vec4 rows[4];
+	for (int r = 0; r < 4; r++) {
+		rows[r] = glm::vec4(viewProj[0][r], viewProj[1][r], viewProj[2][r], viewProj[3][r]);
+	}
+
+	Frustum result{};
+	result.planes[0] = rows[3] + rows[0];
+	result.planes[1] = rows[3] - rows[0];
+	result.planes[2] = rows[3] + rows[1];
+	result.planes[3] = rows[3] - rows[1];
+	result.planes[4] = rows[2];
+	result.planes[5] = rows[3] - rows[2];
+
+	for (auto& plane : result.planes) {
+		plane /= glm::length(glm::vec3(plane));
+	}
+
+	return result;
+}
+
+void Adren::Culling::cull(const Frustum& frustum, const Bounds& bounds, std::vector<uint32_t>& visible) {
+	visible.clear();
+
+#if defined(__AVX__)
+	const __m256 sign = _mm256_set1_ps(-0.0f);
+	for (uint32_t i = 0; i < bounds.count; i += 8) {
+		__m256 cx = _mm256_loadu_ps(&bounds.centerX[i]);
+		__m256 cy = _mm256_loadu_ps(&bounds.centerY[i]);
+		__m256 cz = _mm256_loadu_ps(&bounds.centerZ[i]);
+		__m256 ex = _mm256_loadu_ps(&bounds.extentX[i]);
+		__m256 ey = _mm256_loadu_ps(&bounds.extentY[i]);
+		__m256 ez = _mm256_loadu_ps(&bounds.extentZ[i]);
+
+		__m256 outside = _mm256_setzero_ps();
+		for (const glm::vec4& plane : frustum.planes) {
+			__m256 nx = _mm256_set1_ps(plane.x), ny = _mm256_set1_ps(plane.y), nz = _mm256_set1_ps(plane.z);
+
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, cx), _mm256_mul_ps(ny, cy)),
+				_mm256_add_ps(_mm256_mul_ps(nz, cz), _mm256_set1_ps(plane.w)));
+			__m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_andnot_ps(sign, nx), ex),
+				_mm256_mul_ps(_mm256_andnot_ps(sign, ny), ey)), _mm256_mul_ps(_mm256_andnot_ps(sign, nz), ez));
+
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(), _CMP_LT_OQ));
+		}
+
+		int mask = ~_mm256_movemask_ps(outside) & 0xFF;
+		while (mask) {
+			uint32_t lane = 0;
+			while (!(mask & (1 << lane))) { lane++; }
+			mask &= mask - 1;
+			if (i + lane < bounds.count) { visible.push_back(i + lane); }
+		}
+	}
+#elif defined(ADREN_SSE)
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	for (uint32_t i = 0; i < bounds.count; i += 4) {
+		__m128 cx = _mm_loadu_ps(&bounds.centerX[i]);
+		__m128 cy = _mm_loadu_ps(&bounds.centerY[i]);
+		__m128 cz = _mm_loadu_ps(&bounds.centerZ[i]);
+		__m128 ex = _mm_loadu_ps(&bounds.extentX[i]);
+		__m128 ey = _mm_loadu_ps(&bounds.extentY[i]);
+		__m128 ez = _mm_loadu_ps(&bounds.extentZ[i]);
+
+		__m128 outside = _mm_setzero_ps();
+		for (const glm::vec4& plane : frustum.planes) {
+			__m128 nx = _mm_set1_ps(plane.x), ny = _mm_set1_ps(plane.y), nz = _mm_set1_ps(plane.z);
+
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)),
+				_mm_add_ps(_mm_mul_ps(nz, cz), _mm_set1_ps(plane.w)));
+			__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(sign, nx), ex),
+				_mm_mul_ps(_mm_andnot_ps(sign, ny), ey)), _mm_mul_ps(_mm_andnot_ps(sign, nz), ez));
+
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+		}
+
+		int mask = ~_mm_movemask_ps(outside) & 0xF;
+		for (uint32_t lane = 0; lane < 4; lane++) {
+			if ((mask & (1 << lane)) && i + lane < bounds.count) { visible.push_back(i + lane); }
+		}
+	}
+#else
+	for (uint32_t i = 0; i < bounds.count; i++) {
+		bool inside = true;
+		for (const glm::vec4& plane : frustum.planes) {
+			float distance = plane.x * bounds.centerX[i] + plane.y * bounds.centerY[i] + plane.z * bounds.centerZ[i] + plane.w;
+			float radius = std::abs(plane.x) * bounds.extentX[i] + std::abs(plane.y) * bounds.extentY[i] + std::abs(plane.z) * bounds.extentZ[i];
+			if (distance + radius < 0.0f) { inside = false; break; }
+		}
+
+		if (inside) { visible.push_back(i); }
+	}
+#endif
+}
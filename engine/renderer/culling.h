@@ -0,0 +1,31 @@
+/*
+	culling.h
+	Adrenaline Engine
+
+	Bounding volume math and the frustum tests that decide what gets drawn.
+*/
+
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace Adren::Culling {
+// Planes are stored as (normal, distance) with the normal pointing into the frustum.
+struct Frustum {
+	glm::vec4 planes[6];
+};
+
+// World space boxes stored as separate center and extent arrays so they can be loaded straight into SIMD registers.
+// Every array is padded to a multiple of 8 so the wide loops never read past the end.
+struct Bounds {
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<float> extentX, extentY, extentZ;
+	uint32_t count = 0;
+
+	void resize(uint32_t size);
+	void set(uint32_t index, const glm::vec3& min, const glm::vec3& max, const glm::mat4& matrix);
+};
+
+Frustum frustum(const glm::mat4& viewProj);
+void cull(const Frustum& frustum, const Bounds& bounds, std::vector<uint32_t>& visible);
+}
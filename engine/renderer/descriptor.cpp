@@ -7,39 +7,13 @@
 #include "descriptor.h"
 #include "info.h"
 
-void Adren::Descriptor::createLayout(std::vector<Model>& models) {
-    VkDescriptorSetLayoutBinding uboBinding = Adren::Info::uboLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0);
-
-    VkDescriptorSetLayoutBinding dynamicUboBinding = Adren::Info::uboLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT, 1);
-
-    VkDescriptorSetLayoutBinding samplerBinding = Adren::Info::samplerLayoutBinding();
-
-    VkDescriptorSetLayoutBinding textureBinding = Adren::Info::textureLayoutBinding(2048);
-
-
-    std::array<VkDescriptorSetLayoutBinding, 4> bindings = {uboBinding, dynamicUboBinding, samplerBinding, textureBinding};
-    VkDescriptorSetLayoutCreateInfo layoutInfo{};
-    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
-
-    VkDescriptorBindingFlags flags[4];
-    flags[0] = 0;
-    flags[1] = 0;
-    flags[2] = 0;
-    flags[3] = VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT;
-
-    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlags{};
-    bindingFlags.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
-    bindingFlags.bindingCount = static_cast<uint32_t>(bindings.size());
-    bindingFlags.pBindingFlags = flags;
-
-    layoutInfo.pBindings = bindings.data();
-    layoutInfo.pNext = &bindingFlags;
-
-    Adren::Tools::vibeCheck("DESCRIPTOR SET LAYOUT", vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &layout));
+void Adren::Descriptor::createLayout(Reflection::Interface reflected) {
+    // The per node model matrices are bound with a dynamic offset, which the shaders have no way of saying.
+    reflected.makeDynamic(1);
+    layout = reflection.setLayout(reflected);
 }
 
-void Adren::Descriptor::createPool(std::vector<VkImage>& images) {
+void Adren::Descriptor::createPool() {
     std::array<VkDescriptorPoolSize, 4> poolSizes{};
     poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER; poolSizes[0].descriptorCount = 1000;
     poolSizes[1].type = VK_DESCRIPTOR_TYPE_SAMPLER; poolSizes[1].descriptorCount = 1000;
@@ -50,7 +24,7 @@ void Adren::Descriptor::createPool(std::vector<VkImage>& images) {
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
     poolInfo.pPoolSizes = poolSizes.data();
-    poolInfo.maxSets = static_cast<uint32_t>(images.size());
+    poolInfo.maxSets = maxFramesInFlight;
 
     Adren::Tools::vibeCheck("DESCRIPTOR POOL", vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool));
 }
@@ -64,9 +38,22 @@ void Adren::Descriptor::fillWrites(std::array<VkWriteDescriptorSet, 4>& write, i
     write[index].descriptorCount = count;
 }
 
-void Adren::Descriptor::createSets(std::vector<Model::Texture>& textures, std::vector<VkImage>& images) {
+// The pool only has room for one set per frame in flight, so making the sets again moves to a new pool and
+// retires the old one.
+void Adren::Descriptor::createSets(std::vector<Model::Texture>& textures) {
+    if (!sets.empty()) {
+        retire([device = device, old = pool] { vkDestroyDescriptorPool(device, old, nullptr); });
+        createPool();
+    }
+
+    // Every set samples with the same sampler, which lives as long as the descriptors do.
+    if (sampler == VK_NULL_HANDLE) {
+        VkSamplerCreateInfo sampInfo = Adren::Info::samplerInfo();
+        Adren::Tools::vibeCheck("CREATE SAMPLER", vkCreateSampler(device, &sampInfo, nullptr, &sampler));
+    }
+
     size_t textureSize = textures.size();
-    uint32_t setCount = static_cast<uint32_t>(images.size());
+    uint32_t setCount = maxFramesInFlight;
     std::vector<VkDescriptorSetLayout> layouts(setCount, layout);
     
     uint32_t counts[4];
@@ -87,10 +74,18 @@ void Adren::Descriptor::createSets(std::vector<Model::Texture>& textures, std::v
     sets.resize(setCount);
     Adren::Tools::vibeCheck("ALLOCATED DESCRIPTOR SETS", vkAllocateDescriptorSets(device, &allocInfo, sets.data()));
 
+    // Every set points at the same textures and sampler, so their infos are filled once.
+    std::vector<VkDescriptorImageInfo> imageInfo(textureSize);
+    for (uint32_t t = 0; t < textureSize; t++) {
+        imageInfo[t].sampler = sampler;
+        imageInfo[t].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageInfo[t].imageView = textures[t].view;
+    }
+
     for (size_t i = 0; i < sets.size(); i++) {
         VkDescriptorBufferInfo bufferInfo{};
         bufferInfo.buffer = buffers.uniform.buffer;
-        bufferInfo.offset = 0;
+        bufferInfo.offset = buffers.uniform.align * i;
         bufferInfo.range = sizeof(UniformBufferObject);
 
         VkDescriptorBufferInfo dynamicBufferInfo{};
@@ -98,18 +93,8 @@ void Adren::Descriptor::createSets(std::vector<Model::Texture>& textures, std::v
         dynamicBufferInfo.offset = 0;
         dynamicBufferInfo.range = sizeof(glm::mat4);
 
-        VkSamplerCreateInfo sampInfo = Adren::Info::samplerInfo();
-        Adren::Tools::vibeCheck("CREATE SAMPLER", vkCreateSampler(device, &sampInfo, nullptr, &sampler));
-
         VkDescriptorImageInfo samplerInfo{};
         samplerInfo.sampler = sampler;
-        VkDescriptorImageInfo* imageInfo;
-        imageInfo = new VkDescriptorImageInfo[textureSize];
-        for (uint32_t t = 0; t < textureSize; t++) {
-            imageInfo[t].sampler = sampler;
-            imageInfo[t].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-            imageInfo[t].imageView = textures[t].view;
-        }
 
         std::array<VkWriteDescriptorSet, 4> dWrites{};
 
@@ -124,14 +109,13 @@ void Adren::Descriptor::createSets(std::vector<Model::Texture>& textures, std::v
         dWrites[2].pImageInfo = &samplerInfo;
 
         fillWrites(dWrites, 3, sets[i], 3, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, textureSize);
-        dWrites[3].pImageInfo = imageInfo;
+        dWrites[3].pImageInfo = imageInfo.data();
 
         vkUpdateDescriptorSets(device, static_cast<uint32_t>(dWrites.size()), dWrites.data(), 0, nullptr);
-        delete[] imageInfo;
     }
 }
 
 void Adren::Descriptor::cleanup() {
-    vkDestroyDescriptorSetLayout(device, layout, nullptr);
     vkDestroyDescriptorPool(device, pool, nullptr);
+    vkDestroySampler(device, sampler, nullptr);
 }
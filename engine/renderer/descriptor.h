@@ -7,25 +7,32 @@
 
 #pragma once
 #include "buffers.h"
+#include "reflection.h"
+#include <functional>
 
 namespace Adren {
 class Descriptor {
 public:
-	Descriptor(Devices& devices, Buffers& buffers) : device(devices.device), buffers(buffers) {}
+	Descriptor(Devices& devices, Buffers& buffers, Reflection& reflection) : device(devices.device), buffers(buffers), reflection(reflection) {}
 
-	void createLayout(std::vector<Model>& models);
-	void createPool(std::vector<VkImage>& images);
-	void createSets(std::vector<Model::Texture>& textures, std::vector<VkImage>& images);
+	void createLayout(Reflection::Interface reflected);
+	void createPool();
+	void createSets(std::vector<Model::Texture>& textures);
 
 	void cleanup();
 
+	// One per frame in flight, each reading that frame's region of the camera's uniform buffer.
 	std::vector<VkDescriptorSet> sets;
 	VkDescriptorSetLayout layout = VK_NULL_HANDLE;
 	VkDescriptorPool pool = VK_NULL_HANDLE;
 	VkSampler sampler = VK_NULL_HANDLE;
+
+	// Sets made again for new textures come from a new pool, frames in flight may still use the old one.
+	std::function<void(std::function<void()>)> retire;
 private:
 	void fillWrites(std::array<VkWriteDescriptorSet, 4>& write, int index, VkDescriptorSet& dSet, int binding, VkDescriptorType type, size_t& count);
 	Buffers& buffers;
+	Reflection& reflection;
 	VkDevice& device;
 };
 }
\ No newline at end of file
@@ -8,6 +8,7 @@
 #include "devices.h"
 #include "info.h"
 #include "tools.h"
+#include "memory.h"
 #include <cstring>
 
 bool Adren::Devices::checkDeviceExtensionSupport(VkPhysicalDevice& device) {
@@ -31,8 +32,8 @@ bool Adren::Devices::isDeviceSuitable(VkPhysicalDevice device, VkSurfaceKHR surf
     
     bool extensionsSupported = checkDeviceExtensionSupport(device);
     
-    bool swapChainAdequate = false;
-    if (extensionsSupported) {
+    bool swapChainAdequate = headless;
+    if (extensionsSupported && !headless) {
         SwapChainSupportDetails swapChainSupport = Adren::Tools::querySwapChainSupport(device, surface); 
         swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
     }
@@ -51,6 +52,8 @@ void Adren::Devices::pickGPU() {
         throw std::runtime_error("Failed to find GPUs with Vulkan support!");
     }
 
+    if (headless) { deviceExtensions.clear(); }
+
     std::vector<VkPhysicalDevice> devices(deviceCount);
     vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
 
@@ -79,16 +82,40 @@ void Adren::Devices::createLogicalDevice() {
         queueCreateInfos.push_back(queueCreateInfo);
     }
 
+    // Indirect draws with a GPU written count are optional, the renderer falls back to culling on the CPU without them.
+    VkPhysicalDeviceVulkan12Features supported12{};
+    supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceFeatures2 supported{};
+    supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supported.pNext = &supported12;
+    vkGetPhysicalDeviceFeatures2(gpu, &supported);
+
+    indirectCount = supported12.drawIndirectCount && supported.features.multiDrawIndirect && supported.features.drawIndirectFirstInstance;
+
+    // Without the budget extension VMA estimates the budgets from the heap sizes, which works but knows nothing of other processes.
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(gpu, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(gpu, nullptr, &extensionCount, extensions.data());
+    for (const VkExtensionProperties& extension : extensions) {
+        if (std::string(extension.extensionName) == VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) { memoryBudget = true; }
+    }
+    if (memoryBudget) { deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME); }
+
     VkPhysicalDeviceFeatures deviceFeatures{};
     deviceFeatures.samplerAnisotropy = VK_TRUE;
+    deviceFeatures.multiDrawIndirect = indirectCount;
+    deviceFeatures.drawIndirectFirstInstance = indirectCount;
 
-    VkPhysicalDeviceDescriptorIndexingFeatures descriptorIndexing{};
-    descriptorIndexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+    // The descriptor indexing features live in here too, they can't be chained separately alongside it.
+    VkPhysicalDeviceVulkan12Features features12{};
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
 
-    descriptorIndexing.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
-    descriptorIndexing.runtimeDescriptorArray = VK_TRUE;
-    descriptorIndexing.descriptorBindingVariableDescriptorCount = VK_TRUE;
-    descriptorIndexing.descriptorBindingPartiallyBound = VK_TRUE;
+    features12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+    features12.runtimeDescriptorArray = VK_TRUE;
+    features12.descriptorBindingVariableDescriptorCount = VK_TRUE;
+    features12.descriptorBindingPartiallyBound = VK_TRUE;
+    features12.drawIndirectCount = indirectCount;
 
 
     VkDeviceCreateInfo createInfo{};
@@ -108,7 +135,7 @@ void Adren::Devices::createLogicalDevice() {
 #else
         createInfo.enabledLayerCount = 0;
 #endif
-    createInfo.pNext = &descriptorIndexing;
+    createInfo.pNext = &features12;
     
     Adren::Tools::vibeCheck("PHYSICAL DEVICE", vkCreateDevice(gpu, &createInfo, nullptr, &device));
     
@@ -117,11 +144,13 @@ void Adren::Devices::createLogicalDevice() {
 }
 
 std::vector<const char*> Adren::Devices::getRequiredExtensions() {
-    uint32_t glfwExtensionCount = 0;
-    const char** glfwExtensions;
-    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-    std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    std::vector<const char*> extensions;
+    if (!headless) {
+        uint32_t glfwExtensionCount = 0;
+        const char** glfwExtensions;
+        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
     
 #ifdef DEBUG
         extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -168,5 +197,7 @@ void Adren::Devices::createAllocator() {
     allocatorInfo.instance = instance;
     allocatorInfo.preferredLargeHeapBlockSize = 0;
     allocatorInfo.pVulkanFunctions = &vulkanFunctions;
+    allocatorInfo.pAllocationCallbacks = Memory::callbacks();
+    if (memoryBudget) { allocatorInfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT; }
     vmaCreateAllocator(&allocatorInfo, &allocator);
 }
\ No newline at end of file
@@ -32,10 +32,17 @@ public:
     VkQueue presentQueue = VK_NULL_HANDLE;
     VkSurfaceKHR& surface;
     VmaAllocator allocator = VK_NULL_HANDLE;
+    bool indirectCount = false;
+
+    // With VK_EXT_memory_budget the heap budgets come from the driver and cover other processes too.
+    bool memoryBudget = false;
+
+    // Renders without a window or a surface, nothing is presented and no swapchain extension is asked for.
+    bool headless = false;
     const std::vector<const char*> validationLayers = {"VK_LAYER_KHRONOS_validation", "VK_LAYER_LUNARG_monitor"};
 private:
     VkInstance& instance;
-    const std::vector<const char*> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+    std::vector<const char*> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
     bool isDeviceSuitable(VkPhysicalDevice device, VkSurfaceKHR surface);
     bool checkDeviceExtensionSupport(VkPhysicalDevice& device);
 
@@ -11,6 +11,7 @@
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_vulkan.h>
 #include "info.h"
+#include "core/allocations.h"
 #include <glm/gtc/type_ptr.hpp>
 
 void Adren::GUI::init(GLFWwindow* window, VkSurfaceKHR& surface) {
@@ -38,14 +39,16 @@ void Adren::GUI::init(GLFWwindow* window, VkSurfaceKHR& surface) {
     Adren::Tools::vibeCheck("IMGUI DESCRIPTOR POOL", vkCreateDescriptorPool(device, &pool_info, nullptr, &descriptorPool));
 
     IMGUI_CHECKVERSION();
+    // ImGui allocates with malloc unless told otherwise, this way its windows and draw lists count as the editor's.
+    if (Adren::Allocations::tracking()) {
+        ImGui::SetAllocatorFunctions(
+            [](size_t size, void*) { return Adren::Allocations::allocate(size, alignof(std::max_align_t), Adren::Allocations::Subsystem::Editor); },
+            [](void* data, void*) { Adren::Allocations::release(data); });
+    }
     ImGui::CreateContext();
     ImGuiIO& io = ImGui::GetIO(); (void)io;
 
-    queueFam = Adren::Tools::findQueueFamilies(gpu, surface);
-
-    createRenderPass();
-    createCommands();
-    createFramebuffers();
+    createTargets(surface);
 
     ImGui_ImplGlfw_InitForVulkan(window, true);
 
@@ -83,18 +86,31 @@ void Adren::GUI::init(GLFWwindow* window, VkSurfaceKHR& surface) {
     Adren::Tools::log("ImGui has been initialized..");
 }
 
+void Adren::GUI::createTargets(VkSurfaceKHR& surface) {
+    queueFam = Adren::Tools::findQueueFamilies(gpu, surface);
+
+    createImages();
+    createRenderPass();
+    createCommands();
+    createFramebuffers();
+}
+
 void Adren::GUI::cleanup() {
     vkDestroyDescriptorPool(device, descriptorPool, nullptr);
     vkDestroySampler(device, base.sampler, nullptr);
-    vmaDestroyImage(allocator, base.color.image, base.color.memory);
+    Memory::destroyImage(allocator, base.color.image, base.color.memory);
     vkDestroyImageView(device, base.color.view, nullptr);
-    vmaDestroyImage(allocator, base.depth.image, base.depth.memory);
+    Memory::destroyImage(allocator, base.depth.image, base.depth.memory);
     vkDestroyImageView(device, base.depth.view, nullptr);
     vkDestroyRenderPass(device, base.renderpass, nullptr);
     vkDestroyFramebuffer(device, base.framebuffer, nullptr);
-    ImGui_ImplVulkan_Shutdown();
-    ImGui_ImplGlfw_Shutdown();
-    ImGui::DestroyContext(); 
+
+    // Headless runs never start ImGui.
+    if (ImGui::GetCurrentContext()) {
+        ImGui_ImplVulkan_Shutdown();
+        ImGui_ImplGlfw_Shutdown();
+        ImGui::DestroyContext();
+    }
 }
 
 void Adren::GUI::mouseHandler(GLFWwindow* window) {
@@ -102,14 +118,14 @@ void Adren::GUI::mouseHandler(GLFWwindow* window) {
     if (io.WantCaptureMouse) {
         camera.toggled = false;
     } else {
-        if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS && rightClick == true) {
+        if (input.pressed(GLFW_MOUSE_BUTTON_LEFT) && rightClick == true) {
             glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
             glfwSetCursorPos(window, savedX, savedY);
             rightClick = false;
         }
     }
 
-    if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS && rightClick == false) {
+    if (input.pressed(GLFW_MOUSE_BUTTON_RIGHT) && rightClick == false) {
         int centerX = camera.width / 2;
         int centerY = camera.height / 2;
         glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
@@ -130,17 +146,42 @@ void Adren::GUI::newFrame(GLFWwindow* window) {
     mouseHandler(window);
 }
 
-void Adren::GUI::createRenderPass() {
+// Ends the ImGui frame and copies out what it drew, the copies from the last capture into the same draws are freed first.
+void Adren::GUI::capture(Draws& draws) {
+    ImGui::Render();
+    release(draws);
+
+    ImDrawData* source = ImGui::GetDrawData();
+    draws.data = *source;
+    for (int i = 0; i < source->CmdListsCount; i++) {
+        draws.lists.push_back(source->CmdLists[i]->CloneOutput());
+    }
+
+    draws.data.CmdLists = draws.lists.data();
+}
+
+void Adren::GUI::release(Draws& draws) {
+    for (ImDrawList* list : draws.lists) { IM_DELETE(list); }
+    draws.lists.clear();
+    draws.data = ImDrawData{};
+}
+
+void Adren::GUI::createImages() {
+    // The color is also copied out when a headless run captures a frame.
     images.createImage(camera.width, camera.height, swapchain.imgFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT 
-        | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VMA_MEMORY_USAGE_GPU_ONLY, base.color);
+        | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VMA_MEMORY_USAGE_GPU_ONLY, MemoryCategory::Targets, base.color);
     
     base.color.view = images.createImageView(base.color.image, swapchain.imgFormat, VK_IMAGE_ASPECT_COLOR_BIT);
 
+    // The depth is sampled afterwards to build the occlusion culling pyramid.
     images.createImage(camera.width, camera.height, images.depth.format, VK_IMAGE_TILING_OPTIMAL,
-        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VMA_MEMORY_USAGE_GPU_ONLY, base.depth);
+        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VMA_MEMORY_USAGE_GPU_ONLY, MemoryCategory::Targets, base.depth);
 
+    base.depth.format = images.depth.format;
     base.depth.view = images.createImageView(base.depth.image, images.depth.format, VK_IMAGE_ASPECT_DEPTH_BIT);
-   
+}
+
+void Adren::GUI::createRenderPass() {
     VkSamplerCreateInfo samplerInfo{};
     samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
     samplerInfo.maxAnisotropy = 1.0f;
@@ -246,28 +287,29 @@ void Adren::GUI::createCommands() {
     Adren::Tools::vibeCheck("IMGUI COMMAND BUFFER", vkAllocateCommandBuffers(device, &allocInfo, &base.commandBuffer));
 }
 
-// This function recreates images, renderpassand framebuffer used to display the Vulkan scene to the GUI.
-// It re-renders the scene in a different display resolution dictated by the viewport function.
+// This function recreates the images and framebuffer used to display the Vulkan scene to the GUI, the render pass
+// and sampler do not depend on the size and stay. Frames still on the GPU may be drawing into or sampling the old
+// targets, so they are retired along with their ImGui texture rather than destroyed here.
 void Adren::GUI::resize() {
-    // Destroying the images because we would have to recreate it in a different size.
-    vkDestroyImage(device, base.color.image, nullptr);
-    vmaFreeMemory(allocator, base.color.memory);
+    Image color = base.color;
+    Image depth = base.depth;
+    VkFramebuffer framebuffer = base.framebuffer;
+    VkDescriptorSet set = base.set;
 
-    vkDestroyImage(device, base.depth.image, nullptr);
-    vmaFreeMemory(allocator, base.depth.memory);
-
-    // Same with the images
-    vkDestroyImageView(device, base.color.view, nullptr);
-    vkDestroyImageView(device, base.depth.view, nullptr);
-    
-    // This destroys the render pass and framebuffer because they are required to render to the viewport
-    vkDestroyRenderPass(device, base.renderpass, nullptr);
-    vkDestroyFramebuffer(device, base.framebuffer, nullptr);
+    createImages();
+    createFramebuffers();
 
+    // We are redefining base.set to have the new size.
+    base.set = ImGui_ImplVulkan_AddTexture(base.sampler, base.color.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
-    // This creates a new renderpass and framebuffer with the new size
-    createRenderPass();
-    createFramebuffers();
+    retire([this, color, depth, framebuffer, set] {
+        vkFreeDescriptorSets(device, descriptorPool, 1, &set);
+        vkDestroyFramebuffer(device, framebuffer, nullptr);
+        vkDestroyImageView(device, color.view, nullptr);
+        vkDestroyImageView(device, depth.view, nullptr);
+        Memory::destroyImage(allocator, color.image, color.memory);
+        Memory::destroyImage(allocator, depth.image, depth.memory);
+    });
 }
 
 // This function sets up the viewport element of the editor that shows what Vulkan is rendering.
@@ -292,26 +334,37 @@ void Adren::GUI::viewport() {
     // This will show the current size of the viewport.
     ImVec2 size = ImGui::GetContentRegionAvail();
 
+    // While the viewport is being dragged the last frame is stretched over it, the targets are only recreated once
+    // the size has held still for a moment rather than for every pixel of the drag.
+    if (size.x != pending.x || size.y != pending.y) {
+        pending = size;
+        pendingSince = ImGui::GetTime();
+    }
+
     // Thank you olkotov for inspiration https://github.com/ocornut/imgui/issues/1287#issuecomment-1093514753
-    if (size.x != camera.width || size.y != camera.height) {
-        if (size.x <= 0 || size.y <= 0) {
-            return;
-        }
+    bool settled = ImGui::GetTime() - pendingSince >= settle;
+    if ((size.x != camera.width || size.y != camera.height) && size.x > 0 && size.y > 0 && settled) {
+        if (drain) { drain(); }
 
         camera.width = size.x;
         camera.height = size.y;
 
         resize();
-
-        // We are redefining base.set to have the new size.
-        base.set = ImGui_ImplVulkan_AddTexture(base.sampler, base.color.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
     }
 
     // This is the viewport tabs for when we want to use the space for more than just the viewport.
     if (ImGui::BeginTabBar("ViewportTabBar")) {
         ImGui::PushStyleVar(ImGuiStyleVar_ItemInnerSpacing, ImVec2(0.0f, 0.0f));
         if (ImGui::BeginTabItem("Scene")) {
-            ImGui::Image((ImTextureID)base.set, ImVec2(camera.width, camera.height));
+            ImGui::Image((ImTextureID)base.set, size);
+
+            // Only while the cursor is free, otherwise the left click is what gives the camera control back.
+            if (rightClick && ImGui::IsItemClicked(ImGuiMouseButton_Left)) {
+                ImVec2 min = ImGui::GetItemRectMin();
+                click.x = (io.MousePos.x - min.x) / size.x;
+                click.y = (io.MousePos.y - min.y) / size.y;
+                click.pending = true;
+            }
             ImGui::EndTabItem();
         }
 
@@ -323,7 +376,8 @@ void Adren::GUI::viewport() {
     ImGui::End();
 }
 
-void Adren::GUI::beginRenderpass(VkCommandBuffer& buffer, VkPipeline& pipeline, Buffer vertex, Buffer index) {
+// With secondary contents the pass only gets vkCmdExecuteCommands, so every secondary buffer binds the scene itself.
+void Adren::GUI::beginRenderpass(VkCommandBuffer& buffer, VkPipeline& pipeline, Buffer vertex, Buffer index, VkSubpassContents contents) {
     VkRenderPassBeginInfo renderpassInfo{};
     renderpassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
     renderpassInfo.renderPass = base.renderpass;
@@ -339,8 +393,12 @@ void Adren::GUI::beginRenderpass(VkCommandBuffer& buffer, VkPipeline& pipeline,
     renderpassInfo.clearValueCount = 2;
     renderpassInfo.pClearValues = clearValues;
 
-    vkCmdBeginRenderPass(buffer, &renderpassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    vkCmdBeginRenderPass(buffer, &renderpassInfo, contents);
+    if (contents == VK_SUBPASS_CONTENTS_INLINE) { bindScene(buffer, pipeline, vertex, index); }
+}
 
+// Secondary command buffers inherit none of this from the primary.
+void Adren::GUI::bindScene(VkCommandBuffer& buffer, VkPipeline& pipeline, Buffer vertex, Buffer index) {
     VkViewport viewport{};
     viewport.width = (float)camera.width;
     viewport.height = (float)camera.height;
@@ -9,24 +9,46 @@
 #pragma once
 #include <GLFW/glfw3.h>
 #include <vector>
+#include <functional>
+#include <imgui.h>
 #include "types.h"
 #include "swapchain.h"
 #include "pipeline.h"
 #include "renderpass.h"
+#include "input.h"
 
 namespace Adren {
 class GUI {
 public:
-    GUI(Devices& devices, Buffers& buffers, Images& images, Swapchain& swapchain, VkInstance& instance, Camera& camera) : 
-        buffers(buffers), images(images), swapchain(swapchain), instance(instance), camera(camera),
+    GUI(Devices& devices, Buffers& buffers, Images& images, Swapchain& swapchain, VkInstance& instance, Camera& camera, Input& input) : 
+        buffers(buffers), images(images), swapchain(swapchain), instance(instance), camera(camera), input(input),
         device(devices.device), graphicsQueue(devices.graphicsQueue), gpu(devices.gpu), allocator(devices.allocator) {}
 
     void init(GLFWwindow* window, VkSurfaceKHR& surface);
+
+    // Only the offscreen color and depth targets the scene is drawn into, without ImGui. Init calls it too.
+    void createTargets(VkSurfaceKHR& surface);
     void cleanup();
     void mouseHandler(GLFWwindow* window);
     void newFrame(GLFWwindow* window);
     void viewport();
-    void beginRenderpass(VkCommandBuffer& buffer, VkPipeline& pipeline, Buffer vertex, Buffer index);
+    void beginRenderpass(VkCommandBuffer& buffer, VkPipeline& pipeline, Buffer vertex, Buffer index, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
+    void bindScene(VkCommandBuffer& buffer, VkPipeline& pipeline, Buffer vertex, Buffer index);
+
+    // ImGui owns its draw lists and rewrites them every frame, so the render thread draws from copies of them
+    // while the main thread is already building the next frame.
+    struct Draws {
+        ImDrawData data{};
+        std::vector<ImDrawList*> lists;
+    };
+
+    void capture(Draws& draws);
+    void release(Draws& draws);
+
+    // Runs before the viewport images are recreated, the renderer uses it to make sure the render thread is not
+    // recording with them. Frames already submitted may still use them, so the old ones go to retire instead.
+    std::function<void()> drain;
+    std::function<void(std::function<void()>)> retire;
 
     struct Base {
         VkRenderPass renderpass;
@@ -39,8 +61,16 @@ public:
         VkSampler sampler;
     } base;
 
+    // A left click on the scene, from 0 to 1 across the viewport, waiting for the renderer to pick with it.
+    struct Click {
+        bool pending = false;
+        float x = 0.0f;
+        float y = 0.0f;
+    } click;
+
 private:
     void createCommands();
+    void createImages();
     void createRenderPass();
     void createFramebuffers();
     void resize();
@@ -50,6 +80,7 @@ private:
     Images& images;
 
     Camera& camera;
+    Input& input;
 
     VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
     VkDevice& device;
@@ -61,6 +92,11 @@ private:
 
     bool rightClick = false;
 
+    // The viewport size last seen and when it changed to it, the targets only follow once it has held for settle seconds.
+    ImVec2 pending{0.0f, 0.0f};
+    double pendingSince = 0.0;
+    static constexpr double settle = 0.2;
+
     int savedX = 0;
     int savedY = 0;
     
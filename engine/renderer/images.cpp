@@ -9,7 +9,7 @@
 #include "tools.h"
 
 namespace Adren {
-void Images::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VmaMemoryUsage vmaUsage, Image& image) {
+void Images::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VmaMemoryUsage vmaUsage, MemoryCategory category, Image& image) {
     VkImageCreateInfo imageInfo{};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -30,6 +30,7 @@ void Images::createImage(uint32_t width, uint32_t height, VkFormat format, VkIma
     allocInfo.requiredFlags = properties;
 
     vmaCreateImage(allocator, &imageInfo, &allocInfo, &image.image, &image.memory, nullptr);
+    Memory::track(allocator, image.memory, category);
 }
 
 VkImageView Images::createImageView(VkImage& image, VkFormat format, VkImageAspectFlags aspectFlags) {
@@ -114,33 +115,32 @@ void Images::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, u
     Adren::Tools::endSingleTimeCommands(commandBuffer, device, graphicsQueue, commandPool);
 }
 
-void Images::loadTextures(std::vector<Model::Texture>& textures, VkCommandPool& commandPool) {
-    for (Model model : models) {
-        for (size_t t = 0; t < model.textures.size(); t++) {
-            Model::Texture texture = model.textures[t];
-            int32_t index = model.textures[t].index;
-            Model::glTFImage image = model.images[t];
+// Appended to textures in the model's own order, the scene offsets each model's texture indices by what came before.
+void Images::loadTextures(const Model& model, std::vector<Model::Texture>& textures, VkCommandPool& commandPool) {
+    for (size_t t = 0; t < model.textures.size(); t++) {
+        Model::Texture texture = model.textures[t];
+        const Model::glTFImage& image = model.images[t];
+        VkDeviceSize size = image.pixels.size();
 
-            Buffer staging;
-            buffers.createBuffer(allocator, image.bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging, VMA_MEMORY_USAGE_CPU_ONLY);
+        Buffer staging;
+        buffers.createBuffer(allocator, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging, VMA_MEMORY_USAGE_CPU_ONLY, MemoryCategory::Staging);
 
-            uint8_t* data;
-            vmaMapMemory(allocator, staging.memory, (void**)&data);
-            memcpy(data, image.buffer, image.bufferSize);
-            vmaUnmapMemory(allocator, staging.memory);
+        uint8_t* data;
+        vmaMapMemory(allocator, staging.memory, (void**)&data);
+        memcpy(data, image.pixels.data(), size);
+        vmaUnmapMemory(allocator, staging.memory);
 
-            createImage(image.width, image.height, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT |
-                VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VMA_MEMORY_USAGE_GPU_ONLY, texture);
-            transitionImageLayout(texture.image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, commandPool);
-            copyBufferToImage(staging.buffer, texture.image, static_cast<uint32_t>(image.width), static_cast<uint32_t>(image.height), commandPool);
-            transitionImageLayout(texture.image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, commandPool);
+        createImage(image.width, image.height, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+            VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VMA_MEMORY_USAGE_GPU_ONLY, MemoryCategory::Textures, texture);
+        transitionImageLayout(texture.image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, commandPool);
+        copyBufferToImage(staging.buffer, texture.image, static_cast<uint32_t>(image.width), static_cast<uint32_t>(image.height), commandPool);
+        transitionImageLayout(texture.image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, commandPool);
 
-            vmaDestroyBuffer(allocator, staging.buffer, staging.memory);
+        Memory::destroyBuffer(allocator, staging.buffer, staging.memory);
 
-            texture.view = createImageView(texture.image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT);
-            textures.push_back(texture);
-        }
+        texture.view = createImageView(texture.image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT);
+        textures.push_back(texture);
     }
 }
 
@@ -161,7 +161,7 @@ void Images::createDepthResources(VkExtent2D extent) {
     }
 
     createImage(extent.width, extent.height, depth.format, VK_IMAGE_TILING_OPTIMAL, 
-        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VMA_MEMORY_USAGE_GPU_ONLY, depth);
+        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VMA_MEMORY_USAGE_GPU_ONLY, MemoryCategory::Targets, depth);
     depth.view = createImageView(depth.image, depth.format, VK_IMAGE_ASPECT_DEPTH_BIT);
 }
 }
\ No newline at end of file
@@ -14,14 +14,13 @@
 namespace Adren {
 class Images {
 public:
-	Images(std::vector<Model>& models, Devices& devices, Buffers& buffers) : models(models), 
-		device(devices.device), buffers(buffers), gpu(devices.gpu), 
+	Images(Devices& devices, Buffers& buffers) : device(devices.device), buffers(buffers), gpu(devices.gpu), 
 		graphicsQueue(devices.graphicsQueue), allocator(devices.allocator) {}
 
 	void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, 
-		VkMemoryPropertyFlags properties, VmaMemoryUsage vmaUsage, Image& image);
+		VkMemoryPropertyFlags properties, VmaMemoryUsage vmaUsage, MemoryCategory category, Image& image);
 	VkImageView createImageView(VkImage& image, VkFormat format, VkImageAspectFlags aspectFlags);
-	void loadTextures(std::vector<Model::Texture>& textures, VkCommandPool& commandPool);
+	void loadTextures(const Model& model, std::vector<Model::Texture>& textures, VkCommandPool& commandPool);
 	void createDepthResources(VkExtent2D extent);
 	Image depth;
 private:
@@ -32,6 +31,5 @@ private:
 	VkQueue& graphicsQueue;
 	Buffers& buffers;
 	VmaAllocator& allocator;
-	std::vector<Model>& models;
 };
 }
\ No newline at end of file
@@ -0,0 +1,524 @@
+/*
+	indirect.cpp
+	Adrenaline Engine
+
+	Definitions for the GPU culling passes and the indirect draws they feed.
+*/
+
+#include "indirect.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+// Rounding up keeps every level 0 texel at most one depth texel across, so the 2x2 gather in hiz.comp always
+// covers all the depth under it. Rounding down would skip texels and could occlude draws that are visible.
+uint32_t nextPowerOfTwo(uint32_t value) {
+	uint32_t result = 1;
+	while (result < value) { result *= 2; }
+	return result;
+}
+
+bool hasStencil(VkFormat format) {
+	return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
+}
+}
+
+// Everything here is optional, the renderer keeps culling on the CPU if any piece is missing.
+void Adren::Indirect::create(Pipeline& pipeline) {
+	std::string cullPath = "../engine/resources/shaders/cull.spv";
+	std::string reducePath = "../engine/resources/shaders/hiz.spv";
+
+	if (!devices.indirectCount || !pipeline.instancing || !std::ifstream(cullPath).good() || !std::ifstream(reducePath).good()) {
+		Tools::log("GPU culling is unavailable, culling stays on the CPU..");
+		return;
+	}
+
+	cullPass = createPass(pipeline, cullPath);
+	reducePass = createPass(pipeline, reducePath);
+
+	VkSamplerCreateInfo samplerInfo{};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = samplerInfo.addressModeU;
+	samplerInfo.addressModeW = samplerInfo.addressModeU;
+	samplerInfo.maxLod = static_cast<float>(maxLevels);
+	Tools::vibeCheck("PYRAMID SAMPLER", vkCreateSampler(device, &samplerInfo, nullptr, &sampler));
+
+	supported = true;
+}
+
+Adren::Indirect::Pass Adren::Indirect::createPass(Pipeline& pipeline, const std::string& path) {
+	auto code = Pipeline::readFile(path);
+	Reflection::Interface reflected = Reflection::reflect(code);
+
+	Pass pass;
+	pass.module = pipeline.createShaderModule(code);
+	pass.setLayout = reflection.setLayout(reflected);
+	pass.layout = reflection.pipelineLayout(pass.setLayout, reflected);
+
+	VkComputePipelineCreateInfo info{};
+	info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	info.stage.module = pass.module;
+	info.stage.pName = "main";
+	info.layout = pass.layout;
+	Tools::vibeCheck("COMPUTE PIPELINE", vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &info, nullptr, &pass.handle));
+
+	return pass;
+}
+
+// Draws are grouped by pipeline state, every group gets a contiguous range of commands that the culling pass appends into.
+void Adren::Indirect::build(Scene& scene, uint32_t width, uint32_t height) {
+	if (!supported) { return; }
+
+	vkDeviceWaitIdle(device);
+	destroyBuffers();
+
+	count = static_cast<uint32_t>(scene.draws.size());
+	batches.clear();
+
+	std::unordered_map<Pipeline::State, uint32_t, Pipeline::Hash> lookup;
+	std::vector<uint32_t> batchOf(count);
+	for (uint32_t i = 0; i < count; i++) {
+		Pipeline::State state = scene.draws[i].state;
+		state.vertexFormat = Pipeline::Instanced;
+
+		auto [found, inserted] = lookup.emplace(state, static_cast<uint32_t>(batches.size()));
+		if (inserted) { batches.push_back({ state, 0, 0 }); }
+
+		batches[found->second].size++;
+		batchOf[i] = found->second;
+	}
+
+	std::vector<uint32_t> baseData(std::max<size_t>(batches.size(), 1), 0);
+	uint32_t first = 0;
+	for (size_t b = 0; b < batches.size(); b++) {
+		batches[b].first = first;
+		baseData[b] = first;
+		first += batches[b].size;
+	}
+
+	objectData.assign(std::max(count, 1u), Object{});
+	instanceData.assign(std::max(count, 1u), Instance{});
+	for (uint32_t i = 0; i < count; i++) {
+		const Scene::Draw& draw = scene.draws[i];
+		glm::vec3 center(scene.bounds.centerX[i], scene.bounds.centerY[i], scene.bounds.centerZ[i]);
+		glm::vec3 extent(scene.bounds.extentX[i], scene.bounds.extentY[i], scene.bounds.extentZ[i]);
+
+		objectData[i] = { glm::vec4(center, glm::length(extent)), draw.indexCount, draw.firstIndex, draw.vertexOffset, batchOf[i] };
+		instanceData[i].model = scene.sources[i].matrix;
+		instanceData[i].texture = draw.texture;
+	}
+
+	auto upload = [this](Buffer& buffer, const void* data, VkDeviceSize size, VkBufferUsageFlags usage, MemoryCategory category) {
+		buffer.size = size;
+		buffers.createBuffer(allocator, buffer.size, usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffer, VMA_MEMORY_USAGE_CPU_TO_GPU, category);
+
+		void* mapped;
+		vmaMapMemory(allocator, buffer.memory, &mapped);
+		memcpy(mapped, data, size);
+		vmaFlushAllocation(allocator, buffer.memory, 0, size);
+		vmaUnmapMemory(allocator, buffer.memory);
+	};
+
+	upload(bases, baseData.data(), sizeof(uint32_t) * baseData.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryCategory::Other);
+
+	// The object regions are bound as storage buffers at an offset, so each has to start on the storage alignment.
+	VkPhysicalDeviceProperties properties{};
+	vkGetPhysicalDeviceProperties(devices.gpu, &properties);
+	VkDeviceSize storageAlign = std::max<VkDeviceSize>(properties.limits.minStorageBufferOffsetAlignment, 1);
+	objectRegion = (sizeof(Object) * objectData.size() + storageAlign - 1) / storageAlign * storageAlign;
+	instanceRegion = sizeof(Instance) * instanceData.size();
+
+	// Stays mapped, every frame writes its own region again when something it holds has moved.
+	auto regions = [this](Buffer& buffer, VkDeviceSize region, VkBufferUsageFlags usage, MemoryCategory category) {
+		buffer.size = region * maxFramesInFlight;
+		buffers.createBuffer(allocator, buffer.size, usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffer, VMA_MEMORY_USAGE_CPU_TO_GPU, category);
+		vmaMapMemory(allocator, buffer.memory, &buffer.mapped);
+	};
+
+	regions(objects, objectRegion, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryCategory::Other);
+	regions(instances, instanceRegion, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, MemoryCategory::Geometry);
+	for (Dirty& range : dirty) { range = { 0, static_cast<uint32_t>(objectData.size()) }; }
+	for (uint32_t frame = 0; frame < maxFramesInFlight; frame++) { refresh(frame); }
+
+	params.size = sizeof(Params);
+	buffers.createBuffer(allocator, params.size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, params, VMA_MEMORY_USAGE_GPU_ONLY, MemoryCategory::Uniforms);
+
+	commands.size = sizeof(VkDrawIndexedIndirectCommand) * objectData.size();
+	buffers.createBuffer(allocator, commands.size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, commands, VMA_MEMORY_USAGE_GPU_ONLY, MemoryCategory::Other);
+
+	counts.size = sizeof(uint32_t) * baseData.size();
+	buffers.createBuffer(allocator, counts.size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, counts, VMA_MEMORY_USAGE_GPU_ONLY, MemoryCategory::Other);
+
+	// Each frame in flight copies its counts into its own slot so the editor can show how much was drawn.
+	readback.size = counts.size * maxFramesInFlight;
+	buffers.createBuffer(allocator, readback.size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, readback, VMA_MEMORY_USAGE_GPU_TO_CPU, MemoryCategory::Staging);
+	vmaMapMemory(allocator, readback.memory, &readback.mapped);
+	memset(readback.mapped, 0, readback.size);
+
+	// The device is idle, so the old sets can go right away. The depth buffer is written into the new ones by prepare.
+	if (pyramid.image == VK_NULL_HANDLE) { createPyramid(width, height); }
+	vkDestroyDescriptorPool(device, writeSets(VK_NULL_HANDLE), nullptr);
+}
+
+// Runs before anything of the frame is recorded. A pyramid of another size or a new depth buffer needs new sets,
+// and frames in flight may still have the old ones bound, so those are retired along with the old pyramid.
+void Adren::Indirect::prepare(Image& depth, uint32_t width, uint32_t height) {
+	if (!supported || params.buffer == VK_NULL_HANDLE) { return; }
+
+	bool resized = nextPowerOfTwo(std::max(width, 1u)) != pyramidWidth || nextPowerOfTwo(std::max(height, 1u)) != pyramidHeight;
+	if (!resized && depth.view == source) { return; }
+
+	if (resized) {
+		retire([device = device, allocator = allocator, old = pyramid, views = levels] {
+			for (VkImageView view : views) { vkDestroyImageView(device, view, nullptr); }
+			vkDestroyImageView(device, old.view, nullptr);
+			Memory::destroyImage(allocator, old.image, old.memory);
+		});
+
+		levels.clear();
+		createPyramid(width, height);
+	}
+
+	retire([device = device, old = writeSets(depth.view)] { vkDestroyDescriptorPool(device, old, nullptr); });
+}
+
+// Rewrites the spheres and instance matrices of the draws whose nodes are in the given range of slots. Only the
+// CPU copies change here, each frame's region picks them up in refresh once its frame has finished on the GPU.
+void Adren::Indirect::refit(Scene& scene, uint32_t first, uint32_t count) {
+	if (!supported || this->count == 0) { return; }
+
+	uint32_t lo = UINT32_MAX;
+	uint32_t hi = 0;
+	for (uint32_t i = 0; i < this->count; i++) {
+		const Scene::Source& source = scene.sources[i];
+		if (source.node < first || source.node >= first + count) { continue; }
+
+		glm::vec3 center(scene.bounds.centerX[i], scene.bounds.centerY[i], scene.bounds.centerZ[i]);
+		glm::vec3 extent(scene.bounds.extentX[i], scene.bounds.extentY[i], scene.bounds.extentZ[i]);
+		objectData[i].sphere = glm::vec4(center, glm::length(extent));
+		instanceData[i].model = source.matrix;
+		lo = std::min(lo, i);
+		hi = i + 1;
+	}
+
+	if (lo >= hi) { return; }
+
+	for (Dirty& range : dirty) {
+		range.first = std::min(range.first, lo);
+		range.end = std::max(range.end, hi);
+	}
+}
+
+void Adren::Indirect::refresh(uint32_t frame) {
+	Dirty& range = dirty[frame];
+	if (range.first >= range.end) { return; }
+
+	VkDeviceSize objectOffset = objectRegion * frame + sizeof(Object) * range.first;
+	VkDeviceSize instanceOffset = instanceRegion * frame + sizeof(Instance) * range.first;
+	uint32_t changed = range.end - range.first;
+	memcpy(static_cast<char*>(objects.mapped) + objectOffset, &objectData[range.first], sizeof(Object) * changed);
+	memcpy(static_cast<char*>(instances.mapped) + instanceOffset, &instanceData[range.first], sizeof(Instance) * changed);
+	vmaFlushAllocation(allocator, objects.memory, objectOffset, sizeof(Object) * changed);
+	vmaFlushAllocation(allocator, instances.memory, instanceOffset, sizeof(Instance) * changed);
+	range = {};
+}
+
+void Adren::Indirect::cull(VkCommandBuffer& commandBuffer, const glm::mat4& viewProj, const Settings& settings, uint32_t frame) {
+	// This frame's fence has been waited on, so the counts it copied out last time around are ready to read.
+	VkDeviceSize slot = counts.size * frame;
+	vmaInvalidateAllocation(allocator, readback.memory, slot, counts.size);
+	const uint32_t* written = reinterpret_cast<const uint32_t*>(static_cast<char*>(readback.mapped) + slot);
+	drawn = 0;
+	for (size_t b = 0; b < batches.size(); b++) { drawn += written[b]; }
+	refresh(frame);
+
+	Culling::Frustum frustum = Culling::frustum(viewProj);
+	Params data{};
+	std::copy(std::begin(frustum.planes), std::end(frustum.planes), data.planes);
+	data.previous = previous;
+	data.pyramidSize = glm::vec2(pyramidWidth, pyramidHeight);
+	data.count = count;
+	data.frustum = settings.frustumCulling;
+
+	// The pyramid is only trusted when the frame right before this one built it.
+	data.occlusion = settings.occlusionCulling && reduced;
+	current = viewProj;
+	reduced = false;
+
+	// Last frame's indirect reads, count copies and pyramid writes have to finish before any of it is overwritten.
+	barrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT);
+
+	vkCmdUpdateBuffer(commandBuffer, params.buffer, 0, sizeof(Params), &data);
+	vkCmdFillBuffer(commandBuffer, counts.buffer, 0, counts.size, 0);
+
+	barrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPass.handle);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPass.layout, 0, 1, &cullSets[frame], 0, nullptr);
+	vkCmdDispatch(commandBuffer, (count + 63) / 64, 1, 1);
+
+	barrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT);
+
+	VkBufferCopy region{ 0, slot, counts.size };
+	vkCmdCopyBuffer(commandBuffer, counts.buffer, readback.buffer, 1, &region);
+
+	barrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+}
+
+void Adren::Indirect::draw(VkCommandBuffer& commandBuffer, Pipeline& pipeline, VkDescriptorSet& set, uint32_t frame, DrawCounters& counters) {
+	VkDeviceSize offset = instanceRegion * frame;
+	vkCmdBindVertexBuffers(commandBuffer, 1, 1, &instances.buffer, &offset);
+
+	// The instanced shaders never read the dynamic uniform buffer but the set still needs an offset for it.
+	uint32_t dynamicOffset = 0;
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.layout, 0, 1, &set, 1, &dynamicOffset);
+
+	const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+	for (uint32_t b = 0; b < batches.size(); b++) {
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.get(batches[b].state));
+		vkCmdDrawIndexedIndirectCount(commandBuffer, commands.buffer, batches[b].first * stride, counts.buffer,
+			b * sizeof(uint32_t), batches[b].size, stride);
+	}
+
+	counters.calls += static_cast<uint32_t>(batches.size());
+	counters.pipelines += static_cast<uint32_t>(batches.size());
+	counters.sets++;
+}
+
+// Builds the depth pyramid from the depth buffer the scene was just drawn into, the next frame culls against it.
+// Prepare has already matched the pyramid and its sets to this depth buffer.
+void Adren::Indirect::reduce(VkCommandBuffer& commandBuffer, Image& depth, uint32_t width, uint32_t height) {
+	VkImageMemoryBarrier depthBarrier{};
+	depthBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	depthBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	depthBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	depthBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	depthBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	depthBarrier.image = depth.image;
+	depthBarrier.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+	if (hasStencil(depth.format)) { depthBarrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT; }
+
+	// The pyramid stays in the general layout, it only needs moving out of undefined the first time.
+	VkImageMemoryBarrier pyramidBarrier{};
+	pyramidBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	pyramidBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	pyramidBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	pyramidBarrier.oldLayout = fresh ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_GENERAL;
+	pyramidBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	pyramidBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	pyramidBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	pyramidBarrier.image = pyramid.image;
+	pyramidBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, static_cast<uint32_t>(levels.size()), 0, 1 };
+	fresh = false;
+
+	VkImageMemoryBarrier startBarriers[] = { depthBarrier, pyramidBarrier };
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 2, startBarriers);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, reducePass.handle);
+
+	for (uint32_t level = 0; level < levels.size(); level++) {
+		glm::vec2 size(std::max(pyramidWidth >> level, 1u), std::max(pyramidHeight >> level, 1u));
+
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, reducePass.layout, 0, 1, &reduceSets[level], 0, nullptr);
+		vkCmdPushConstants(commandBuffer, reducePass.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(size), &size);
+		vkCmdDispatch(commandBuffer, (static_cast<uint32_t>(size.x) + 7) / 8, (static_cast<uint32_t>(size.y) + 7) / 8, 1);
+
+		// The next level reads this one.
+		VkImageMemoryBarrier levelBarrier = pyramidBarrier;
+		levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		levelBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+		levelBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 };
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &levelBarrier);
+	}
+
+	previous = current;
+	reduced = true;
+}
+
+void Adren::Indirect::createPyramid(uint32_t width, uint32_t height) {
+	pyramidWidth = nextPowerOfTwo(std::max(width, 1u));
+	pyramidHeight = nextPowerOfTwo(std::max(height, 1u));
+	uint32_t levelCount = std::min(maxLevels, static_cast<uint32_t>(std::log2(std::max(pyramidWidth, pyramidHeight))) + 1);
+
+	VkImageCreateInfo imageInfo{};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = VK_FORMAT_R32_SFLOAT;
+	imageInfo.extent = { pyramidWidth, pyramidHeight, 1 };
+	imageInfo.mipLevels = levelCount;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	VmaAllocationCreateInfo allocInfo{};
+	allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+	Tools::vibeCheck("DEPTH PYRAMID", vmaCreateImage(allocator, &imageInfo, &allocInfo, &pyramid.image, &pyramid.memory, nullptr));
+	Memory::track(allocator, pyramid.memory, MemoryCategory::Targets);
+	pyramid.format = imageInfo.format;
+
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = pyramid.image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = pyramid.format;
+	viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount, 0, 1 };
+	Tools::vibeCheck("DEPTH PYRAMID VIEW", vkCreateImageView(device, &viewInfo, nullptr, &pyramid.view));
+
+	levels.resize(levelCount);
+	for (uint32_t level = 0; level < levelCount; level++) {
+		viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 };
+		Tools::vibeCheck("DEPTH PYRAMID LEVEL VIEW", vkCreateImageView(device, &viewInfo, nullptr, &levels[level]));
+	}
+
+	fresh = true;
+	reduced = false;
+}
+
+// Every set is written at once into a pool of its own, since they all point at buffers or pyramid levels that were
+// just recreated. Hands back the pool of the old sets for the caller to destroy once nothing uses them anymore.
+VkDescriptorPool Adren::Indirect::writeSets(VkImageView depth) {
+	VkDescriptorPool old = pool;
+
+	std::array<VkDescriptorPoolSize, 4> poolSizes{};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER; poolSizes[0].descriptorCount = maxFramesInFlight;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER; poolSizes[1].descriptorCount = 4 * maxFramesInFlight;
+	poolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER; poolSizes[2].descriptorCount = maxFramesInFlight + maxLevels;
+	poolSizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE; poolSizes[3].descriptorCount = maxLevels;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.maxSets = maxFramesInFlight + maxLevels;
+	Tools::vibeCheck("INDIRECT DESCRIPTOR POOL", vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool));
+
+	std::vector<VkDescriptorSetLayout> layouts(maxFramesInFlight + levels.size(), reducePass.setLayout);
+	std::fill(layouts.begin(), layouts.begin() + maxFramesInFlight, cullPass.setLayout);
+
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = pool;
+	allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+	allocInfo.pSetLayouts = layouts.data();
+
+	std::vector<VkDescriptorSet> sets(layouts.size());
+	Tools::vibeCheck("INDIRECT DESCRIPTOR SETS", vkAllocateDescriptorSets(device, &allocInfo, sets.data()));
+	std::copy(sets.begin(), sets.begin() + maxFramesInFlight, cullSets);
+	reduceSets.assign(sets.begin() + maxFramesInFlight, sets.end());
+
+	// The culling sets only differ in which frame's region of the objects they read.
+	std::array<VkDescriptorBufferInfo, 5 * maxFramesInFlight> bufferInfos{};
+	for (uint32_t frame = 0; frame < maxFramesInFlight; frame++) {
+		VkDescriptorBufferInfo* infos = &bufferInfos[frame * 5];
+		infos[0] = { params.buffer, 0, VK_WHOLE_SIZE };
+		infos[1] = { objects.buffer, objectRegion * frame, objectRegion };
+		infos[2] = { bases.buffer, 0, VK_WHOLE_SIZE };
+		infos[3] = { commands.buffer, 0, VK_WHOLE_SIZE };
+		infos[4] = { counts.buffer, 0, VK_WHOLE_SIZE };
+	}
+	VkDescriptorImageInfo pyramidInfo{ sampler, pyramid.view, VK_IMAGE_LAYOUT_GENERAL };
+
+	std::vector<VkDescriptorImageInfo> imageInfos(levels.size() * 2);
+	std::vector<VkWriteDescriptorSet> writes;
+
+	auto write = [&writes](VkDescriptorSet set, uint32_t binding, VkDescriptorType type) -> VkWriteDescriptorSet& {
+		VkWriteDescriptorSet& entry = writes.emplace_back();
+		entry.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		entry.dstSet = set;
+		entry.dstBinding = binding;
+		entry.descriptorCount = 1;
+		entry.descriptorType = type;
+		return entry;
+	};
+
+	for (uint32_t frame = 0; frame < maxFramesInFlight; frame++) {
+		for (uint32_t binding = 0; binding < 5; binding++) {
+			write(cullSets[frame], binding, binding == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER).pBufferInfo = &bufferInfos[frame * 5 + binding];
+		}
+		write(cullSets[frame], 5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER).pImageInfo = &pyramidInfo;
+	}
+
+	// Every level reads the one above it, the first level reads the depth buffer. Without one it is left unwritten
+	// and prepare writes new sets before the pyramid is next built.
+	for (uint32_t level = 0; level < levels.size(); level++) {
+		imageInfos[level * 2] = level > 0 ? VkDescriptorImageInfo{ sampler, levels[level - 1], VK_IMAGE_LAYOUT_GENERAL }
+			: VkDescriptorImageInfo{ sampler, depth, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		imageInfos[level * 2 + 1] = { VK_NULL_HANDLE, levels[level], VK_IMAGE_LAYOUT_GENERAL };
+
+		if (level > 0 || depth != VK_NULL_HANDLE) { write(reduceSets[level], 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER).pImageInfo = &imageInfos[level * 2]; }
+		write(reduceSets[level], 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE).pImageInfo = &imageInfos[level * 2 + 1];
+	}
+
+	vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+	source = depth;
+	return old;
+}
+
+void Adren::Indirect::barrier(VkCommandBuffer& commandBuffer, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+	VkMemoryBarrier memoryBarrier{};
+	memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memoryBarrier.srcAccessMask = srcAccess;
+	memoryBarrier.dstAccessMask = dstAccess;
+	vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+}
+
+void Adren::Indirect::destroyPyramid() {
+	for (VkImageView view : levels) { vkDestroyImageView(device, view, nullptr); }
+	levels.clear();
+
+	if (pyramid.image != VK_NULL_HANDLE) {
+		vkDestroyImageView(device, pyramid.view, nullptr);
+		Memory::destroyImage(allocator, pyramid.image, pyramid.memory);
+	}
+
+	pyramid = {};
+	pyramidWidth = 0;
+	pyramidHeight = 0;
+}
+
+void Adren::Indirect::destroyBuffers() {
+	for (Buffer* buffer : { &objects, &instances, &readback }) {
+		if (buffer->buffer != VK_NULL_HANDLE) { vmaUnmapMemory(allocator, buffer->memory); }
+	}
+
+	for (Buffer* buffer : { &params, &objects, &bases, &commands, &counts, &instances, &readback }) {
+		if (buffer->buffer != VK_NULL_HANDLE) { Memory::destroyBuffer(allocator, buffer->buffer, buffer->memory); }
+		*buffer = {};
+	}
+}
+
+void Adren::Indirect::cleanup() {
+	if (!supported) { return; }
+
+	destroyBuffers();
+	destroyPyramid();
+	vkDestroyDescriptorPool(device, pool, nullptr);
+	vkDestroySampler(device, sampler, nullptr);
+
+	for (Pass* pass : { &cullPass, &reducePass }) {
+		vkDestroyPipeline(device, pass->handle, nullptr);
+		vkDestroyShaderModule(device, pass->module, nullptr);
+	}
+}
@@ -0,0 +1,116 @@
+/*
+	indirect.h
+	Adrenaline Engine
+
+	GPU driven culling. A compute pass tests every draw's bounding sphere against the frustum and the depth
+	pyramid of the last frame, then writes the survivors out as indirect commands with a count the GPU fills in.
+*/
+
+#pragma once
+#include "buffers.h"
+#include "pipeline.h"
+#include "scene.h"
+#include <functional>
+
+namespace Adren {
+class Indirect {
+public:
+	Indirect(Devices& devices, Buffers& buffers, Reflection& reflection) : devices(devices), buffers(buffers), reflection(reflection) {}
+
+	void create(Pipeline& pipeline);
+	void build(Scene& scene, uint32_t width, uint32_t height);
+	void refit(Scene& scene, uint32_t first, uint32_t count);
+	void prepare(Image& depth, uint32_t width, uint32_t height);
+	void cull(VkCommandBuffer& commandBuffer, const glm::mat4& viewProj, const Settings& settings, uint32_t frame);
+	void draw(VkCommandBuffer& commandBuffer, Pipeline& pipeline, VkDescriptorSet& set, uint32_t frame, DrawCounters& counters);
+	void reduce(VkCommandBuffer& commandBuffer, Image& depth, uint32_t width, uint32_t height);
+	void cleanup();
+
+	bool supported = false;
+	uint32_t drawn = 0;
+
+	// The pyramid and sets replaced by prepare may still be used by frames in flight, they go here to be destroyed.
+	std::function<void(std::function<void()>)> retire;
+private:
+	// Laid out the same as the std140 block in cull.comp.
+	struct Params {
+		glm::vec4 planes[6];
+		glm::mat4 previous;
+		glm::vec2 pyramidSize;
+		uint32_t count;
+		uint32_t frustum;
+		uint32_t occlusion;
+		uint32_t padding[3];
+	};
+
+	struct Object {
+		glm::vec4 sphere;
+		uint32_t indexCount;
+		uint32_t firstIndex;
+		int32_t vertexOffset;
+		uint32_t batch;
+	};
+
+	// Draws that share a pipeline state get their own range of the command buffer and their own count.
+	struct Batch {
+		Pipeline::State state;
+		uint32_t first;
+		uint32_t size;
+	};
+
+	struct Pass {
+		VkShaderModule module = VK_NULL_HANDLE;
+		VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		VkPipeline handle = VK_NULL_HANDLE;
+	};
+
+	Pass createPass(Pipeline& pipeline, const std::string& path);
+	void createPyramid(uint32_t width, uint32_t height);
+	void destroyPyramid();
+	void destroyBuffers();
+	VkDescriptorPool writeSets(VkImageView depth);
+	void refresh(uint32_t frame);
+	static void barrier(VkCommandBuffer& commandBuffer, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+	Devices& devices;
+	Buffers& buffers;
+	Reflection& reflection;
+	VkDevice& device = devices.device;
+	VmaAllocator& allocator = devices.allocator;
+
+	Pass cullPass, reducePass;
+	VkDescriptorPool pool = VK_NULL_HANDLE;
+	VkDescriptorSet cullSets[maxFramesInFlight] = {};
+	std::vector<VkDescriptorSet> reduceSets;
+	VkSampler sampler = VK_NULL_HANDLE;
+
+	Buffer params{}, objects{}, bases{}, commands{}, counts{}, instances{}, readback{};
+	std::vector<Batch> batches;
+	uint32_t count = 0;
+
+	// The spheres and instance matrices are written by the CPU, so every frame in flight reads its own region of
+	// the buffers. The draws moved since a frame's region was last written are caught up when it culls again.
+	std::vector<Object> objectData;
+	std::vector<Instance> instanceData;
+	VkDeviceSize objectRegion = 0;
+	VkDeviceSize instanceRegion = 0;
+	struct Dirty {
+		uint32_t first = UINT32_MAX;
+		uint32_t end = 0;
+	} dirty[maxFramesInFlight];
+
+	// One view over every level for the culling pass to sample and one view per level for the reduction to write.
+	Image pyramid{};
+	std::vector<VkImageView> levels;
+	uint32_t pyramidWidth = 0;
+	uint32_t pyramidHeight = 0;
+	VkImageView source = VK_NULL_HANDLE;
+	bool fresh = false;
+	bool reduced = false;
+	glm::mat4 current{1.0f};
+	glm::mat4 previous{1.0f};
+
+	static const uint32_t maxLevels = 16;
+};
+}
@@ -0,0 +1,208 @@
+/*
+	input.cpp
+	Adrenaline Engine
+
+	Definitions for recording and replaying input.
+*/
+
+#include "input.h"
+#include "tools.h"
+#include <chrono>
+#include <fstream>
+#include <cstring>
+
+namespace {
+const char magic[4] = { 'A', 'D', 'R', 'I' };
+const uint32_t version = 2;
+
+double seconds() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+template <typename T>
+void put(std::ofstream& file, const T& value) {
+	file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool get(std::ifstream& file, T& value) {
+	return static_cast<bool>(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+}
+
+void Adren::Input::attach(GLFWwindow* window) {
+	glfwSetWindowUserPointer(window, this);
+	glfwSetKeyCallback(window, keyCallback);
+	glfwSetMouseButtonCallback(window, buttonCallback);
+	glfwSetCursorPosCallback(window, cursorCallback);
+}
+
+// A replay starts one before its first frame, so its first advance lands on frame 0 with only frame 0's events.
+// One that has run out hands back to live input with nothing held down, so the camera doesn't drift off.
+void Adren::Input::advance() {
+	frame++;
+	if (mode != Mode::Replaying) { return; }
+
+	while (next < events.size() && events[next].frame <= frame) { apply(events[next++]); }
+
+	if (next == events.size() && frame >= logged) {
+		mode = Mode::Live;
+		std::fill(std::begin(keys), std::end(keys), false);
+		std::fill(std::begin(buttons), std::end(buttons), false);
+		Tools::log("Replayed " + std::to_string(logged) + " frames of input..");
+	}
+}
+
+// Before a replay's first frame nothing is stepped, so whatever runs ahead of it holds the starting camera.
+double Adren::Input::step(double elapsed) {
+	if (mode == Mode::Recording) {
+		if (steps.size() <= frame) { steps.resize(frame + 1, 0.0); }
+		steps[frame] = elapsed;
+	} else if (mode == Mode::Replaying) {
+		elapsed = frame < steps.size() ? steps[frame] : 0.0;
+	}
+
+	return elapsed;
+}
+
+bool Adren::Input::down(int key) const {
+	return key >= 0 && key <= GLFW_KEY_LAST && keys[key];
+}
+
+bool Adren::Input::pressed(int button) const {
+	return button >= 0 && button <= GLFW_MOUSE_BUTTON_LAST && buttons[button];
+}
+
+void Adren::Input::focus(bool focused) {
+	if (focused != hasFocus) { push({ frame, elapsed(), Type::Focus, static_cast<uint8_t>(focused), 0, 0.0f, 0.0f }); }
+}
+
+// Whatever is already held down is logged first, otherwise the replay would never see it pressed.
+void Adren::Input::record(uint32_t tickRate, bool fixedStep, const Camera::State& camera) {
+	mode = Mode::Recording;
+	events.clear();
+	steps.clear();
+	next = 0;
+	frame = 0;
+	rate = tickRate;
+	fixed = fixedStep;
+	initial = camera;
+	started = seconds();
+
+	for (int key = 0; key <= GLFW_KEY_LAST; key++) {
+		if (keys[key]) { events.push_back({ 0, 0.0f, Type::Key, GLFW_PRESS, static_cast<uint16_t>(key), 0.0f, 0.0f }); }
+	}
+
+	for (int button = 0; button <= GLFW_MOUSE_BUTTON_LAST; button++) {
+		if (buttons[button]) { events.push_back({ 0, 0.0f, Type::Button, GLFW_PRESS, static_cast<uint16_t>(button), 0.0f, 0.0f }); }
+	}
+
+	events.push_back({ 0, 0.0f, Type::Focus, static_cast<uint8_t>(hasFocus), 0, 0.0f, 0.0f });
+}
+
+// A header, the camera the recording started from, every event as it is laid out in memory and then the time
+// every frame stepped by.
+bool Adren::Input::save(const std::string& path) {
+	if (mode == Mode::Recording) {
+		mode = Mode::Live;
+		logged = frame;
+		steps.resize(logged, 0.0);
+	}
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file) { return false; }
+
+	file.write(magic, sizeof(magic));
+	put(file, version);
+	put(file, rate);
+	put(file, static_cast<uint8_t>(fixed));
+	put(file, logged);
+	put(file, static_cast<uint32_t>(events.size()));
+
+	put(file, initial.pos);
+	put(file, initial.front);
+	put(file, initial.yaw);
+	put(file, initial.pitch);
+	put(file, initial.lastX);
+	put(file, initial.lastY);
+	put(file, static_cast<uint8_t>(initial.firstMouse));
+
+	file.write(reinterpret_cast<const char*>(events.data()), static_cast<std::streamsize>(events.size() * sizeof(Event)));
+	file.write(reinterpret_cast<const char*>(steps.data()), static_cast<std::streamsize>(steps.size() * sizeof(double)));
+	return static_cast<bool>(file);
+}
+
+bool Adren::Input::replay(const std::string& path) {
+	std::ifstream file(path, std::ios::binary);
+	char header[4];
+	uint32_t fileVersion = 0, count = 0;
+	uint8_t fixedStep = 1;
+	if (!file || !file.read(header, sizeof(header)) || std::memcmp(header, magic, sizeof(magic)) != 0) { return false; }
+	if (!get(file, fileVersion) || fileVersion != version || !get(file, rate) || !get(file, fixedStep) || !get(file, logged) || !get(file, count)) { return false; }
+	fixed = fixedStep != 0;
+
+	uint8_t firstMouse = 0;
+	if (!get(file, initial.pos) || !get(file, initial.front) || !get(file, initial.yaw) || !get(file, initial.pitch) ||
+		!get(file, initial.lastX) || !get(file, initial.lastY) || !get(file, firstMouse)) { return false; }
+	initial.firstMouse = firstMouse != 0;
+
+	events.resize(count);
+	if (!file.read(reinterpret_cast<char*>(events.data()), static_cast<std::streamsize>(count * sizeof(Event)))) { return false; }
+
+	steps.resize(logged);
+	if (!file.read(reinterpret_cast<char*>(steps.data()), static_cast<std::streamsize>(logged * sizeof(double)))) { return false; }
+
+	mode = Mode::Replaying;
+	next = 0;
+	frame = UINT32_MAX;
+	hasFocus = true;
+	std::fill(std::begin(keys), std::end(keys), false);
+	std::fill(std::begin(buttons), std::end(buttons), false);
+	return true;
+}
+
+// Live events are dropped while a replay runs, it owns the state until it is done.
+void Adren::Input::push(const Event& event) {
+	if (mode == Mode::Replaying) { return; }
+
+	apply(event);
+	if (mode == Mode::Recording) { events.push_back(event); }
+}
+
+void Adren::Input::apply(const Event& event) {
+	switch (event.type) {
+	case Type::Key:
+		if (event.code <= GLFW_KEY_LAST) { keys[event.code] = event.action != GLFW_RELEASE; }
+		break;
+	case Type::Button:
+		if (event.code <= GLFW_MOUSE_BUTTON_LAST) { buttons[event.code] = event.action != GLFW_RELEASE; }
+		break;
+	case Type::Cursor:
+		if (cursor) { cursor(event.x, event.y); }
+		break;
+	case Type::Focus:
+		hasFocus = event.action != 0;
+		break;
+	}
+}
+
+float Adren::Input::elapsed() const {
+	return mode == Mode::Recording ? static_cast<float>(seconds() - started) : 0.0f;
+}
+
+void Adren::Input::keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+	if (key < 0 || action == GLFW_REPEAT) { return; }
+
+	Input* input = static_cast<Input*>(glfwGetWindowUserPointer(window));
+	input->push({ input->frame, input->elapsed(), Type::Key, static_cast<uint8_t>(action), static_cast<uint16_t>(key), 0.0f, 0.0f });
+}
+
+void Adren::Input::buttonCallback(GLFWwindow* window, int button, int action, int mods) {
+	Input* input = static_cast<Input*>(glfwGetWindowUserPointer(window));
+	input->push({ input->frame, input->elapsed(), Type::Button, static_cast<uint8_t>(action), static_cast<uint16_t>(button), 0.0f, 0.0f });
+}
+
+void Adren::Input::cursorCallback(GLFWwindow* window, double x, double y) {
+	Input* input = static_cast<Input*>(glfwGetWindowUserPointer(window));
+	input->push({ input->frame, input->elapsed(), Type::Cursor, 0, 0, static_cast<float>(x), static_cast<float>(y) });
+}
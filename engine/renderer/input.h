@@ -0,0 +1,93 @@
+/*
+	input.h
+	Adrenaline Engine
+
+	Keys, mouse buttons and the cursor as the engine sees them. Live, the GLFW callbacks feed the state here and
+	everything that reacts to input reads it back instead of asking GLFW. Recording keeps every event with the
+	frame it arrived in and how long each frame simulated for, and replaying a saved log feeds the same events back
+	on the same frames and steps them by the same times, so a captured session runs exactly the same way again.
+*/
+
+#pragma once
+#include <GLFW/glfw3.h>
+#include "camera.h"
+#include <functional>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace Adren {
+class Input {
+public:
+	// Takes over the window's user pointer. Has to run before ImGui installs its callbacks so it chains to these.
+	void attach(GLFWwindow* window);
+
+	// Called once a frame before events are polled. While replaying, this is where the frame's events come in.
+	void advance();
+
+	bool down(int key) const;
+	bool pressed(int button) const;
+
+	// Whether the camera had the mouse, which depends on the editor as much as on input, so it is logged too.
+	void focus(bool focused);
+	bool focused() const { return hasFocus; }
+
+	// The tick rate, the timestep mode and the camera go into the log, replays start from that camera and run with those.
+	void record(uint32_t tickRate, bool fixedStep, const Camera::State& camera);
+	bool save(const std::string& path);
+	bool replay(const std::string& path);
+	const Camera::State& start() const { return initial; }
+
+	// The time this frame's simulation steps by. Recording logs the live time, a replay hands back the logged one.
+	double step(double elapsed);
+
+	bool recording() const { return mode == Mode::Recording; }
+	bool replaying() const { return mode == Mode::Replaying; }
+	uint32_t frames() const { return logged; }
+	uint32_t tickRate() const { return rate; }
+	bool fixedStep() const { return fixed; }
+
+	// Receives every cursor move, live or replayed.
+	std::function<void(double, double)> cursor;
+
+private:
+	enum class Mode : uint8_t { Live, Recording, Replaying };
+	enum class Type : uint8_t { Key, Button, Cursor, Focus };
+
+	// Twenty bytes an event, written as is. The time is only there to read a log by, replays go by frame.
+	struct Event {
+		uint32_t frame;
+		float time;
+		Type type;
+		uint8_t action;
+		uint16_t code;
+		float x;
+		float y;
+	};
+
+	static_assert(sizeof(Event) == 20, "Input events are written to logs as they are laid out");
+
+	static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
+	static void buttonCallback(GLFWwindow* window, int button, int action, int mods);
+	static void cursorCallback(GLFWwindow* window, double x, double y);
+
+	void push(const Event& event);
+	void apply(const Event& event);
+	float elapsed() const;
+
+	Mode mode = Mode::Live;
+	std::vector<Event> events;
+	std::vector<double> steps;
+	size_t next = 0;
+	uint32_t frame = 0;
+	uint32_t logged = 0;
+	uint32_t rate = 60;
+	bool fixed = true;
+	double started = 0.0;
+	Camera::State initial{};
+
+	bool keys[GLFW_KEY_LAST + 1]{};
+	bool buttons[GLFW_MOUSE_BUTTON_LAST + 1]{};
+	bool hasFocus = true;
+};
+}
@@ -0,0 +1,135 @@
+/*
+	instancing.cpp
+	Adrenaline Engine
+
+	Definitions for grouping draws and recording the instanced calls.
+*/
+
+#include "instancing.h"
+#include <algorithm>
+#include <numeric>
+
+size_t Adren::Instancing::Hash::operator()(const Key& key) const {
+	size_t seed = Pipeline::Hash()(key.state);
+	auto combine = [&seed](size_t value) { seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2); };
+	combine(std::hash<uint32_t>()(key.indexCount));
+	combine(std::hash<uint32_t>()(key.firstIndex));
+	combine(std::hash<int32_t>()(key.vertexOffset));
+	return seed;
+}
+
+// The texture comes in per instance, so placements of one model share a group even when their materials only
+// differ by texture. Groups are numbered in the order of their draws' sort keys, so the batches of a frame come
+// out grouped by pipeline with blended ones last.
+void Adren::Instancing::build(const Scene& scene) {
+	vkDeviceWaitIdle(device);
+	destroyBuffers();
+
+	uint32_t count = static_cast<uint32_t>(scene.draws.size());
+	groups.resize(count);
+	leaders.clear();
+
+	std::unordered_map<Key, uint32_t, Hash> lookup;
+	for (uint32_t i = 0; i < count; i++) {
+		const Scene::Draw& draw = scene.draws[i];
+		Key key{ draw.indexCount, draw.firstIndex, draw.vertexOffset, draw.state };
+		key.state.vertexFormat = Pipeline::Instanced;
+
+		auto [found, inserted] = lookup.emplace(key, static_cast<uint32_t>(leaders.size()));
+		if (inserted) { leaders.push_back(i); }
+		groups[i] = found->second;
+	}
+
+	std::vector<uint32_t> order(leaders.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return scene.draws[leaders[a]].key < scene.draws[leaders[b]].key; });
+
+	std::vector<uint32_t> renumbered(order.size()), sorted(order.size());
+	for (uint32_t g = 0; g < order.size(); g++) {
+		renumbered[order[g]] = g;
+		sorted[g] = leaders[order[g]];
+	}
+
+	leaders.swap(sorted);
+	for (uint32_t& group : groups) { group = renumbered[group]; }
+
+	cursors.assign(leaders.size(), 0);
+
+	for (Buffer& buffer : instances) {
+		buffer.size = sizeof(Instance) * std::max(count, 1u);
+		buffers.createBuffer(allocator, buffer.size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, buffer, VMA_MEMORY_USAGE_CPU_TO_GPU, MemoryCategory::Geometry);
+		vmaMapMemory(allocator, buffer.memory, &buffer.mapped);
+	}
+
+	Tools::log(std::to_string(count) + " draws fold into " + std::to_string(leaders.size()) + " instanced groups..");
+}
+
+// A counting sort of the visible draws by group, the frame's fence has to have been waited on first.
+void Adren::Instancing::prepare(const Scene& scene, uint32_t frame) {
+	batches.clear();
+	if (leaders.empty()) { return; }
+
+	std::fill(cursors.begin(), cursors.end(), 0);
+	for (uint32_t i : scene.visible) { cursors[groups[i]]++; }
+
+	uint32_t first = 0;
+	for (uint32_t g = 0; g < leaders.size(); g++) {
+		if (cursors[g] == 0) { continue; }
+
+		batches.push_back({ leaders[g], first, cursors[g] });
+		uint32_t size = cursors[g];
+		cursors[g] = first;
+		first += size;
+	}
+
+	Instance* data = static_cast<Instance*>(instances[frame].mapped);
+	for (uint32_t i : scene.visible) {
+		Instance& instance = data[cursors[groups[i]]++];
+		instance.model = scene.sources[i].matrix;
+		instance.texture = scene.draws[i].texture;
+	}
+
+	vmaFlushAllocation(allocator, instances[frame].memory, 0, sizeof(Instance) * first);
+}
+
+// Records the batches from first up to last, separate ranges can go into separate command buffers at once.
+// The variants hold every batch's pipeline, looked up before the ranges were handed out.
+void Adren::Instancing::draw(VkCommandBuffer& commandBuffer, const Scene& scene, Pipeline& pipeline, const VkPipeline* variants, VkDescriptorSet& set, uint32_t frame, uint32_t first, uint32_t last, DrawCounters& counters) {
+	VkDeviceSize offset = 0;
+	vkCmdBindVertexBuffers(commandBuffer, 1, 1, &instances[frame].buffer, &offset);
+
+	// The instanced shaders never read the dynamic uniform buffer but the set still needs an offset for it.
+	uint32_t dynamicOffset = 0;
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.layout, 0, 1, &set, 1, &dynamicOffset);
+	counters.sets++;
+
+	VkPipeline bound = VK_NULL_HANDLE;
+	for (uint32_t b = first; b < last; b++) {
+		const Batch& batch = batches[b];
+		const Scene::Draw& draw = scene.draws[batch.draw];
+
+		VkPipeline variant = variants[b];
+		if (variant != bound) {
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, variant);
+			bound = variant;
+			counters.pipelines++;
+		}
+
+		vkCmdDrawIndexed(commandBuffer, draw.indexCount, batch.count, draw.firstIndex, draw.vertexOffset, batch.first);
+		counters.calls++;
+	}
+}
+
+void Adren::Instancing::destroyBuffers() {
+	for (Buffer& buffer : instances) {
+		if (buffer.buffer == VK_NULL_HANDLE) { continue; }
+
+		vmaUnmapMemory(allocator, buffer.memory);
+		Memory::destroyBuffer(allocator, buffer.buffer, buffer.memory);
+		buffer = {};
+	}
+}
+
+void Adren::Instancing::cleanup() {
+	destroyBuffers();
+}
@@ -0,0 +1,62 @@
+/*
+	instancing.h
+	Adrenaline Engine
+
+	Draws that share a mesh and a pipeline state are folded into one instanced call. Every frame the visible draws
+	are bucketed by group and their matrices and textures written into that frame's instance buffer.
+*/
+
+#pragma once
+#include "buffers.h"
+#include "pipeline.h"
+#include "scene.h"
+
+namespace Adren {
+class Instancing {
+public:
+	Instancing(Devices& devices, Buffers& buffers) : devices(devices), buffers(buffers) {}
+
+	void build(const Scene& scene);
+	void prepare(const Scene& scene, uint32_t frame);
+	void draw(VkCommandBuffer& commandBuffer, const Scene& scene, Pipeline& pipeline, const VkPipeline* variants, VkDescriptorSet& set, uint32_t frame, uint32_t first, uint32_t last, DrawCounters& counters);
+	void cleanup();
+
+	// A draw of the group stands in for its mesh range and state, the instances are a range of the frame's buffer.
+	struct Batch {
+		uint32_t draw;
+		uint32_t first;
+		uint32_t count;
+	};
+
+	std::vector<Batch> batches;
+private:
+	struct Key {
+		uint32_t indexCount;
+		uint32_t firstIndex;
+		int32_t vertexOffset;
+		Pipeline::State state;
+
+		bool operator==(const Key& other) const {
+			return indexCount == other.indexCount && firstIndex == other.firstIndex && vertexOffset == other.vertexOffset && state == other.state;
+		}
+	};
+
+	struct Hash {
+		size_t operator()(const Key& key) const;
+	};
+
+	void destroyBuffers();
+
+	Devices& devices;
+	Buffers& buffers;
+	VkDevice& device = devices.device;
+	VmaAllocator& allocator = devices.allocator;
+
+	// The group of every draw, one draw standing in for every group and where each group writes this frame.
+	std::vector<uint32_t> groups;
+	std::vector<uint32_t> leaders;
+	std::vector<uint32_t> cursors;
+
+	Buffer instances[maxFramesInFlight]{};
+};
+}
@@ -0,0 +1,224 @@
+/*
+	kernels.cpp
+	Adrenaline Engine
+
+	Definitions for the matrix kernels. Composition runs 8 transforms at a time with AVX2, 4 at a time with SSE or
+	NEON and one at a time everywhere else. Multiplication works a column at a time in 4 wide registers.
+	The AVX2 path is only compiled in when the engine is built with the ADREN_AVX2 option.
+*/
+
+#include "kernels.h"
+#include "types.h"
+#include <glm/gtx/quaternion.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define ADREN_SSE
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ADREN_SSE
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define ADREN_NEON
+#endif
+
+namespace {
+// The handful of operations composition needs, so its body is written once for every instruction set.
+#if defined(__AVX2__)
+using Wide = __m256;
+const uint32_t width = 8;
+inline Wide load(const float* p) { return _mm256_loadu_ps(p); }
+inline Wide broadcast(float v) { return _mm256_set1_ps(v); }
+inline Wide add(Wide a, Wide b) { return _mm256_add_ps(a, b); }
+inline Wide sub(Wide a, Wide b) { return _mm256_sub_ps(a, b); }
+inline Wide mul(Wide a, Wide b) { return _mm256_mul_ps(a, b); }
+inline void store(float* p, Wide a) { _mm256_storeu_ps(p, a); }
+#elif defined(ADREN_SSE)
+using Wide = __m128;
+const uint32_t width = 4;
+inline Wide load(const float* p) { return _mm_loadu_ps(p); }
+inline Wide broadcast(float v) { return _mm_set1_ps(v); }
+inline Wide add(Wide a, Wide b) { return _mm_add_ps(a, b); }
+inline Wide sub(Wide a, Wide b) { return _mm_sub_ps(a, b); }
+inline Wide mul(Wide a, Wide b) { return _mm_mul_ps(a, b); }
+inline void store(float* p, Wide a) { _mm_storeu_ps(p, a); }
+#elif defined(ADREN_NEON)
+using Wide = float32x4_t;
+const uint32_t width = 4;
+inline Wide load(const float* p) { return vld1q_f32(p); }
+inline Wide broadcast(float v) { return vdupq_n_f32(v); }
+inline Wide add(Wide a, Wide b) { return vaddq_f32(a, b); }
+inline Wide sub(Wide a, Wide b) { return vsubq_f32(a, b); }
+inline Wide mul(Wide a, Wide b) { return vmulq_f32(a, b); }
+inline void store(float* p, Wide a) { vst1q_f32(p, a); }
+#else
+using Wide = float;
+const uint32_t width = 1;
+inline Wide load(const float* p) { return *p; }
+inline Wide broadcast(float v) { return v; }
+inline Wide add(Wide a, Wide b) { return a + b; }
+inline Wide sub(Wide a, Wide b) { return a - b; }
+inline Wide mul(Wide a, Wide b) { return a * b; }
+inline void store(float* p, Wide a) { *p = a; }
+#endif
+}
+
+void Adren::Kernels::TRS::resize(uint32_t size) {
+	count = size;
+	uint32_t padded = (size + 7) & ~7u;
+
+	for (auto* array : { &tx, &ty, &tz, &rx, &ry, &rz }) { array->assign(padded, 0.0f); }
+	for (auto* array : { &rw, &sx, &sy, &sz }) { array->assign(padded, 1.0f); }
+}
+
+void Adren::Kernels::TRS::set(uint32_t index, const glm::vec3& translation, const glm::vec4& rotation, const glm::vec3& scale) {
+	tx[index] = translation.x; ty[index] = translation.y; tz[index] = translation.z;
+	rx[index] = rotation.x; ry[index] = rotation.y; rz[index] = rotation.z; rw[index] = rotation.w;
+	sx[index] = scale.x; sy[index] = scale.y; sz[index] = scale.z;
+}
+
+// The rotation part is the usual quaternion to matrix expansion with each column scaled, which is what
+// glm::translate * glm::toMat4 * glm::scale works out to without the two full matrix products.
+void Adren::Kernels::compose(const TRS& trs, glm::mat4* out) {
+	const Wide one = broadcast(1.0f), two = broadcast(2.0f);
+
+	for (uint32_t i = 0; i < trs.count; i += width) {
+		Wide x = load(&trs.rx[i]), y = load(&trs.ry[i]), z = load(&trs.rz[i]), w = load(&trs.rw[i]);
+		Wide sx = load(&trs.sx[i]), sy = load(&trs.sy[i]), sz = load(&trs.sz[i]);
+
+		Wide xx = mul(x, x), yy = mul(y, y), zz = mul(z, z);
+		Wide xy = mul(x, y), xz = mul(x, z), yz = mul(y, z);
+		Wide wx = mul(w, x), wy = mul(w, y), wz = mul(w, z);
+
+		// Element c * 3 + r is row r of column c, one lane per transform.
+		float elements[12][width];
+		store(elements[0], mul(sub(one, mul(two, add(yy, zz))), sx));
+		store(elements[1], mul(mul(two, add(xy, wz)), sx));
+		store(elements[2], mul(mul(two, sub(xz, wy)), sx));
+		store(elements[3], mul(mul(two, sub(xy, wz)), sy));
+		store(elements[4], mul(sub(one, mul(two, add(xx, zz))), sy));
+		store(elements[5], mul(mul(two, add(yz, wx)), sy));
+		store(elements[6], mul(mul(two, add(xz, wy)), sz));
+		store(elements[7], mul(mul(two, sub(yz, wx)), sz));
+		store(elements[8], mul(sub(one, mul(two, add(xx, yy))), sz));
+		store(elements[9], load(&trs.tx[i]));
+		store(elements[10], load(&trs.ty[i]));
+		store(elements[11], load(&trs.tz[i]));
+
+		uint32_t lanes = std::min(width, trs.count - i);
+		for (uint32_t l = 0; l < lanes; l++) {
+			glm::mat4& m = out[i + l];
+			m[0] = glm::vec4(elements[0][l], elements[1][l], elements[2][l], 0.0f);
+			m[1] = glm::vec4(elements[3][l], elements[4][l], elements[5][l], 0.0f);
+			m[2] = glm::vec4(elements[6][l], elements[7][l], elements[8][l], 0.0f);
+			m[3] = glm::vec4(elements[9][l], elements[10][l], elements[11][l], 1.0f);
+		}
+	}
+}
+
+// Column j of the product is a's columns weighted by the entries of b's column j.
+void Adren::Kernels::multiply(const glm::mat4& a, const glm::mat4& b, glm::mat4& out) {
+#if defined(ADREN_SSE)
+	__m128 a0 = _mm_loadu_ps(&a[0][0]), a1 = _mm_loadu_ps(&a[1][0]), a2 = _mm_loadu_ps(&a[2][0]), a3 = _mm_loadu_ps(&a[3][0]);
+	glm::mat4 result;
+	for (int j = 0; j < 4; j++) {
+		__m128 column = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a0, _mm_set1_ps(b[j][0])), _mm_mul_ps(a1, _mm_set1_ps(b[j][1]))),
+			_mm_add_ps(_mm_mul_ps(a2, _mm_set1_ps(b[j][2])), _mm_mul_ps(a3, _mm_set1_ps(b[j][3]))));
+		_mm_storeu_ps(&result[j][0], column);
+	}
+	out = result;
+#elif defined(ADREN_NEON)
+	float32x4_t a0 = vld1q_f32(&a[0][0]), a1 = vld1q_f32(&a[1][0]), a2 = vld1q_f32(&a[2][0]), a3 = vld1q_f32(&a[3][0]);
+	glm::mat4 result;
+	for (int j = 0; j < 4; j++) {
+		float32x4_t column = vaddq_f32(vaddq_f32(vmulq_n_f32(a0, b[j][0]), vmulq_n_f32(a1, b[j][1])),
+			vaddq_f32(vmulq_n_f32(a2, b[j][2]), vmulq_n_f32(a3, b[j][3])));
+		vst1q_f32(&result[j][0], column);
+	}
+	out = result;
+#else
+	out = a * b;
+#endif
+}
+
+void Adren::Kernels::multiply(const glm::mat4& a, const glm::mat4* b, glm::mat4* out, uint32_t count) {
+	for (uint32_t i = 0; i < count; i++) {
+		multiply(a, b[i], out[i]);
+	}
+}
+
+// Times both kernels against the glm code they replace and fails when either strays further from it than tolerance,
+// relative to the size of the element so the large translations and products get the same slack as the rest.
+bool Adren::Kernels::benchmark(uint32_t count) {
+	const float tolerance = 1e-4f;
+
+	using Clock = std::chrono::steady_clock;
+	auto milliseconds = [](Clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	};
+
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> size(0.1f, 10.0f);
+
+	TRS trs;
+	trs.resize(count);
+	std::vector<glm::quat> rotations(count);
+	for (uint32_t i = 0; i < count; i++) {
+		glm::vec4 q = glm::normalize(glm::vec4(unit(random), unit(random), unit(random), unit(random)));
+		rotations[i] = glm::quat(q.w, q.x, q.y, q.z);
+		trs.set(i, glm::vec3(position(random), position(random), position(random)), q, glm::vec3(size(random), size(random), size(random)));
+	}
+
+	std::vector<glm::mat4> expected(count), composed(count);
+	Clock::time_point start = Clock::now();
+	for (uint32_t i = 0; i < count; i++) {
+		expected[i] = glm::translate(glm::mat4(1.0f), glm::vec3(trs.tx[i], trs.ty[i], trs.tz[i])) * glm::toMat4(rotations[i])
+			* glm::scale(glm::mat4(1.0f), glm::vec3(trs.sx[i], trs.sy[i], trs.sz[i]));
+	}
+	double glmCompose = milliseconds(start);
+
+	start = Clock::now();
+	compose(trs, composed.data());
+	double kernelCompose = milliseconds(start);
+
+	auto difference = [count](const std::vector<glm::mat4>& a, const std::vector<glm::mat4>& b) {
+		float largest = 0.0f;
+		for (uint32_t i = 0; i < count; i++) {
+			for (int c = 0; c < 4; c++) {
+				for (int r = 0; r < 4; r++) {
+					largest = std::max(largest, std::abs(a[i][c][r] - b[i][c][r]) / std::max(1.0f, std::abs(a[i][c][r])));
+				}
+			}
+		}
+		return largest;
+	};
+
+	float composeError = difference(expected, composed);
+
+	glm::mat4 parent = expected[0];
+	std::vector<glm::mat4> products(count), multiplied(count);
+	start = Clock::now();
+	for (uint32_t i = 0; i < count; i++) { products[i] = parent * expected[i]; }
+	double glmMultiply = milliseconds(start);
+
+	start = Clock::now();
+	multiply(parent, expected.data(), multiplied.data(), count);
+	double kernelMultiply = milliseconds(start);
+
+	float multiplyError = difference(products, multiplied);
+
+	bool passed = composeError <= tolerance && multiplyError <= tolerance;
+	std::cout << "Matrix kernels over " << count << " transforms, " << width << " wide\n"
+		<< "    compose glm " << glmCompose << " ms, kernel " << kernelCompose << " ms, largest difference " << composeError << "\n"
+		<< "    multiply glm " << glmMultiply << " ms, kernel " << kernelMultiply << " ms, largest difference " << multiplyError << "\n"
+		<< "    " << (passed ? "within" : "MISMATCH, over") << " the tolerance of " << tolerance << std::endl;
+
+	return passed;
+}
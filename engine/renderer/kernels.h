@@ -0,0 +1,33 @@
+/*
+	kernels.h
+	Adrenaline Engine
+
+	Batched matrix math for the transform system. Translation, rotation and scale are kept as separate arrays so
+	several transforms are composed at once in one SIMD register per component.
+*/
+
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace Adren::Kernels {
+// Every array is padded to a multiple of 8 with identity transforms so the wide loops never read past the end.
+struct TRS {
+	std::vector<float> tx, ty, tz;
+	std::vector<float> rx, ry, rz, rw;
+	std::vector<float> sx, sy, sz;
+	uint32_t count = 0;
+
+	void resize(uint32_t size);
+	void set(uint32_t index, const glm::vec3& translation, const glm::vec4& rotation, const glm::vec3& scale);
+};
+
+// Writes translate * rotate * scale for every transform in trs, the rotation being a unit quaternion as x, y, z, w.
+void compose(const TRS& trs, glm::mat4* out);
+
+void multiply(const glm::mat4& a, const glm::mat4& b, glm::mat4& out);
+void multiply(const glm::mat4& a, const glm::mat4* b, glm::mat4* out, uint32_t count);
+
+// Returns false when a kernel's results differ from the glm ones by more than the tolerance.
+bool benchmark(uint32_t count);
+}
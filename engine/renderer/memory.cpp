@@ -0,0 +1,184 @@
+/*
+	memory.cpp
+	Adrenaline Engine
+
+	Definitions for the GPU memory statistics.
+*/
+
+#include "memory.h"
+#include "tools.h"
+#include "core/allocations.h"
+#include "tinygltf/json.hpp"
+#include <atomic>
+#include <fstream>
+
+using json = nlohmann::json;
+
+namespace {
+constexpr size_t categoryCount = static_cast<size_t>(MemoryCategory::Count);
+
+// Allocations are made and destroyed on both threads, the totals are only ever added to and read.
+std::atomic<uint64_t> categoryBytes[categoryCount]{};
+std::atomic<uint32_t> categoryCounts[categoryCount]{};
+
+const char* names[categoryCount] = { "Geometry", "Textures", "Uniforms", "Render targets", "Staging", "Other" };
+
+// The category goes in the user data one up from its value, so an allocation that was never tagged reads as null.
+void* encode(MemoryCategory category) {
+	return reinterpret_cast<void*>(static_cast<uintptr_t>(category) + 1);
+}
+
+void release(VmaAllocator allocator, VmaAllocation allocation) {
+	if (allocation == VK_NULL_HANDLE) { return; }
+
+	VmaAllocationInfo info;
+	vmaGetAllocationInfo(allocator, allocation, &info);
+	uintptr_t tag = reinterpret_cast<uintptr_t>(info.pUserData);
+	if (tag == 0 || tag > categoryCount) { return; }
+
+	categoryBytes[tag - 1] -= info.size;
+	categoryCounts[tag - 1]--;
+}
+
+// The budgets are tracked by the allocator as it goes, only the largest free range needs the full statistics.
+// Both fill vectors that already have the right size in place, so a frame's update never allocates.
+void heaps(VmaAllocator allocator, const std::vector<uint64_t>& largestFree, std::vector<HeapStats>& result) {
+	const VkPhysicalDeviceMemoryProperties* properties;
+	vmaGetMemoryProperties(allocator, &properties);
+	VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+	vmaGetHeapBudgets(allocator, budgets);
+
+	result.resize(properties->memoryHeapCount);
+	for (uint32_t i = 0; i < properties->memoryHeapCount; i++) {
+		HeapStats& heap = result[i];
+		heap.deviceLocal = (properties->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+		heap.size = properties->memoryHeaps[i].size;
+		heap.usage = budgets[i].usage;
+		heap.budget = budgets[i].budget;
+		heap.blocks = budgets[i].statistics.blockBytes;
+		heap.allocated = budgets[i].statistics.allocationBytes;
+		heap.allocations = budgets[i].statistics.allocationCount;
+		heap.largestFree = i < largestFree.size() ? largestFree[i] : 0;
+	}
+}
+
+void largestFreeRanges(VmaAllocator allocator, std::vector<uint64_t>& result) {
+	const VkPhysicalDeviceMemoryProperties* properties;
+	vmaGetMemoryProperties(allocator, &properties);
+	VmaTotalStatistics total;
+	vmaCalculateStatistics(allocator, &total);
+
+	result.resize(properties->memoryHeapCount);
+	for (uint32_t i = 0; i < properties->memoryHeapCount; i++) { result[i] = total.memoryHeap[i].unusedRangeSizeMax; }
+}
+
+void* VKAPI_PTR allocateHost(void*, size_t size, size_t alignment, VkSystemAllocationScope) {
+	return Adren::Allocations::allocate(size, alignment, Adren::Allocations::Subsystem::Vulkan);
+}
+
+void* VKAPI_PTR reallocateHost(void*, void* original, size_t size, size_t alignment, VkSystemAllocationScope) {
+	return Adren::Allocations::reallocate(original, size, alignment, Adren::Allocations::Subsystem::Vulkan);
+}
+
+void VKAPI_PTR freeHost(void*, void* memory) {
+	Adren::Allocations::release(memory);
+}
+
+const VkAllocationCallbacks hostCallbacks = { nullptr, allocateHost, reallocateHost, freeHost, nullptr, nullptr };
+
+double megabytes(uint64_t bytes) {
+	return bytes / (1024.0 * 1024.0);
+}
+}
+
+void Adren::Memory::track(VmaAllocator allocator, VmaAllocation allocation, MemoryCategory category) {
+	if (allocation == VK_NULL_HANDLE) { return; }
+
+	VmaAllocationInfo info;
+	vmaGetAllocationInfo(allocator, allocation, &info);
+	vmaSetAllocationUserData(allocator, allocation, encode(category));
+	vmaSetAllocationName(allocator, allocation, name(category));
+
+	categoryBytes[static_cast<size_t>(category)] += info.size;
+	categoryCounts[static_cast<size_t>(category)]++;
+}
+
+void Adren::Memory::destroyBuffer(VmaAllocator allocator, VkBuffer buffer, VmaAllocation allocation) {
+	release(allocator, allocation);
+	vmaDestroyBuffer(allocator, buffer, allocation);
+}
+
+void Adren::Memory::destroyImage(VmaAllocator allocator, VkImage image, VmaAllocation allocation) {
+	release(allocator, allocation);
+	vmaDestroyImage(allocator, image, allocation);
+}
+
+const char* Adren::Memory::name(MemoryCategory category) {
+	return category < MemoryCategory::Count ? names[static_cast<size_t>(category)] : "Unknown";
+}
+
+const VkAllocationCallbacks* Adren::Memory::callbacks() {
+	return Allocations::tracking() ? &hostCallbacks : nullptr;
+}
+
+// A heap that crossed the warning warns again only after it drops well back under it, not on every frame it wobbles.
+void Adren::Memory::update(MemoryStats& stats) {
+	VmaAllocator allocator = devices.allocator;
+	if (frame++ % detailEvery == 0) { largestFreeRanges(allocator, largestFree); }
+
+	heaps(allocator, largestFree, stats.heaps);
+	warned.resize(stats.heaps.size(), false);
+	stats.nearBudget = false;
+
+	for (size_t i = 0; i < stats.heaps.size(); i++) {
+		const HeapStats& heap = stats.heaps[i];
+		if (heap.budget == 0) { continue; }
+
+		double used = static_cast<double>(heap.usage) / heap.budget;
+		stats.nearBudget |= used >= warning;
+		if (used >= warning && !warned[i]) {
+			Tools::log("Heap " + std::to_string(i) + " is using " + std::to_string(megabytes(heap.usage)) + " MB of its "
+				+ std::to_string(megabytes(heap.budget)) + " MB budget..");
+			warned[i] = true;
+		} else if (used < warning - 0.1) {
+			warned[i] = false;
+		}
+	}
+
+	for (size_t i = 0; i < categoryCount; i++) {
+		stats.bytes[i] = categoryBytes[i].load(std::memory_order_relaxed);
+		stats.counts[i] = categoryCounts[i].load(std::memory_order_relaxed);
+	}
+}
+
+bool Adren::Memory::save(const std::string& path) const {
+	VmaAllocator allocator = devices.allocator;
+	std::vector<uint64_t> free;
+	std::vector<HeapStats> current;
+	largestFreeRanges(allocator, free);
+	heaps(allocator, free, current);
+
+	json report = { { "heaps", json::array() }, { "categories", json::object() } };
+	for (const HeapStats& heap : current) {
+		report["heaps"].push_back({ { "deviceLocal", heap.deviceLocal }, { "size", heap.size }, { "usage", heap.usage },
+			{ "budget", heap.budget }, { "blocks", heap.blocks }, { "allocated", heap.allocated },
+			{ "allocations", heap.allocations }, { "largestFree", heap.largestFree } });
+	}
+
+	for (size_t i = 0; i < categoryCount; i++) {
+		report["categories"][names[i]] = { { "bytes", categoryBytes[i].load() }, { "allocations", categoryCounts[i].load() } };
+	}
+
+	// VMA's own map lists every block and allocation, the names set when they were tagged included.
+	char* detail = nullptr;
+	vmaBuildStatsString(allocator, &detail, VK_TRUE);
+	report["allocator"] = json::parse(detail, nullptr, false);
+	vmaFreeStatsString(allocator, detail);
+
+	std::ofstream file(path);
+	if (!file) { return false; }
+
+	file << report.dump(2) << std::endl;
+	Tools::log("Wrote the GPU memory report to " + path + "..");
+	return static_cast<bool>(file);
+}
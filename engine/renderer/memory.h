@@ -0,0 +1,45 @@
+/*
+	memory.h
+	Adrenaline Engine
+
+	Where the GPU memory goes. Every allocation is tagged with what it holds when it is made and untagged when it
+	is destroyed, so the bytes in each category are always known without walking VMA. Once a frame the heap
+	budgets are read back, which is cheap, the full statistics only every so often since those walk every block.
+*/
+
+#pragma once
+#include "devices.h"
+#include "types.h"
+#include <string>
+#include <vector>
+
+namespace Adren {
+class Memory {
+public:
+	Memory(Devices& devices) : devices(devices) {}
+
+	// Every buffer and image the renderer allocates goes through these, anything left untagged shows up nowhere.
+	static void track(VmaAllocator allocator, VmaAllocation allocation, MemoryCategory category);
+	static void destroyBuffer(VmaAllocator allocator, VkBuffer buffer, VmaAllocation allocation);
+	static void destroyImage(VmaAllocator allocator, VkImage image, VmaAllocation allocation);
+	static const char* name(MemoryCategory category);
+
+	// Charges VMA's own bookkeeping on the CPU to the Vulkan subsystem, null when the build doesn't track memory.
+	static const VkAllocationCallbacks* callbacks();
+
+	// Fills the heaps and categories and warns once when a heap crosses the warning fraction of its budget.
+	void update(MemoryStats& stats);
+
+	// Heaps, categories and VMA's own detailed map with every allocation by name. Safe from any thread.
+	bool save(const std::string& path) const;
+
+	static constexpr float warning = 0.9f;
+private:
+	static constexpr uint32_t detailEvery = 60;
+
+	Devices& devices;
+	uint32_t frame = 0;
+	std::vector<uint64_t> largestFree;
+	std::vector<bool> warned;
+};
+}
@@ -12,16 +12,25 @@
 
 #include "model.h"
 #include "tools.h"
+#include "core/profiler.h"
+#include "core/allocations.h"
 #include <glm/gtc/type_ptr.hpp>
-#include <glm/gtx/quaternion.hpp>
 
-Model::Model(std::string modelPath) {
+Model::Model(std::string modelPath) : path(modelPath) {
+    ADREN_PROFILE_SCOPE("Model::load");
+    Adren::Allocations::Scope assets(Adren::Allocations::Subsystem::Assets);
     tinygltf::TinyGLTF tinyGLTF;
+    tinygltf::Model gltf;
     std::string error;
     std::string warning;
     std::unordered_map<Vertex, uint32_t> uniqueVertices{};
 
-    bool file = tinyGLTF.LoadASCIIFromFile(&gltf, &error, &warning, modelPath);
+    bool file = false;
+    {
+        ADREN_PROFILE_SCOPE("Model::parse");
+        Adren::Allocations::Scope document(Adren::Allocations::Subsystem::Documents);
+        file = tinyGLTF.LoadASCIIFromFile(&gltf, &error, &warning, modelPath);
+    }
 
     if (!file) { Adren::Tools::log("Unable to load glTF file."); }
 
@@ -33,11 +42,16 @@ Model::Model(std::string modelPath) {
         fillImages(gltf);
         fillMaterials(gltf);
         fillTextures(gltf);
-        tinygltf::Scene scene = gltf.scenes[0];
+        const tinygltf::Scene& scene = gltf.scenes[0];
         for (size_t i = 0; i < scene.nodes.size(); i++) {
-            const tinygltf::Node node = gltf.nodes[scene.nodes[i]];
-            fillNode(node, gltf, nullptr, glm::mat4(1.0f));
+            const tinygltf::Node& node = gltf.nodes[scene.nodes[i]];
+            fillNode(node, gltf, nullptr);
         }
+
+        // The scene still needs the lights and cameras, the rest of the document goes when it goes out of scope.
+        lights = std::move(gltf.lights);
+        cameras = std::move(gltf.cameras);
+        vertexCount = static_cast<uint32_t>(vertices.size());
     }
 };
 
@@ -52,28 +66,18 @@ void Model::fillImages(tinygltf::Model& model) {
     images.resize(model.images.size());
     for (size_t i = 0; i < model.images.size(); i++) {
         tinygltf::Image& image = model.images[i];
-        unsigned char* imageBuffer = nullptr;
-        VkDeviceSize imageBufferSize = 0;
         if (image.component == 3) {
-            imageBufferSize = image.width * image.height * 4;
-            imageBuffer = new unsigned char[imageBufferSize];
-            unsigned char* rgba = imageBuffer;
-            unsigned char* rgb = &image.image[0];
-            for (size_t i = 0; i < (float)image.width * image.height; ++i) {
-                memcpy(rgba, rgb, sizeof(unsigned char) * 3);
-                rgba += 4;
-                rgb += 3;
+            size_t pixels = static_cast<size_t>(image.width) * image.height;
+            std::vector<unsigned char> rgba(pixels * 4, 255);
+            for (size_t p = 0; p < pixels; p++) {
+                memcpy(&rgba[p * 4], &image.image[p * 3], 3);
             }
-        }
-        else {
-            imageBuffer = &image.image[0];
-            imageBufferSize = image.image.size();
+            image.image = std::move(rgba);
         }
 
         images[i].height = image.height;
         images[i].width = image.width;
-        images[i].buffer = imageBuffer;
-        images[i].bufferSize = imageBufferSize;
+        images[i].pixels = std::move(image.image);
     }
 }
 
@@ -89,6 +93,16 @@ void Model::fillMaterials(tinygltf::Model& model) {
         if (mat.values.find("baseColorTexture") != mat.values.end()) {
             materials[m].baseColorTextureIndex = mat.values["baseColorTexture"].TextureIndex();
         }
+
+        if (mat.alphaMode == "MASK") {
+            materials[m].alphaMode = AlphaMode::Mask;
+        } else if (mat.alphaMode == "BLEND") {
+            materials[m].alphaMode = AlphaMode::Blend;
+        }
+
+        materials[m].alphaCutoff = static_cast<float>(mat.alphaCutoff);
+        materials[m].doubleSided = mat.doubleSided;
+        materials[m].unlit = mat.extensions.find("KHR_materials_unlit") != mat.extensions.end();
     }
 }
 
@@ -122,65 +136,59 @@ void Model::findComponent(const tinygltf::Accessor& accessor, const tinygltf::Bu
     }
 }
 
-glm::mat4 Model::matrix() {
-    glm::mat4 matrix(1.0f);
-    
-    for (Node& node : nodes) {
-        matrix = node.matrix;
-        Node* parent = node.parent;
-        
-        while (parent) {
-            matrix = parent->matrix * matrix;
-            parent = parent->parent;
-        }
+void Model::fillTransform(const tinygltf::Node& iNode, Node& node) {
+    if (iNode.matrix.size() == 16) {
+        node.matrix = glm::mat4x4(glm::make_mat4x4(iNode.matrix.data()));
+        node.composed = true;
+        return;
     }
 
-    return matrix;
-}
-
-glm::mat4 Model::getMatrix(const tinygltf::Node& node, glm::mat4x4& base) {
-    if (node.matrix.size() == 16) {
-        return base * glm::mat4x4(glm::make_mat4x4(node.matrix.data()));
+    if (iNode.translation.size() == 3) {
+        node.translation = glm::make_vec3(iNode.translation.data());
     }
-    else {
-        auto translation = glm::vec3(0.0f);
-        auto rotation = glm::quat();
-        auto size = glm::vec3(1.0f);
 
-        if (node.translation.size() == 3) {
-            translation = glm::make_vec3(node.translation.data());
-        }
-
-        if (node.rotation.size() == 4) {
-            rotation = glm::make_quat(node.rotation.data());
-        }
-
-        if (node.scale.size() == 3) {
-            size = glm::make_vec3(node.scale.data());
-        } 
+    // glTF stores rotations as x, y, z, w which is the order the kernels take them in.
+    if (iNode.rotation.size() == 4) {
+        node.rotation = glm::vec4(glm::make_vec4(iNode.rotation.data()));
+    }
 
-        return base * glm::translate(glm::mat4(1.0f), translation) * glm::toMat4(rotation) * glm::scale(glm::mat4(1.0f), size);
+    if (iNode.scale.size() == 3) {
+        node.scale = glm::make_vec3(iNode.scale.data());
     }
 }
-void Model::fillNode(const tinygltf::Node& iNode, const tinygltf::Model& model, Node* parent, glm::mat4& matrix) {
+void Model::fillNode(const tinygltf::Node& iNode, const tinygltf::Model& model, Node* parent) {
     Node node{};
-    node.matrix = getMatrix(iNode, matrix);
+    fillTransform(iNode, node);
+
+    // Nodes can be marked as occluders for the software rasterizer with {"occluder": true} in their extras.
+    node.occluder = iNode.extras.IsObject() && iNode.extras.Has("occluder") && iNode.extras.Get("occluder").IsBool() && iNode.extras.Get("occluder").Get<bool>();
+    node.camera = iNode.camera;
+
+    auto lights = iNode.extensions.find("KHR_lights_punctual");
+    if (lights != iNode.extensions.end() && lights->second.Has("light") && lights->second.Get("light").IsInt()) {
+        node.light = lights->second.Get("light").Get<int>();
+    }
 
     if (iNode.children.size() > 0) {
         for (size_t i = 0; i < iNode.children.size(); i++) {
-            fillNode(model.nodes[iNode.children[i]], model, &node, matrix);
+            fillNode(model.nodes[iNode.children[i]], model, &node);
         }
     }
 
     if (iNode.mesh > -1) {
         std::vector<Primitive> primitives;
-        const tinygltf::Mesh mesh = model.meshes[iNode.mesh];
+        const tinygltf::Mesh& mesh = model.meshes[iNode.mesh];
         for (size_t p = 0; p < mesh.primitives.size(); p++) {
             const tinygltf::Primitive& prim = mesh.primitives[p];
             const float* modelVert = nullptr;
             const float* modelTex = nullptr;
             uint32_t vertexCount = 0;
             uint32_t indexCount = 0;
+            uint32_t firstVertex = static_cast<uint32_t>(vertices.size());
+            uint32_t firstIndex = static_cast<uint32_t>(indices.size());
+            glm::vec3 min = glm::vec3(0.0f);
+            glm::vec3 max = glm::vec3(0.0f);
+            bool bounded = false;
 
             if (prim.attributes.find("POSITION") != prim.attributes.end()) {
                 const tinygltf::Accessor& vAccessor = getAccessor(model, prim, "POSITION");
@@ -188,6 +196,13 @@ void Model::fillNode(const tinygltf::Node& iNode, const tinygltf::Model& model,
                 const tinygltf::Buffer& vBuffer = model.buffers[vBufferView.buffer];
                 modelVert = reinterpret_cast<const float*>(&vBuffer.data[vBufferView.byteOffset + vAccessor.byteOffset]);
                 vertexCount = vAccessor.count;
+
+                // glTF requires min and max on POSITION accessors but not every exporter writes them.
+                if (vAccessor.minValues.size() == 3 && vAccessor.maxValues.size() == 3) {
+                    min = glm::vec3(vAccessor.minValues[0], vAccessor.minValues[1], vAccessor.minValues[2]);
+                    max = glm::vec3(vAccessor.maxValues[0], vAccessor.maxValues[1], vAccessor.maxValues[2]);
+                    bounded = true;
+                }
             }
 
             if (prim.attributes.find("TEXCOORD_0") != prim.attributes.end()) {
@@ -203,9 +218,13 @@ void Model::fillNode(const tinygltf::Node& iNode, const tinygltf::Model& model,
                 vertex.texCoord = modelTex ? glm::make_vec2(&modelTex[v * 2]) : glm::vec3(0.0f);
                 vertex.color = glm::vec3(1.0f);
                 vertices.push_back(vertex);
+
+                if (!bounded) {
+                    min = v == 0 ? vertex.pos : glm::min(min, vertex.pos);
+                    max = v == 0 ? vertex.pos : glm::max(max, vertex.pos);
+                }
             }
 
-            uint32_t firstVertex = static_cast<uint32_t>(vertices.size());
             const tinygltf::Accessor& iAccessor = model.accessors[prim.indices];
             const tinygltf::BufferView& iBufferView = model.bufferViews[iAccessor.bufferView];
             const tinygltf::Buffer& iBuffer = model.buffers[iBufferView.buffer];
@@ -218,8 +237,10 @@ void Model::fillNode(const tinygltf::Node& iNode, const tinygltf::Model& model,
             primitive.firstVertex = firstVertex;
             primitive.vertexCount = vertexCount;
             primitive.indexCount = indexCount;
-            primitive.firstIndex = static_cast<uint32_t>(indices.size());
+            primitive.firstIndex = firstIndex;
             primitive.materialIndex = prim.material;
+            primitive.min = min;
+            primitive.max = max;
             node.mesh.primitives.push_back(primitive);
         }
     }
@@ -231,39 +252,30 @@ void Model::fillNode(const tinygltf::Node& iNode, const tinygltf::Model& model,
     }
 }
 
-void Model::count(uint32_t& num, const std::vector<Node>& nodes) {
-    for (const auto& node : nodes) {
-        count(num, node.children);
-        num++;
+void Model::release() {
+    positions.resize(vertices.size());
+    for (size_t v = 0; v < vertices.size(); v++) {
+        positions[v] = vertices[v].pos;
     }
-}
 
-void Model::count(std::vector<glm::mat4>& matrices, const std::vector<Node>& nodes) {
-    for (const auto& node : nodes) {
-        matrices.push_back(node.matrix);
-        count(matrices, node.children);
-    }
+    std::vector<Vertex>().swap(vertices);
+    std::vector<glTFImage>().swap(images);
+    indices.shrink_to_fit();
+    resident = true;
 }
 
-void Model::drawNode(VkCommandBuffer& commandBuffer, VkPipelineLayout& pipelineLayout, Node& iNode, VkDescriptorSet& set, Offset& offset) {
-    if (iNode.mesh.primitives.size() > 0) {
-        for (Primitive& prim : iNode.mesh.primitives) {
-            if (prim.indexCount > 0) {
-                Texture texture = textures[materials[prim.materialIndex].baseColorTextureIndex];
-                const auto index = texture.index + offset.texture;
-                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &set, 1, &offset.dynamic);
-                vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(index), &index);
-                vkCmdDrawIndexed(commandBuffer, prim.indexCount, 1, offset.index, offset.vertex, 0);
-                offset.index += prim.indexCount;
-                offset.vertex += prim.vertexCount;
-            }
-        }
+size_t Model::footprint() const {
+    size_t bytes = vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(uint32_t) + positions.capacity() * sizeof(glm::vec3);
+    for (const glTFImage& image : images) {
+        bytes += image.pixels.capacity();
     }
 
-    if (iNode.children.size() > 0) {
-        for (size_t i = 0; i < iNode.children.size(); i++) {
-            offset.dynamic += static_cast<uint32_t>(offset.align);
-            drawNode(commandBuffer, pipelineLayout, iNode.children[i], set, offset);
-        }
+    return bytes;
+}
+
+void Model::count(uint32_t& num, const std::vector<Node>& nodes) {
+    for (const auto& node : nodes) {
+        count(num, node.children);
+        num++;
     }
 }
\ No newline at end of file
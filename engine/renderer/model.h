@@ -14,20 +14,28 @@ public:
         uint32_t indexCount;
         uint32_t vertexCount;
         int32_t materialIndex;
+        glm::vec3 min;
+        glm::vec3 max;
     };
 
+    enum class AlphaMode { Opaque, Mask, Blend };
+
     struct Material {
         glm::vec4 baseColorFactor = glm::vec4(1.0f);
         uint32_t baseColorTextureIndex = 0;
+        AlphaMode alphaMode = AlphaMode::Opaque;
+        float alphaCutoff = 0.5f;
+        bool doubleSided = false;
+        bool unlit = false;
     };
 
     struct Texture : ::Image {
         int32_t index;
     };
 
+    // Always RGBA, the pixels are moved out of the document rather than copied.
     struct glTFImage {
-        unsigned char* buffer = nullptr;
-        VkDeviceSize bufferSize = 0;
+        std::vector<unsigned char> pixels;
 
         int height = 0;
         int width = 0;
@@ -37,40 +45,57 @@ public:
         std::vector<Primitive> primitives;
     };
 
+    // The transform is relative to the parent node, Adren::Transforms turns it into a world matrix. Files give
+    // either a whole matrix or translation, rotation and scale, which Transforms composes in batches.
     struct Node {
-        Node* parent;
         std::vector<Node> children;
         Mesh mesh;
-        glm::mat4 matrix;
+        glm::mat4 matrix = glm::mat4(1.0f);
+        bool composed = false;
+        glm::vec3 translation = glm::vec3(0.0f);
+        glm::vec4 rotation = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        glm::vec3 scale = glm::vec3(1.0f);
+        bool occluder = false;
+        int32_t light = -1;
+        int32_t camera = -1;
     };
 
     struct Matrix {
         glm::mat4 model[4];
     };
 
-    tinygltf::Model gltf;
+    std::string path;
+    std::vector<tinygltf::Light> lights;
+    std::vector<tinygltf::Camera> cameras;
     std::vector<Texture> textures;
-    glm::vec3 position = glm::vec3(0.0f);
-    float rotationAngle = 0.0f;
-    float scale = 0.0f;
-    glm::vec3 rotationAxis = ADREN_Y_AXIS;
     std::vector<Node> nodes;
     std::vector<Material> materials;
     std::vector<glTFImage> images;
     std::vector<Vertex> vertices;
     std::vector<uint32_t> indices;
-    glm::mat4 matrix();
+    uint32_t vertexCount = 0;
+
+    // What the software occlusion rasterizer reads its occluders from once the vertices are released.
+    std::vector<glm::vec3> positions;
+
+    // Set by release, the renderer uploads a model's textures and geometry exactly once.
+    bool resident = false;
+
+    // The glTF document is dropped as soon as the model is converted out of it. Once the textures and geometry are
+    // on the GPU this drops the pixels and vertices too, keeping only positions and indices for occlusion.
+    void release();
+
+    // Bytes held in geometry and pixels, the node tree and materials are small enough to leave out.
+    size_t footprint() const;
     void count(uint32_t& num, const std::vector<Node>& nodes);
-    void count(std::vector<glm::mat4>& matrices, const std::vector<Node>& nodes);
-    void drawNode(VkCommandBuffer& commandBuffer, VkPipelineLayout& pipelineLayout, Node& node, VkDescriptorSet& set, Offset& offset);
 private:
     void fillTextures(tinygltf::Model& model);
     void fillMaterials(tinygltf::Model& model);
     void fillImages(tinygltf::Model& model);
-    void fillNode(const tinygltf::Node& iNode, const tinygltf::Model& model, Node* parent, glm::mat4& matrix);
+    void fillNode(const tinygltf::Node& iNode, const tinygltf::Model& model, Node* parent);
     void findComponent(const tinygltf::Accessor& accessor, const tinygltf::Buffer& buffer, 
         const tinygltf::BufferView& view);
     tinygltf::Accessor Model::getAccessor(const tinygltf::Model& model, const tinygltf::Primitive& prim, std::string attribute);
 
-    glm::mat4 getMatrix(const tinygltf::Node& node, glm::mat4x4& base);
+    void fillTransform(const tinygltf::Node& iNode, Node& node);
 };
@@ -0,0 +1,307 @@
+/*
+	occlusion.cpp
+	Adrenaline Engine
+
+	Definitions for the software occlusion rasterizer. Pixels are filled and tested 4 at a time with SSE,
+	one at a time everywhere else.
+*/
+
+#include "occlusion.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ADREN_SSE
+#include <emmintrin.h>
+#endif
+
+// Occluders are the nodes marked as such in the glTF extras, or the biggest opaque primitives if nothing is marked.
+// Their triangles are copied out once so the per frame work is only the projection.
+void Adren::Occlusion::build(std::vector<Model>& models, Scene& scene) {
+	vertices.clear();
+	occluders.clear();
+
+	std::vector<uint32_t> chosen;
+	for (uint32_t i = 0; i < scene.sources.size(); i++) {
+		if (scene.sources[i].occluder) { chosen.push_back(i); }
+	}
+
+	if (chosen.empty()) {
+		for (uint32_t i = 0; i < scene.draws.size(); i++) {
+			const Scene::Draw& draw = scene.draws[i];
+			if (draw.state.blend || draw.state.alphaMask || draw.indexCount / 3 > maxOccluderTriangles) { continue; }
+			chosen.push_back(i);
+		}
+
+		auto area = [&scene](uint32_t i) {
+			const Culling::Bounds& b = scene.bounds;
+			return b.extentX[i] * b.extentY[i] + b.extentY[i] * b.extentZ[i] + b.extentZ[i] * b.extentX[i];
+		};
+
+		std::stable_sort(chosen.begin(), chosen.end(), [&area](uint32_t a, uint32_t b) { return area(a) > area(b); });
+		if (chosen.size() > maxOccluders) { chosen.resize(maxOccluders); }
+	}
+
+	for (uint32_t i : chosen) {
+		const Scene::Source& source = scene.sources[i];
+		const Model& model = models[source.model];
+		occluders.push_back({ i, static_cast<uint32_t>(vertices.size()), scene.draws[i].indexCount });
+
+		for (uint32_t t = 0; t < scene.draws[i].indexCount; t++) {
+			vertices.push_back(model.positions[source.firstVertex + model.indices[source.firstIndex + t]]);
+		}
+	}
+
+	Tools::log("Software occlusion using " + std::to_string(occluders.size()) + " occluders with " + std::to_string(vertices.size() / 3) + " triangles..");
+}
+
+// Projects every occluder triangle and sets up its edge functions in pixel space.
+void Adren::Occlusion::setup(const glm::mat4& viewProj, const Scene& scene) {
+	triangles.clear();
+
+	for (const Occluder& occluder : occluders) {
+		glm::mat4 matrix = viewProj * scene.sources[occluder.source].matrix;
+
+		for (uint32_t v = occluder.first; v + 2 < occluder.first + occluder.count; v += 3) {
+			glm::vec3 screen[3];
+			bool behind = false;
+
+			for (int i = 0; i < 3; i++) {
+				glm::vec4 clip = matrix * glm::vec4(vertices[v + i], 1.0f);
+
+				// Triangles crossing the camera plane are dropped, which can only ever make culling less aggressive.
+				if (clip.w <= 1.0e-4f) { behind = true; break; }
+
+				screen[i] = glm::vec3((clip.x / clip.w * 0.5f + 0.5f) * width, (clip.y / clip.w * 0.5f + 0.5f) * height, clip.z / clip.w);
+			}
+
+			if (behind) { continue; }
+
+			Triangle triangle{};
+			triangle.minX = std::max(0, static_cast<int32_t>(std::floor(std::min({ screen[0].x, screen[1].x, screen[2].x }))));
+			triangle.maxX = std::min(static_cast<int32_t>(width) - 1, static_cast<int32_t>(std::ceil(std::max({ screen[0].x, screen[1].x, screen[2].x }))));
+			triangle.minY = std::max(0, static_cast<int32_t>(std::floor(std::min({ screen[0].y, screen[1].y, screen[2].y }))));
+			triangle.maxY = std::min(static_cast<int32_t>(height) - 1, static_cast<int32_t>(std::ceil(std::max({ screen[0].y, screen[1].y, screen[2].y }))));
+			if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) { continue; }
+
+			// Edge i runs from vertex i to the next one, and is zero on both of them.
+			for (int i = 0; i < 3; i++) {
+				const glm::vec3& a = screen[i];
+				const glm::vec3& b = screen[(i + 1) % 3];
+				triangle.edges[i][0] = a.y - b.y;
+				triangle.edges[i][1] = b.x - a.x;
+				triangle.edges[i][2] = a.x * b.y - a.y * b.x;
+			}
+
+			float area = triangle.edges[0][0] * screen[2].x + triangle.edges[0][1] * screen[2].y + triangle.edges[0][2];
+			if (std::abs(area) < 1.0e-8f) { continue; }
+
+			// Occluders are drawn from both sides, flipping the edges makes the inside positive either way.
+			if (area < 0.0f) {
+				for (auto& edge : triangle.edges) { for (float& c : edge) { c = -c; } }
+				area = -area;
+			}
+
+			// Each vertex's weight is the edge opposite to it over the area, so depth is a plane in pixel space.
+			for (int c = 0; c < 3; c++) {
+				triangle.plane[c] = (screen[0].z * triangle.edges[1][c] + screen[1].z * triangle.edges[2][c] + screen[2].z * triangle.edges[0][c]) / area;
+			}
+
+			triangles.push_back(triangle);
+		}
+	}
+}
+
+void Adren::Occlusion::rasterize(uint32_t band) {
+	int32_t top = static_cast<int32_t>(band * bandHeight);
+	int32_t bottom = top + static_cast<int32_t>(bandHeight) - 1;
+	std::fill(depth.begin() + top * width, depth.begin() + (bottom + 1) * width, 1.0f);
+
+	for (const Triangle& t : triangles) {
+		if (t.maxY < top || t.minY > bottom) { continue; }
+
+		int32_t startX = t.minX & ~3;
+		for (int32_t y = std::max(t.minY, top); y <= std::min(t.maxY, bottom); y++) {
+			float py = y + 0.5f;
+			float* row = &depth[y * width];
+
+#if defined(ADREN_SSE)
+			__m128 e0 = _mm_set1_ps(t.edges[0][1] * py + t.edges[0][2]);
+			__m128 e1 = _mm_set1_ps(t.edges[1][1] * py + t.edges[1][2]);
+			__m128 e2 = _mm_set1_ps(t.edges[2][1] * py + t.edges[2][2]);
+			__m128 z = _mm_set1_ps(t.plane[1] * py + t.plane[2]);
+			__m128 a0 = _mm_set1_ps(t.edges[0][0]), a1 = _mm_set1_ps(t.edges[1][0]), a2 = _mm_set1_ps(t.edges[2][0]);
+			__m128 za = _mm_set1_ps(t.plane[0]);
+			__m128 zero = _mm_setzero_ps();
+
+			for (int32_t x = startX; x <= t.maxX; x += 4) {
+				__m128 px = _mm_add_ps(_mm_set1_ps(x + 0.5f), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+
+				__m128 inside = _mm_and_ps(_mm_and_ps(
+					_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, px), e0), zero),
+					_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, px), e1), zero)),
+					_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, px), e2), zero));
+
+				__m128 current = _mm_loadu_ps(row + x);
+				__m128 nearer = _mm_min_ps(current, _mm_add_ps(_mm_mul_ps(za, px), z));
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, current)));
+			}
+#else
+			for (int32_t x = t.minX; x <= t.maxX; x++) {
+				float px = x + 0.5f;
+				bool inside = true;
+				for (const auto& edge : t.edges) {
+					inside = inside && edge[0] * px + edge[1] * py + edge[2] >= 0.0f;
+				}
+
+				if (inside) { row[x] = std::min(row[x], t.plane[0] * px + t.plane[1] * py + t.plane[2]); }
+			}
+#endif
+		}
+	}
+}
+
+// A box is hidden when every pixel its projection touches already holds something nearer than the box's nearest point.
+bool Adren::Occlusion::occluded(const Culling::Bounds& bounds, uint32_t index, const glm::mat4& viewProj) const {
+	glm::vec3 center(bounds.centerX[index], bounds.centerY[index], bounds.centerZ[index]);
+	glm::vec3 extent(bounds.extentX[index], bounds.extentY[index], bounds.extentZ[index]);
+
+	glm::vec2 lo(static_cast<float>(width), static_cast<float>(height));
+	glm::vec2 hi(0.0f);
+	float nearest = 1.0f;
+
+	for (int i = 0; i < 8; i++) {
+		glm::vec3 corner = center + extent * glm::vec3(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f);
+		glm::vec4 clip = viewProj * glm::vec4(corner, 1.0f);
+		if (clip.w <= 1.0e-4f) { return false; }
+
+		glm::vec2 pixel((clip.x / clip.w * 0.5f + 0.5f) * width, (clip.y / clip.w * 0.5f + 0.5f) * height);
+		lo = glm::min(lo, pixel);
+		hi = glm::max(hi, pixel);
+		nearest = std::min(nearest, clip.z / clip.w);
+	}
+
+	int32_t x0 = std::max(0, static_cast<int32_t>(std::floor(lo.x)));
+	int32_t x1 = std::min(static_cast<int32_t>(width) - 1, static_cast<int32_t>(std::ceil(hi.x)));
+	int32_t y0 = std::max(0, static_cast<int32_t>(std::floor(lo.y)));
+	int32_t y1 = std::min(static_cast<int32_t>(height) - 1, static_cast<int32_t>(std::ceil(hi.y)));
+	if (x0 > x1 || y0 > y1) { return false; }
+
+	for (int32_t y = y0; y <= y1; y++) {
+		const float* row = &depth[y * width];
+
+#if defined(ADREN_SSE)
+		__m128 limit = _mm_set1_ps(nearest);
+		__m128 first = _mm_set1_ps(static_cast<float>(x0)), last = _mm_set1_ps(static_cast<float>(x1));
+		for (int32_t x = x0 & ~3; x <= x1; x += 4) {
+			__m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+			__m128 lanes = _mm_and_ps(_mm_cmpge_ps(px, first), _mm_cmple_ps(px, last));
+			__m128 behind = _mm_cmpge_ps(_mm_loadu_ps(row + x), limit);
+			if (_mm_movemask_ps(_mm_and_ps(lanes, behind))) { return false; }
+		}
+#else
+		for (int32_t x = x0; x <= x1; x++) {
+			if (row[x] >= nearest) { return false; }
+		}
+#endif
+	}
+
+	return true;
+}
+
+void Adren::Occlusion::cull(const glm::mat4& viewProj, Scene& scene, RenderStats& stats) {
+	if (vertices.empty()) { return; }
+
+	setup(viewProj, scene);
+	workers.parallel(height / bandHeight, [this](uint32_t band) { rasterize(band); });
+
+	// Boxes are tested in chunks and compacted afterwards so the order of what gets drawn stays the same.
+	const uint32_t chunk = 256;
+	uint32_t tested = static_cast<uint32_t>(scene.visible.size());
+	hidden.assign(tested, 0);
+	workers.parallel((tested + chunk - 1) / chunk, [&](uint32_t c) {
+		for (uint32_t i = c * chunk; i < std::min(tested, (c + 1) * chunk); i++) {
+			hidden[i] = occluded(scene.bounds, scene.visible[i], viewProj);
+		}
+	});
+
+	uint32_t kept = 0;
+	for (uint32_t i = 0; i < tested; i++) {
+		if (!hidden[i]) { scene.visible[kept++] = scene.visible[i]; }
+	}
+	scene.visible.resize(kept);
+
+	stats.occluded = tested - kept;
+	stats.drawn = kept;
+	stats.culled = stats.draws - kept;
+}
+
+bool Adren::Occlusion::test() {
+	Workers workers;
+	Occlusion occlusion(workers);
+
+	// A 10 by 10 wall at z = 0 is the only occluder, its triangles are put in directly instead of coming from a model.
+	const glm::vec3 wall[6] = { { -5.0f, -5.0f, 0.0f }, { 5.0f, -5.0f, 0.0f }, { 5.0f, 5.0f, 0.0f },
+								{ -5.0f, -5.0f, 0.0f }, { 5.0f, 5.0f, 0.0f }, { -5.0f, 5.0f, 0.0f } };
+	occlusion.vertices.assign(wall, wall + 6);
+	occlusion.occluders.push_back({ 0, 0, 6 });
+
+	// 0 is the wall's own box, 1 and 5 are right behind it, 2 is in front of it, 3 is off to the side behind
+	// it and 4 sticks out over its top.
+	const glm::vec3 centers[] = { { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, -5.0f }, { 0.0f, 0.0f, 3.0f },
+								  { 12.0f, 0.0f, -5.0f }, { 0.0f, 8.0f, -5.0f }, { 0.0f, 0.0f, -20.0f } };
+	const glm::vec3 halves[] = { { 5.0f, 5.0f, 0.01f }, { 1.0f, 1.0f, 1.0f }, { 0.5f, 0.5f, 0.5f },
+								 { 0.5f, 0.5f, 0.5f }, { 4.0f, 4.0f, 4.0f }, { 2.0f, 2.0f, 2.0f } };
+	const uint32_t count = 6;
+
+	Scene scene;
+	scene.sources.resize(1);
+	scene.bounds.resize(count);
+	for (uint32_t i = 0; i < count; i++) {
+		scene.bounds.set(i, centers[i] - halves[i], centers[i] + halves[i], glm::mat4(1.0f));
+	}
+
+	struct Pose {
+		const char* name;
+		glm::vec3 eye;
+		glm::vec3 target;
+		glm::mat4 wall;
+		std::vector<uint32_t> hidden;
+	};
+
+	const Pose poses[] = {
+		{ "front", { 0.0f, 0.0f, 10.0f }, glm::vec3(0.0f), glm::mat4(1.0f), { 1, 5 } },
+		{ "behind", { 0.0f, 0.0f, -30.0f }, glm::vec3(0.0f), glm::mat4(1.0f), { 2 } },
+		{ "away", { 0.0f, 0.0f, 10.0f }, { 0.0f, 0.0f, 20.0f }, glm::mat4(1.0f), {} },
+		{ "moved", { 0.0f, 0.0f, 10.0f }, glm::vec3(0.0f), glm::translate(glm::mat4(1.0f), glm::vec3(12.0f, 0.0f, 0.0f)), { 3 } },
+	};
+
+	glm::mat4 projection = glm::perspective(glm::radians(60.0f), static_cast<float>(width) / height, 0.1f, 100.0f);
+	bool passed = true;
+	for (const Pose& pose : poses) {
+		scene.sources[0].matrix = pose.wall;
+		scene.visible.resize(count);
+		for (uint32_t i = 0; i < count; i++) { scene.visible[i] = i; }
+
+		RenderStats stats;
+		stats.draws = count;
+		occlusion.cull(projection * glm::lookAt(pose.eye, pose.target, glm::vec3(0.0f, 1.0f, 0.0f)), scene, stats);
+
+		std::vector<uint32_t> hidden;
+		for (uint32_t i = 0, v = 0; i < count; i++) {
+			if (v < scene.visible.size() && scene.visible[v] == i) { v++; } else { hidden.push_back(i); }
+		}
+
+		bool matched = hidden == pose.hidden;
+		passed = passed && matched;
+
+		std::string list;
+		for (uint32_t i : hidden) { list += " " + std::to_string(i); }
+		std::cout << pose.name << ": hid" << (list.empty() ? " nothing" : list) << (matched ? "" : ", wrong") << std::endl;
+	}
+
+	std::cout << (passed ? "Occlusion culling test passed" : "Occlusion culling test failed") << std::endl;
+	return passed;
+}
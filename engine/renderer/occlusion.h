@@ -0,0 +1,59 @@
+/*
+	occlusion.h
+	Adrenaline Engine
+
+	Software occlusion culling. A handful of big occluder meshes are rasterized into a small depth buffer on the
+	worker threads every frame and the boxes that survived frustum culling are tested against it.
+*/
+
+#pragma once
+#include "scene.h"
+#include "core/workers.h"
+#include "tools.h"
+
+namespace Adren {
+class Occlusion {
+public:
+	Occlusion(Workers& workers) : workers(workers), depth(width * height, 1.0f) {}
+
+	void build(std::vector<Model>& models, Scene& scene);
+	void cull(const glm::mat4& viewProj, Scene& scene, RenderStats& stats);
+
+	// Culls a fixed wall and boxes from fixed camera poses and compares what each pose hides against what it
+	// should. False when any pose hides a different set.
+	static bool test();
+
+	static const uint32_t width = 256;
+	static const uint32_t height = 128;
+private:
+	// Edge functions and the depth plane of a screen space triangle, all as a * x + b * y + c.
+	struct Triangle {
+		float edges[3][3];
+		float plane[3];
+		int32_t minX, maxX, minY, maxY;
+	};
+
+	// An occluder's triangles are kept in the space of its node so moving it only changes the matrix in Scene.
+	struct Occluder {
+		uint32_t source;
+		uint32_t first;
+		uint32_t count;
+	};
+
+	void setup(const glm::mat4& viewProj, const Scene& scene);
+	void rasterize(uint32_t band);
+	bool occluded(const Culling::Bounds& bounds, uint32_t index, const glm::mat4& viewProj) const;
+
+	Workers& workers;
+	std::vector<float> depth;
+	std::vector<Occluder> occluders;
+	std::vector<glm::vec3> vertices;
+	std::vector<Triangle> triangles;
+	std::vector<uint8_t> hidden;
+
+	// Every band of rows is rasterized by one thread, so no two threads ever write the same pixel.
+	static const uint32_t bandHeight = 16;
+	static const uint32_t maxOccluders = 64;
+	static const uint32_t maxOccluderTriangles = 4096;
+};
+}
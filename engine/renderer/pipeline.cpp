@@ -6,6 +6,8 @@
 */
 #include "pipeline.h"
 #include "info.h"
+#include <chrono>
+#include <sstream>
 
 std::vector<char> Adren::Pipeline::readFile(const std::string& filename) {
     std::ifstream file(filename, std::ios::ate | std::ios::binary);
@@ -38,37 +40,181 @@ VkShaderModule Adren::Pipeline::createShaderModule(const std::vector<char>& code
     return shaderModule;
 }
 
-void Adren::Pipeline::create(Swapchain& swapchain, VkDescriptorSetLayout& dLayout, VkRenderPass& renderpass) {
+bool Adren::Pipeline::State::operator==(const State& other) const {
+    return vertexFormat == other.vertexFormat && cullMode == other.cullMode && blend == other.blend &&
+        depthWrite == other.depthWrite && alphaMask == other.alphaMask && unlit == other.unlit && alphaCutoff == other.alphaCutoff;
+}
+
+size_t Adren::Pipeline::Hash::operator()(const State& state) const {
+    size_t seed = 0;
+    auto combine = [&seed](size_t value) { seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2); };
+    combine(std::hash<uint32_t>()(state.vertexFormat));
+    combine(std::hash<uint32_t>()(state.cullMode));
+    combine(std::hash<uint32_t>()(state.blend));
+    combine(std::hash<uint32_t>()(state.depthWrite));
+    combine(std::hash<int32_t>()(state.alphaMask));
+    combine(std::hash<int32_t>()(state.unlit));
+    combine(std::hash<float>()(state.alphaCutoff));
+    return seed;
+}
+
+// The modules stay alive for as long as the pipeline does since variants get compiled later on.
+// Their interface is reflected here so the descriptor set layout can be made from it before the pipeline is.
+void Adren::Pipeline::loadShaders() {
     auto vertShaderCode = readFile("../engine/resources/shaders/vert.spv");
     auto fragShaderCode = readFile("../engine/resources/shaders/frag.spv");
 
-    VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-    VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+    vertShaderModules[Indexed] = createShaderModule(vertShaderCode);
+    fragShaderModules[Indexed] = createShaderModule(fragShaderCode);
+
+    reflected = Reflection::reflect(vertShaderCode);
+    Reflection::merge(reflected, Reflection::reflect(fragShaderCode));
+
+    // The instanced shaders only use bindings the indexed ones already have, so both share one layout.
+    // They are optional, without them everything is drawn the indexed way.
+    std::string vertPath = "../engine/resources/shaders/indirectvert.spv";
+    std::string fragPath = "../engine/resources/shaders/indirectfrag.spv";
+    if (std::ifstream(vertPath).good() && std::ifstream(fragPath).good()) {
+        vertShaderModules[Instanced] = createShaderModule(readFile(vertPath));
+        fragShaderModules[Instanced] = createShaderModule(readFile(fragPath));
+        instancing = true;
+    } else {
+        Tools::log("Instanced shaders not found, indirect drawing is disabled..");
+    }
+}
+
+void Adren::Pipeline::create(Swapchain& swapchain, VkDescriptorSetLayout& dLayout, VkRenderPass& renderpass) {
+    this->renderpass = renderpass;
+
+    // The cache is internally synchronized so every worker thread can share it.
+    VkPipelineCacheCreateInfo cacheInfo{};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    Tools::vibeCheck("PIPELINE CACHE", vkCreatePipelineCache(device, &cacheInfo, nullptr, &cache));
+
+    // Pipelines whose shaders share an interface get the same layout back from the cache.
+    layout = reflection.pipelineLayout(dLayout, reflected);
+
+    // The default state of each format is built right away, it is what gets drawn with while the other variants compile.
+    for (uint32_t format = Indexed; format < FormatCount; format++) {
+        if (format == Instanced && !instancing) { continue; }
+
+        State state{};
+        state.vertexFormat = format;
+
+        auto fallback = std::make_unique<Variant>();
+        fallback->handle = build(state);
+        fallback->ready = true;
+        fallbacks[format] = fallback->handle;
+        variants.emplace(state, std::move(fallback));
+    }
+
+    handle = fallbacks[Indexed];
+}
+
+Adren::Pipeline::State Adren::Pipeline::state(const Model::Material& material) {
+    State state{};
+    state.cullMode = material.doubleSided ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
+    state.blend = material.alphaMode == Model::AlphaMode::Blend;
+    state.depthWrite = !state.blend;
+    state.alphaMask = material.alphaMode == Model::AlphaMode::Mask;
+    state.unlit = material.unlit;
+
+    // The cutoff only matters for masked materials, keeping it at the default stops it from creating extra variants.
+    if (state.alphaMask) { state.alphaCutoff = material.alphaCutoff; }
+
+    return state;
+}
+
+// Returns the pipeline for the state if it has been compiled, otherwise the compile is queued
+// on the worker threads and the fallback pipeline of the same vertex format is returned until it is ready.
+VkPipeline Adren::Pipeline::get(const State& state) {
+    std::lock_guard<std::mutex> lock(mutex);
+    VkPipeline fallback = fallbacks[state.vertexFormat];
+
+    auto found = variants.find(state);
+    if (found != variants.end()) {
+        return found->second->ready.load(std::memory_order_acquire) ? found->second->handle : fallback;
+    }
+
+    Variant* variant = variants.emplace(state, std::make_unique<Variant>()).first->second.get();
+    size_t hash = Hash()(state);
+
+    workers.submit([this, state, variant, hash] {
+        auto start = std::chrono::high_resolution_clock::now();
+        variant->handle = build(state);
+        auto end = std::chrono::high_resolution_clock::now();
+        variant->milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+        variant->ready.store(true, std::memory_order_release);
+
+        std::stringstream message;
+        message << "Pipeline variant " << std::hex << hash << std::dec << " compiled in " << variant->milliseconds << " ms..";
+        Tools::log(message.str());
+    });
+
+    return fallback;
+}
+
+std::vector<Adren::Pipeline::Report> Adren::Pipeline::reports() {
+    std::lock_guard<std::mutex> lock(mutex);
 
+    std::vector<Report> list;
+    // The compile time is written by the worker before it publishes ready, so it is only read once ready is seen.
+    for (auto& [state, variant] : variants) {
+        bool ready = variant->ready.load(std::memory_order_acquire);
+        list.push_back({ Hash()(state), ready, ready ? variant->milliseconds : 0.0 });
+    }
+
+    return list;
+}
+
+VkPipeline Adren::Pipeline::build(const State& state) {
     VkPipelineShaderStageCreateInfo vertShaderStageInfo = Adren::Info::vertShaderStageInfo();
-    vertShaderStageInfo.module = vertShaderModule;
+    vertShaderStageInfo.module = vertShaderModules[state.vertexFormat];
+
+    // Material switches are compiled into the fragment shader instead of being branched on at runtime.
+    struct Constants {
+        int32_t alphaMask;
+        int32_t unlit;
+        float alphaCutoff;
+    } constants = { state.alphaMask, state.unlit, state.alphaCutoff };
+
+    std::array<VkSpecializationMapEntry, 3> entries{};
+    entries[0] = { 0, offsetof(Constants, alphaMask), sizeof(int32_t) };
+    entries[1] = { 1, offsetof(Constants, unlit), sizeof(int32_t) };
+    entries[2] = { 2, offsetof(Constants, alphaCutoff), sizeof(float) };
+
+    VkSpecializationInfo specialization{};
+    specialization.mapEntryCount = static_cast<uint32_t>(entries.size());
+    specialization.pMapEntries = entries.data();
+    specialization.dataSize = sizeof(Constants);
+    specialization.pData = &constants;
 
     VkPipelineShaderStageCreateInfo fragShaderStageInfo = Adren::Info::fragShaderStageInfo();
-    fragShaderStageInfo.module = fragShaderModule;
+    fragShaderStageInfo.module = fragShaderModules[state.vertexFormat];
+    fragShaderStageInfo.pSpecializationInfo = &specialization;
 
     VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
 
     VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
     vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 
-    auto bindingDescription = Vertex::getBindingDescription();
-    auto attributeDescriptions = Vertex::getAttributeDescriptions();
+    std::vector<VkVertexInputBindingDescription> bindingDescriptions = { Vertex::getBindingDescription() };
+    auto vertexAttributes = Vertex::getAttributeDescriptions();
+    std::vector<VkVertexInputAttributeDescription> attributeDescriptions(vertexAttributes.begin(), vertexAttributes.end());
+
+    if (state.vertexFormat == Instanced) {
+        bindingDescriptions.push_back(Instance::getBindingDescription());
+        auto instanceAttributes = Instance::getAttributeDescriptions();
+        attributeDescriptions.insert(attributeDescriptions.end(), instanceAttributes.begin(), instanceAttributes.end());
+    }
 
-    vertexInputInfo.vertexBindingDescriptionCount = 1;
+    vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
     vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-    vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+    vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
     vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
 
     VkPipelineInputAssemblyStateCreateInfo inputAssembly = Adren::Info::inputAssembly();
 
-    VkRect2D scissor = Adren::Info::scissor();
-    scissor.extent = swapchain.extent;
-
     VkDynamicState states[2] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
 
     VkPipelineViewportStateCreateInfo viewportState = Adren::Info::viewportState();
@@ -83,31 +229,27 @@ void Adren::Pipeline::create(Swapchain& swapchain, VkDescriptorSetLayout& dLayou
     dynamicStateInfo.pDynamicStates = states;
 
     VkPipelineRasterizationStateCreateInfo rasterizer = Adren::Info::rasterizer();
+    rasterizer.cullMode = state.cullMode;
 
     VkPipelineMultisampleStateCreateInfo multisampling = Adren::Info::multisampling();
 
     VkPipelineDepthStencilStateCreateInfo depthStencil = Adren::Info::depthStencil();
+    depthStencil.depthWriteEnable = state.depthWrite;
 
     VkPipelineColorBlendAttachmentState colorBlendAttachment = Adren::Info::colorBlendAttachment();
+    if (state.blend) {
+        colorBlendAttachment.blendEnable = VK_TRUE;
+        colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+        colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+        colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+        colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+        colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+        colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+    }
 
     VkPipelineColorBlendStateCreateInfo colorBlending = Adren::Info::colorBlending();
     colorBlending.pAttachments = &colorBlendAttachment;
 
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 1;
-    pipelineLayoutInfo.pSetLayouts = &dLayout;
-
-    VkPushConstantRange pushConstantRange{};
-    pushConstantRange.offset = 0;
-    pushConstantRange.size = sizeof(glm::mat4);
-    pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
-    pipelineLayoutInfo.pushConstantRangeCount = 1;
-
-    Tools::vibeCheck("PIPELINE LAYOUT", vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &layout));
-
     VkGraphicsPipelineCreateInfo pipelineInfo{};
     pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
     pipelineInfo.stageCount = 2;
@@ -125,8 +267,24 @@ void Adren::Pipeline::create(Swapchain& swapchain, VkDescriptorSetLayout& dLayou
     pipelineInfo.subpass = 0;
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-    Tools::vibeCheck("PIPELINE", vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &handle));
+    VkPipeline pipeline;
+    Tools::vibeCheck("PIPELINE", vkCreateGraphicsPipelines(device, cache, 1, &pipelineInfo, nullptr, &pipeline));
 
-    vkDestroyShaderModule(device, fragShaderModule, nullptr);
-    vkDestroyShaderModule(device, vertShaderModule, nullptr);
+    return pipeline;
+}
+
+void Adren::Pipeline::cleanup() {
+    // Nothing can be destroyed while a variant is still compiling on another thread.
+    workers.wait();
+
+    for (auto& [state, variant] : variants) {
+        vkDestroyPipeline(device, variant->handle, nullptr);
+    }
+    variants.clear();
+
+    vkDestroyPipelineCache(device, cache, nullptr);
+    for (uint32_t format = Indexed; format < FormatCount; format++) {
+        vkDestroyShaderModule(device, fragShaderModules[format], nullptr);
+        vkDestroyShaderModule(device, vertShaderModules[format], nullptr);
+    }
 }
@@ -5,20 +5,79 @@
 	This defines everything related to the graphics pipeline
 */
 #pragma once
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
 #include "devices.h"
 #include "swapchain.h"
+#include "reflection.h"
+#include "core/workers.h"
 
 namespace Adren {
 class Pipeline {
 public:
-	Pipeline(Devices& devices) : device(devices.device) {}
+	Pipeline(Devices& devices, Workers& workers, Reflection& reflection) : device(devices.device), workers(workers), reflection(reflection) {}
+
+	// Indexed reads the model matrix from the dynamic uniform buffer, Instanced reads it from the per draw vertex buffer.
+	enum Format : uint32_t { Indexed = 0, Instanced = 1, FormatCount = 2 };
+
+	// Everything that makes one pipeline variant different from another.
+	// The last three fields are fed to the fragment shader as specialization constants.
+	struct State {
+		uint32_t vertexFormat = 0;
+		VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+		VkBool32 blend = VK_FALSE;
+		VkBool32 depthWrite = VK_TRUE;
+		int32_t alphaMask = 0;
+		int32_t unlit = 0;
+		float alphaCutoff = 0.5f;
+
+		bool operator==(const State& other) const;
+	};
+
+	struct Hash {
+		size_t operator()(const State& state) const;
+	};
+
+	struct Report {
+		size_t hash;
+		bool ready;
+		double milliseconds;
+	};
+
+	static std::vector<char> readFile(const std::string& filename);
+	VkShaderModule createShaderModule(const std::vector<char>& code);
+	void loadShaders();
 	void create(Swapchain& swapchain, VkDescriptorSetLayout& layout, VkRenderPass& renderpass);
+	VkPipeline get(const State& state);
+	static State state(const Model::Material& material);
+	std::vector<Report> reports();
+	void cleanup();
+
 	VkPipeline handle;
 	VkPipelineLayout layout = VK_NULL_HANDLE;
+	Reflection::Interface reflected;
+	bool instancing = false;
 private:
-	static std::vector<char> readFile(const std::string& filename);
-	VkShaderModule createShaderModule(const std::vector<char>& code);
+	struct Variant {
+		VkPipeline handle = VK_NULL_HANDLE;
+		std::atomic<bool> ready{false};
+		double milliseconds = 0.0;
+	};
+
+	VkPipeline build(const State& state);
 
 	VkDevice& device;
+	Workers& workers;
+	Reflection& reflection;
+	VkRenderPass renderpass = VK_NULL_HANDLE;
+	VkPipelineCache cache = VK_NULL_HANDLE;
+	VkShaderModule vertShaderModules[FormatCount] = {};
+	VkShaderModule fragShaderModules[FormatCount] = {};
+	VkPipeline fallbacks[FormatCount] = {};
+
+	std::mutex mutex;
+	std::unordered_map<State, std::unique_ptr<Variant>, Hash> variants;
 };
-}
\ No newline at end of file
+}
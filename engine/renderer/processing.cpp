@@ -6,20 +6,29 @@
 */
 
 #include "processing.h"
+#include "core/profiler.h"
 #include <cmath>
+#include <chrono>
 
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_vulkan.h>
 
 void Adren::Processing::cleanup() {
+    collect(UINT64_MAX);
     vkDestroyCommandPool(device, commandPool, nullptr);
     for (size_t i = 0; i < maxFramesInFlight; i++) {
         vkDestroyCommandPool(device, frames[i].commandPool, nullptr);
+        for (VkCommandPool pool : frames[i].recordPools) { vkDestroyCommandPool(device, pool, nullptr); }
         vkDestroySemaphore(device, frames[i].rSemaphore, nullptr);
         vkDestroySemaphore(device, frames[i].iSemaphore, nullptr);
         vkDestroyFence(device, frames[i].fence, nullptr);
     }
+
+    if (readbackBuffer.size > 0) {
+        vmaUnmapMemory(allocator, readbackBuffer.memory);
+        Memory::destroyBuffer(allocator, readbackBuffer.buffer, readbackBuffer.memory);
+    }
 }
 
 void Adren::Processing::createCommands(VkSurfaceKHR& surface, VkInstance& instance) {
@@ -39,6 +48,20 @@ void Adren::Processing::createCommands(VkSurfaceKHR& surface, VkInstance& instan
         allocInfo.commandBufferCount = 1;
 
         Adren::Tools::vibeCheck("ALLOCATE COMMAND BUFFERS", vkAllocateCommandBuffers(device, &allocInfo, &frames[i].commandBuffer));
+
+        // One pool per recording thread, since a pool can only be used from one thread at a time.
+        frames[i].recordPools.resize(maxRecorders);
+        frames[i].secondaries.resize(maxRecorders);
+        for (uint32_t r = 0; r < maxRecorders; r++) {
+            Adren::Tools::vibeCheck("RECORDING COMMAND POOL", vkCreateCommandPool(device, &poolInfo, nullptr, &frames[i].recordPools[r]));
+
+            VkCommandBufferAllocateInfo secondaryInfo{};
+            secondaryInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            secondaryInfo.commandPool = frames[i].recordPools[r];
+            secondaryInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            secondaryInfo.commandBufferCount = 1;
+            Adren::Tools::vibeCheck("ALLOCATE SECONDARY COMMAND BUFFERS", vkAllocateCommandBuffers(device, &secondaryInfo, &frames[i].secondaries[r]));
+        }
         
 #ifdef DEBUG
             Adren::Tools::label(instance, device, VK_OBJECT_TYPE_COMMAND_POOL, (uint64_t)frames[i].commandPool, "FRAME COMMAND POOL");
@@ -70,15 +93,102 @@ void Adren::Processing::createSyncObjects() {
     }
 }
 
-void Adren::Processing::render(Buffers& buffers, Pipeline& pipeline, Descriptor& descriptor, Swapchain& swapchain, Renderpass& renderpass, GUI& gui) {
-    ImGui::Render();
+// Every variant shares one layout, so the set and the push constant stay valid across pipeline binds and each
+// only needs recording when its value actually changes from the draw before. The variants were resolved up front,
+// one per visible draw, so recording never takes the pipeline's lock.
+void Adren::Processing::recordDraws(VkCommandBuffer& commandBuffer, Pipeline& pipeline, const VkPipeline* variants, VkDescriptorSet& set, const Scene& scene, uint32_t first, uint32_t last, DrawCounters& counters) {
+    VkPipeline bound = pipeline.handle;
+    uint32_t boundOffset = UINT32_MAX;
+    uint32_t boundTexture = UINT32_MAX;
+    for (uint32_t v = first; v < last; v++) {
+        const Scene::Draw& draw = scene.draws[scene.visible[v]];
 
+        // Variants that are still compiling resolved to the fallback pipeline, so only rebind when it changes.
+        VkPipeline variant = variants[v];
+        if (variant != bound) {
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, variant);
+            bound = variant;
+            counters.pipelines++;
+        }
+
+        uint32_t offset = draw.dynamicOffset + dynamicBase;
+        if (offset != boundOffset) {
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.layout, 0, 1, &set, 1, &offset);
+            boundOffset = offset;
+            counters.sets++;
+        }
+
+        if (draw.texture != boundTexture) {
+            vkCmdPushConstants(commandBuffer, pipeline.layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(draw.texture), &draw.texture);
+            boundTexture = draw.texture;
+            counters.pushes++;
+        }
+
+        vkCmdDrawIndexed(commandBuffer, draw.indexCount, 1, draw.firstIndex, draw.vertexOffset, 0);
+        counters.calls++;
+    }
+}
+
+Adren::Arena& Adren::Processing::begin() {
+    ADREN_PROFILE_SCOPE("Wait for frame");
     currentFrame = (currentFrame + 1) % maxFramesInFlight;
     vkWaitForFences(device, 1, &frames[currentFrame].fence, VK_TRUE, UINT64_MAX);
-    vkResetFences(device, 1, &frames[currentFrame].fence);
+    arenas[currentFrame].reset();
+
+    uint64_t frame = 0;
+    {
+        std::lock_guard<std::mutex> lock(retiring);
+        frame = ++frameNumber;
+    }
+
+    collect(frame);
+    return arenas[currentFrame];
+}
 
-    uint32_t imageIndex;
-    vkAcquireNextImageKHR(device, swapchain.handle, UINT64_MAX, frames[currentFrame].iSemaphore, VK_NULL_HANDLE, &imageIndex);
+void Adren::Processing::retire(std::function<void()> destroy) {
+    std::lock_guard<std::mutex> lock(retiring);
+    retired.push_back({frameNumber + maxFramesInFlight, std::move(destroy)});
+}
+
+// Everything retired by the time frame n started was last used by frame n at the latest, and begin has waited on
+// that frame's fence once maxFramesInFlight more frames have started. The destroys run outside the lock.
+void Adren::Processing::collect(uint64_t frame) {
+    std::vector<Retired> ready;
+    {
+        std::lock_guard<std::mutex> lock(retiring);
+        auto done = std::stable_partition(retired.begin(), retired.end(), [frame](const Retired& entry) { return entry.frame > frame; });
+        ready.assign(std::make_move_iterator(done), std::make_move_iterator(retired.end()));
+        retired.erase(done, retired.end());
+    }
+
+    for (Retired& entry : ready) { entry.destroy(); }
+}
+
+void Adren::Processing::render(Buffers& buffers, Pipeline& pipeline, Descriptor& descriptor, Swapchain& swapchain, Renderpass& renderpass, GUI& gui, Scene& scene, Indirect& indirect, Instancing& instancing, const Settings& settings, ImDrawData* overlay, Timing& timing) {
+    ADREN_PROFILE_FUNCTION();
+
+    // Headless there is nothing to acquire, the frame slot picks the descriptor set instead of a swapchain image.
+    bool headless = swapchain.handle == VK_NULL_HANDLE;
+    uint32_t imageIndex = static_cast<uint32_t>(currentFrame % swapchain.images.size());
+    if (!headless) {
+        ADREN_PROFILE_SCOPE("Acquire");
+
+        // Nothing has been recorded or reset yet, so a frame that cannot get an image is simply skipped. The fence
+        // is only reset right before submitting, which leaves it signaled for the next wait on this slot.
+        if (outdated) {
+            if (!recreate()) { return; }
+            outdated = false;
+        }
+
+        VkResult result = vkAcquireNextImageKHR(device, swapchain.handle, UINT64_MAX, frames[currentFrame].iSemaphore, VK_NULL_HANDLE, &imageIndex);
+        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+            outdated = true;
+            return;
+        }
+
+        // Suboptimal still presents, the swapchain is rebuilt before the next frame.
+        outdated = result == VK_SUBOPTIMAL_KHR;
+    }
     auto commandBuffer = frames[currentFrame].commandBuffer;
 
     VkCommandBufferBeginInfo beginInfo{};
@@ -89,25 +199,136 @@ void Adren::Processing::render(Buffers& buffers, Pipeline& pipeline, Descriptor&
     //vkResetCommandBuffer(commandBuffer, VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT);
     vkResetCommandPool(device, frames[currentFrame].commandPool, 0);
     vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    timing.begin(commandBuffer, static_cast<uint32_t>(currentFrame));
+    uint32_t whole = timing.start(commandBuffer, "Frame");
     
-    gui.beginRenderpass(commandBuffer, pipeline.handle, buffers.vertex, buffers.index);
-    Offset offset = {0, 0, 0, 0, 0, buffers.dynamicUniform.align};
-    for (uint32_t m = 0; m < models.size(); m++) {
-        for (size_t n = 0; n < models[m].nodes.size(); n++) {
-            Model::Node node = models[m].nodes[n];
-            models[m].drawNode(commandBuffer, pipeline.layout, node, descriptor.sets[imageIndex], offset);
+    // With GPU culling the draw list never comes back to the CPU, the compute pass writes it straight into the indirect buffer.
+    bool gpu = settings.gpuCulling && indirect.supported;
+    if (gpu) {
+        indirect.prepare(gui.base.depth, camera.width, camera.height);
+        uint32_t culling = timing.start(commandBuffer, "Culling");
+        indirect.cull(commandBuffer, camera.projection() * camera.view(), settings, static_cast<uint32_t>(currentFrame));
+        timing.end(commandBuffer, culling);
+    }
+
+    // The fence waited on in begin guarantees this frame's instance buffer is no longer being read.
+    bool instanced = !gpu && settings.instancing && pipeline.instancing;
+    if (instanced) { instancing.prepare(scene, static_cast<uint32_t>(currentFrame)); }
+
+    // The draws are split into one contiguous range per thread, which keeps each range in sort order.
+    uint32_t units = static_cast<uint32_t>(instanced ? instancing.batches.size() : scene.visible.size());
+    uint32_t parts = gpu ? 1 : std::clamp(std::min(settings.recordThreads, units), 1u, maxRecorders);
+    // The draws' matrices come from this frame's own copy of the dynamic uniform buffer.
+    dynamicBase = static_cast<uint32_t>(buffers.dynamicRegion * currentFrame);
+
+    // Looking a variant up takes the pipeline's lock, so every unit's variant is resolved here before the recording
+    // threads start and they only read the handles. Sorted draws mostly repeat the state before them.
+    ArenaVector<VkPipeline> variants(gpu ? 0 : units, VK_NULL_HANDLE, arenas[currentFrame]);
+    Pipeline::State previous{};
+    VkPipeline resolved = VK_NULL_HANDLE;
+    for (uint32_t u = 0; u < variants.size(); u++) {
+        Pipeline::State state = instanced ? scene.draws[instancing.batches[u].draw].state : scene.draws[scene.visible[u]].state;
+        if (instanced) { state.vertexFormat = Pipeline::Instanced; }
+        if (resolved == VK_NULL_HANDLE || !(state == previous)) {
+            resolved = pipeline.get(state);
+            previous = state;
         }
-        offset.texture += models[m].textures.size();
-        offset.dynamic += static_cast<uint32_t>(offset.align);
+
+        variants[u] = resolved;
     }
 
-    vkCmdEndRenderPass(commandBuffer);
+    // Each frame in flight has its own set, which reads its own copy of the camera.
+    VkDescriptorSet& set = descriptor.sets[currentFrame];
 
-    renderpass.begin(commandBuffer, imageIndex, swapchain.framebuffers, swapchain.extent);
+    auto start = std::chrono::steady_clock::now();
+    uint32_t scenePass = timing.start(commandBuffer, "Scene");
+    gui.beginRenderpass(commandBuffer, pipeline.handle, buffers.vertex, buffers.index, parts > 1 ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+    counters = {};
+    if (gpu) {
+        indirect.draw(commandBuffer, pipeline, set, static_cast<uint32_t>(currentFrame), counters);
+    } else if (parts == 1) {
+        if (instanced) {
+            instancing.draw(commandBuffer, scene, pipeline, variants.data(), set, static_cast<uint32_t>(currentFrame), 0, units, counters);
+        } else {
+            recordDraws(commandBuffer, pipeline, variants.data(), set, scene, 0, units, counters);
+        }
+    } else {
+        Frame& frame = frames[currentFrame];
+        ArenaVector<DrawCounters> partCounters(parts, DrawCounters{}, arenas[currentFrame]);
+
+        workers.parallel(parts, [&](uint32_t p) {
+            ADREN_PROFILE_SCOPE("Record secondary");
+            uint32_t first = static_cast<uint32_t>(static_cast<uint64_t>(units) * p / parts);
+            uint32_t last = static_cast<uint32_t>(static_cast<uint64_t>(units) * (p + 1) / parts);
+            VkCommandBuffer& secondary = frame.secondaries[p];
+            vkResetCommandPool(device, frame.recordPools[p], 0);
+
+            VkCommandBufferInheritanceInfo inheritance{};
+            inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+            inheritance.renderPass = gui.base.renderpass;
+            inheritance.subpass = 0;
+            inheritance.framebuffer = gui.base.framebuffer;
+
+            VkCommandBufferBeginInfo secondaryInfo{};
+            secondaryInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            secondaryInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+            secondaryInfo.pInheritanceInfo = &inheritance;
+            vkBeginCommandBuffer(secondary, &secondaryInfo);
+
+            gui.bindScene(secondary, pipeline.handle, buffers.vertex, buffers.index);
+            if (instanced) {
+                instancing.draw(secondary, scene, pipeline, variants.data(), set, static_cast<uint32_t>(currentFrame), first, last, partCounters[p]);
+            } else {
+                recordDraws(secondary, pipeline, variants.data(), set, scene, first, last, partCounters[p]);
+            }
+
+            vkEndCommandBuffer(secondary);
+        });
+
+        vkCmdExecuteCommands(commandBuffer, parts, frame.secondaries.data());
+
+        for (const DrawCounters& part : partCounters) {
+            counters.calls += part.calls;
+            counters.pipelines += part.pipelines;
+            counters.sets += part.sets;
+            counters.pushes += part.pushes;
+        }
+    }
 
-    ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), commandBuffer);
+    recording = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
 
     vkCmdEndRenderPass(commandBuffer);
+    timing.end(commandBuffer, scenePass);
+
+    // The depth pyramid comes from this frame's depth and is what the next frame culls against.
+    if (gpu && settings.occlusionCulling) {
+        uint32_t pyramid = timing.start(commandBuffer, "Depth pyramid");
+        indirect.reduce(commandBuffer, gui.base.depth, camera.width, camera.height);
+        timing.end(commandBuffer, pyramid);
+    }
+
+    captured = headless && capture;
+    capture = false;
+    if (captured) {
+        uint32_t copy = timing.start(commandBuffer, "Capture");
+        copyTarget(commandBuffer, buffers, gui.base.color);
+        timing.end(commandBuffer, copy);
+    }
+
+    if (!headless) {
+        uint32_t editorPass = timing.start(commandBuffer, "ImGui");
+        renderpass.begin(commandBuffer, imageIndex, swapchain.framebuffers, swapchain.extent);
+
+        {
+            ADREN_PROFILE_SCOPE("Record ImGui");
+            ImGui_ImplVulkan_RenderDrawData(overlay, commandBuffer);
+        }
+
+        vkCmdEndRenderPass(commandBuffer);
+        timing.end(commandBuffer, editorPass);
+    }
+
+    timing.end(commandBuffer, whole);
 
     vkEndCommandBuffer(commandBuffer);
 
@@ -117,7 +338,7 @@ void Adren::Processing::render(Buffers& buffers, Pipeline& pipeline, Descriptor&
     
     VkSemaphore waitSemaphores[] = {frames[currentFrame].iSemaphore};
     VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.waitSemaphoreCount = headless ? 0 : 1;
     submitInfo.pWaitSemaphores = waitSemaphores;
     submitInfo.pWaitDstStageMask = waitStages;
     
@@ -127,10 +348,13 @@ void Adren::Processing::render(Buffers& buffers, Pipeline& pipeline, Descriptor&
     submitInfo.pCommandBuffers = commandBuffers.data();
     
     VkSemaphore signalSemaphores[] = {frames[currentFrame].rSemaphore};
-    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.signalSemaphoreCount = headless ? 0 : 1;
     submitInfo.pSignalSemaphores = signalSemaphores;
     
+    ADREN_PROFILE_SCOPE("Submit and present");
+    vkResetFences(device, 1, &frames[currentFrame].fence);
     vkQueueSubmit(graphicsQueue, 1, &submitInfo, frames[currentFrame].fence);
+    if (headless) { return; }
     
     VkPresentInfoKHR presentInfo{};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -144,5 +368,71 @@ void Adren::Processing::render(Buffers& buffers, Pipeline& pipeline, Descriptor&
     
     presentInfo.pImageIndices = &imageIndex;
     
-    vkQueuePresentKHR(presentQueue, &presentInfo);
+    VkResult presented = vkQueuePresentKHR(presentQueue, &presentInfo);
+    if (presented == VK_ERROR_OUT_OF_DATE_KHR || presented == VK_SUBOPTIMAL_KHR) { outdated = true; }
+}
+
+
+// The target is left for the sampler by the scene pass, and the next frame's pass starts from an undefined layout,
+// so it only needs moving to a transfer source here. The buffer barrier makes the copy visible to the host.
+void Adren::Processing::copyTarget(VkCommandBuffer& commandBuffer, Buffers& buffers, Image& target) {
+    VkDeviceSize size = static_cast<VkDeviceSize>(camera.width) * camera.height * 4;
+    if (readbackBuffer.size != size) {
+        if (readbackBuffer.size > 0) {
+            vmaUnmapMemory(allocator, readbackBuffer.memory);
+            Memory::destroyBuffer(allocator, readbackBuffer.buffer, readbackBuffer.memory);
+        }
+
+        buffers.createBuffer(allocator, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, readbackBuffer, VMA_MEMORY_USAGE_GPU_TO_CPU, MemoryCategory::Staging);
+        readbackBuffer.size = size;
+        vmaMapMemory(allocator, readbackBuffer.memory, &readbackBuffer.mapped);
+    }
+
+    VkImageMemoryBarrier toTransfer{};
+    toTransfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    toTransfer.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    toTransfer.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    toTransfer.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    toTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    toTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toTransfer.image = target.image;
+    toTransfer.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &toTransfer);
+
+    VkBufferImageCopy region{};
+    region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+    region.imageExtent = { static_cast<uint32_t>(camera.width), static_cast<uint32_t>(camera.height), 1 };
+    vkCmdCopyImageToBuffer(commandBuffer, target.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer.buffer, 1, &region);
+
+    VkBufferMemoryBarrier toHost{};
+    toHost.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    toHost.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    toHost.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    toHost.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toHost.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toHost.buffer = readbackBuffer.buffer;
+    toHost.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &toHost, 0, nullptr);
+}
+
+// The target has the swapchain's BGRA layout, image writers want RGBA.
+bool Adren::Processing::readback(std::vector<uint8_t>& pixels) {
+    if (!captured) { return false; }
+
+    vkWaitForFences(device, 1, &frames[currentFrame].fence, VK_TRUE, UINT64_MAX);
+    captured = false;
+
+    // Coherent memory is only preferred, not guaranteed.
+    vmaInvalidateAllocation(allocator, readbackBuffer.memory, 0, VK_WHOLE_SIZE);
+    const uint8_t* source = static_cast<const uint8_t*>(readbackBuffer.mapped);
+    pixels.resize(readbackBuffer.size);
+    for (VkDeviceSize i = 0; i < readbackBuffer.size; i += 4) {
+        pixels[i + 0] = source[i + 2];
+        pixels[i + 1] = source[i + 1];
+        pixels[i + 2] = source[i + 0];
+        pixels[i + 3] = source[i + 3];
+    }
+
+    return true;
 }
@@ -8,33 +8,91 @@
 #pragma once
 #include "gui.h"
 #include "descriptor.h"
+#include "indirect.h"
+#include "occlusion.h"
+#include "instancing.h"
+#include "timing.h"
+#include "core/arena.h"
+#include <algorithm>
+#include <functional>
+#include <mutex>
 
 namespace Adren {
 class Processing {
 public:
-    Processing(Devices& devices, Camera& camera, std::vector<Model>& models, GLFWwindow* window) :
-        device(devices.device), camera(camera), models(models), window(window), gpu(devices.gpu),
-        graphicsQueue(devices.graphicsQueue), presentQueue(devices.presentQueue) {}
+    Processing(Devices& devices, Camera& camera, std::vector<Model>& models, GLFWwindow* window, Workers& workers) :
+        device(devices.device), allocator(devices.allocator), camera(camera), models(models), window(window), gpu(devices.gpu),
+        graphicsQueue(devices.graphicsQueue), presentQueue(devices.presentQueue), workers(workers),
+        maxRecorders(std::min(workers.size() + 1, 8u)) {}
 
     void createCommands(VkSurfaceKHR& surface, VkInstance& instance);
     void createSyncObjects();
-    void render(Buffers& buffers, Pipeline& pipeline, Descriptor& descriptor, Swapchain& swapchain, Renderpass& renderpass, GUI& gui);
+
+    // Moves on to the next frame slot and waits for its fence, after which the slot's arena is empty again and
+    // good for whatever the CPU needs until the next frame. Called before anything of the frame is drawn.
+    Arena& begin();
+    const Arena& arena() const { return arenas[currentFrame]; }
+    void render(Buffers& buffers, Pipeline& pipeline, Descriptor& descriptor, Swapchain& swapchain, Renderpass& renderpass, GUI& gui, Scene& scene, Indirect& indirect, Instancing& instancing, const Settings& settings, ImDrawData* overlay, Timing& timing);
     void cleanup();
+    uint32_t recorders() const { return maxRecorders; }
+
+    // Destroys something once every frame that could still be using it has finished, which begin knows when it
+    // has waited on the fence of each frame started before the call. Safe from either thread.
+    void retire(std::function<void()> destroy);
+
+    // Set by the renderer. Rebuilds the swapchain on the render thread, false while the window has no area to draw to.
+    std::function<bool()> recreate;
+
+    // Waits for the last frame and copies what it drew out as tightly packed RGBA rows. Only has something to
+    // give after a frame rendered with capture set.
+    bool readback(std::vector<uint8_t>& pixels);
    
     VkCommandPool commandPool = VK_NULL_HANDLE;
     size_t currentFrame = 0;
+
+    // What was recorded for the scene last frame. The indirect path counts one call per batch, the GPU decides
+    // how many draws each of those turns into.
+    DrawCounters counters;
+
+    // How long recording the scene's draws took on the CPU last frame, in milliseconds.
+    double recording = 0.0;
+
+    // Without a swapchain, the next frame copies the scene's color target into the readback buffer.
+    bool capture = false;
 private:
+    void recordDraws(VkCommandBuffer& commandBuffer, Pipeline& pipeline, const VkPipeline* variants, VkDescriptorSet& set, const Scene& scene, uint32_t first, uint32_t last, DrawCounters& counters);
+    void copyTarget(VkCommandBuffer& commandBuffer, Buffers& buffers, Image& target);
+    void collect(uint64_t frame);
+
     GLFWwindow* window;
     Camera& camera;
     std::vector<Model>& models;
     VkDevice& device;
+    VmaAllocator& allocator;
     VkPhysicalDevice& gpu;
     VkQueue& graphicsQueue;
     VkQueue& presentQueue;
     std::vector<VkCommandBuffer> commandBuffers;
-
-    static const int maxFramesInFlight = 3;
+    Workers& workers;
+    uint32_t maxRecorders;
 
     Frame frames[maxFramesInFlight];
+    Arena arenas[maxFramesInFlight];
+
+    Buffer readbackBuffer{};
+    bool captured = false;
+    uint32_t dynamicBase = 0;
+
+    // Presenting or acquiring found the swapchain no longer matches the window, the next frame rebuilds it first.
+    bool outdated = false;
+
+    struct Retired {
+        uint64_t frame;
+        std::function<void()> destroy;
+    };
+
+    std::mutex retiring;
+    std::vector<Retired> retired;
+    uint64_t frameNumber = 0;
 };
 }
@@ -0,0 +1,364 @@
+/*
+    reflection.cpp
+    Adrenaline Engine
+
+    This walks the SPIR-V instruction stream and pulls out everything the pipeline layout needs.
+    The opcodes and enums are taken from the SPIR-V specification.
+*/
+
+#include "reflection.h"
+#include "tools.h"
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+const uint32_t spirvMagic = 0x07230203;
+
+enum Op : uint32_t {
+    OpEntryPoint = 15,
+    OpTypeInt = 21,
+    OpTypeFloat = 22,
+    OpTypeVector = 23,
+    OpTypeMatrix = 24,
+    OpTypeImage = 25,
+    OpTypeSampler = 26,
+    OpTypeSampledImage = 27,
+    OpTypeArray = 28,
+    OpTypeRuntimeArray = 29,
+    OpTypeStruct = 30,
+    OpTypePointer = 32,
+    OpConstant = 43,
+    OpVariable = 59,
+    OpDecorate = 71,
+    OpMemberDecorate = 72
+};
+
+enum Decoration : uint32_t {
+    DecorationBlock = 2,
+    DecorationBufferBlock = 3,
+    DecorationArrayStride = 6,
+    DecorationMatrixStride = 7,
+    DecorationBinding = 33,
+    DecorationDescriptorSet = 34,
+    DecorationOffset = 35
+};
+
+enum StorageClass : uint32_t {
+    StorageClassUniformConstant = 0,
+    StorageClassUniform = 2,
+    StorageClassPushConstant = 9,
+    StorageClassStorageBuffer = 12
+};
+
+struct Type {
+    uint32_t op = 0;
+    std::vector<uint32_t> operands;
+};
+
+struct Module {
+    std::unordered_map<uint32_t, Type> types;
+    std::unordered_map<uint32_t, uint32_t> constants;
+    std::unordered_map<uint32_t, uint32_t> bindings;
+    std::unordered_map<uint32_t, uint32_t> sets;
+    std::unordered_map<uint32_t, uint32_t> strides;
+    std::unordered_map<uint32_t, std::unordered_map<uint32_t, uint32_t>> offsets;
+    std::unordered_map<uint32_t, std::unordered_map<uint32_t, uint32_t>> matrixStrides;
+    std::unordered_map<uint32_t, uint32_t> blocks;
+    std::vector<std::pair<uint32_t, uint32_t>> variables; // pointer type, variable id
+    VkShaderStageFlags stage = 0;
+};
+
+VkShaderStageFlags stageFromModel(uint32_t executionModel) {
+    switch (executionModel) {
+    case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+    case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+    case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+    case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+    case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+    case 5: return VK_SHADER_STAGE_COMPUTE_BIT;
+    default: return 0;
+    }
+}
+
+// Byte size of a type as laid out in a push constant block, matrix strides come from the enclosing struct member.
+uint32_t sizeOf(const Module& module, uint32_t id, uint32_t matrixStride = 0) {
+    auto found = module.types.find(id);
+    if (found == module.types.end()) { return 0; }
+    const Type& type = found->second;
+
+    switch (type.op) {
+    case OpTypeInt:
+    case OpTypeFloat:
+        return type.operands[0] / 8;
+    case OpTypeVector:
+        return sizeOf(module, type.operands[0]) * type.operands[1];
+    case OpTypeMatrix: {
+        uint32_t column = matrixStride > 0 ? matrixStride : sizeOf(module, type.operands[0]);
+        return column * type.operands[1];
+    }
+    case OpTypeArray: {
+        auto length = module.constants.find(type.operands[1]);
+        auto stride = module.strides.find(id);
+        uint32_t element = stride != module.strides.end() ? stride->second : sizeOf(module, type.operands[0]);
+        return length != module.constants.end() ? element * length->second : 0;
+    }
+    case OpTypeStruct: {
+        uint32_t size = 0;
+        auto offsets = module.offsets.find(id);
+        auto strides = module.matrixStrides.find(id);
+        for (uint32_t m = 0; m < type.operands.size(); m++) {
+            uint32_t offset = 0;
+            uint32_t stride = 0;
+            if (offsets != module.offsets.end() && offsets->second.count(m)) { offset = offsets->second.at(m); }
+            if (strides != module.matrixStrides.end() && strides->second.count(m)) { stride = strides->second.at(m); }
+            size = std::max(size, offset + sizeOf(module, type.operands[m], stride));
+        }
+        return size;
+    }
+    default:
+        return 0;
+    }
+}
+
+bool descriptorType(const Module& module, uint32_t storage, uint32_t id, VkDescriptorType& type) {
+    auto found = module.types.find(id);
+    if (found == module.types.end()) { return false; }
+    const Type& base = found->second;
+
+    if (storage == StorageClassStorageBuffer) { type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER; return true; }
+
+    if (storage == StorageClassUniform) {
+        auto block = module.blocks.find(id);
+        type = (block != module.blocks.end() && block->second == DecorationBufferBlock) ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        return true;
+    }
+
+    if (storage != StorageClassUniformConstant) { return false; }
+
+    switch (base.op) {
+    case OpTypeSampler: type = VK_DESCRIPTOR_TYPE_SAMPLER; return true;
+    case OpTypeSampledImage: type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER; return true;
+    case OpTypeImage: {
+        uint32_t dim = base.operands[1];
+        uint32_t sampled = base.operands[5];
+        if (dim == 5) { type = sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER; }
+        else if (dim == 6) { type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT; }
+        else { type = sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE; }
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+}
+
+Adren::Reflection::Interface Adren::Reflection::reflect(const std::vector<char>& code) {
+    Interface reflected{};
+
+    size_t wordCount = code.size() / sizeof(uint32_t);
+    std::vector<uint32_t> words(wordCount);
+    memcpy(words.data(), code.data(), wordCount * sizeof(uint32_t));
+
+    if (wordCount < 5 || words[0] != spirvMagic) {
+        Adren::Tools::log("Shader module is not valid SPIR-V, nothing to reflect..");
+        return reflected;
+    }
+
+    Module module{};
+    for (size_t i = 5; i < wordCount;) {
+        uint32_t op = words[i] & 0xFFFF;
+        uint32_t count = words[i] >> 16;
+        if (count == 0 || i + count > wordCount) { break; }
+        const uint32_t* operands = &words[i + 1];
+
+        switch (op) {
+        case OpEntryPoint:
+            module.stage |= stageFromModel(operands[0]);
+            break;
+        case OpTypeInt: case OpTypeFloat: case OpTypeVector: case OpTypeMatrix: case OpTypeImage:
+        case OpTypeSampler: case OpTypeSampledImage: case OpTypeArray: case OpTypeRuntimeArray:
+        case OpTypeStruct: case OpTypePointer:
+            module.types[operands[0]] = { op, std::vector<uint32_t>(operands + 1, operands + count - 1) };
+            break;
+        case OpConstant:
+            module.constants[operands[1]] = operands[2];
+            break;
+        case OpVariable:
+            module.variables.push_back({ operands[0], operands[1] });
+            break;
+        case OpDecorate:
+            if (operands[1] == DecorationBinding) { module.bindings[operands[0]] = operands[2]; }
+            else if (operands[1] == DecorationDescriptorSet) { module.sets[operands[0]] = operands[2]; }
+            else if (operands[1] == DecorationArrayStride) { module.strides[operands[0]] = operands[2]; }
+            else if (operands[1] == DecorationBlock || operands[1] == DecorationBufferBlock) { module.blocks[operands[0]] = operands[1]; }
+            break;
+        case OpMemberDecorate:
+            if (operands[2] == DecorationOffset) { module.offsets[operands[0]][operands[1]] = operands[3]; }
+            else if (operands[2] == DecorationMatrixStride) { module.matrixStrides[operands[0]][operands[1]] = operands[3]; }
+            break;
+        }
+
+        i += count;
+    }
+
+    for (auto& [pointerId, variable] : module.variables) {
+        auto pointer = module.types.find(pointerId);
+        if (pointer == module.types.end() || pointer->second.op != OpTypePointer) { continue; }
+
+        uint32_t storage = pointer->second.operands[0];
+        uint32_t typeId = pointer->second.operands[1];
+
+        if (storage == StorageClassPushConstant) {
+            VkPushConstantRange range{};
+            range.stageFlags = module.stage;
+            range.offset = 0;
+            range.size = sizeOf(module, typeId);
+            reflected.pushConstants.push_back(range);
+            continue;
+        }
+
+        auto binding = module.bindings.find(variable);
+        if (binding == module.bindings.end()) { continue; }
+
+        auto set = module.sets.find(variable);
+        if (set != module.sets.end() && set->second != 0) { continue; }
+
+        // Arrays are unwrapped down to the descriptor type, runtime arrays become variable count bindings.
+        uint32_t descriptorCount = 1;
+        VkDescriptorBindingFlags flags = 0;
+        auto pointee = module.types.find(typeId);
+        if (pointee == module.types.end()) { continue; }
+
+        const Type* type = &pointee->second;
+        if (type->op == OpTypeArray) {
+            auto length = module.constants.find(type->operands[1]);
+            descriptorCount = length != module.constants.end() ? length->second : 1;
+            typeId = type->operands[0];
+        } else if (type->op == OpTypeRuntimeArray) {
+            descriptorCount = maxVariableCount;
+            flags = VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT;
+            typeId = type->operands[0];
+        }
+
+        VkDescriptorSetLayoutBinding layoutBinding{};
+        if (!descriptorType(module, storage, typeId, layoutBinding.descriptorType)) { continue; }
+        layoutBinding.binding = binding->second;
+        layoutBinding.descriptorCount = descriptorCount;
+        layoutBinding.stageFlags = module.stage;
+        layoutBinding.pImmutableSamplers = nullptr;
+
+        reflected.bindings.push_back(layoutBinding);
+        reflected.flags.push_back(flags);
+    }
+
+    return reflected;
+}
+
+// Folds the interface of another stage in, bindings that appear in both get both stage flags.
+void Adren::Reflection::merge(Interface& into, const Interface& other) {
+    for (size_t b = 0; b < other.bindings.size(); b++) {
+        auto found = std::find_if(into.bindings.begin(), into.bindings.end(),
+            [&](const VkDescriptorSetLayoutBinding& binding) { return binding.binding == other.bindings[b].binding; });
+
+        if (found != into.bindings.end()) {
+            found->stageFlags |= other.bindings[b].stageFlags;
+        } else {
+            into.bindings.push_back(other.bindings[b]);
+            into.flags.push_back(other.flags[b]);
+        }
+    }
+
+    // Every stage's push constants are declared as one range starting at 0, so the ranges are merged the same way.
+    for (const auto& range : other.pushConstants) {
+        if (into.pushConstants.empty()) {
+            into.pushConstants.push_back(range);
+        } else {
+            into.pushConstants[0].stageFlags |= range.stageFlags;
+            into.pushConstants[0].size = std::max(into.pushConstants[0].size, range.size);
+        }
+    }
+
+    // Variable count bindings have to be the highest binding in the set.
+    std::vector<size_t> order(into.bindings.size());
+    for (size_t i = 0; i < order.size(); i++) { order[i] = i; }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return into.bindings[a].binding < into.bindings[b].binding; });
+
+    Interface sorted{};
+    for (size_t i : order) {
+        sorted.bindings.push_back(into.bindings[i]);
+        sorted.flags.push_back(into.flags[i]);
+    }
+    into.bindings = sorted.bindings;
+    into.flags = sorted.flags;
+}
+
+// Reflection can't tell a uniform buffer that is meant to be bound with a dynamic offset apart from a regular one.
+void Adren::Reflection::Interface::makeDynamic(uint32_t binding) {
+    for (auto& layoutBinding : bindings) {
+        if (layoutBinding.binding == binding && layoutBinding.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) {
+            layoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        }
+    }
+}
+
+VkDescriptorSetLayout Adren::Reflection::setLayout(const Interface& reflected) {
+    // The whole description is the key, two interfaces only share a layout when every binding matches.
+    Key key;
+    for (size_t b = 0; b < reflected.bindings.size(); b++) {
+        const auto& binding = reflected.bindings[b];
+        key.insert(key.end(), { binding.binding, static_cast<uint64_t>(binding.descriptorType), binding.descriptorCount, binding.stageFlags, reflected.flags[b] });
+    }
+
+    auto found = setLayouts.find(key);
+    if (found != setLayouts.end()) { return found->second; }
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlags{};
+    bindingFlags.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    bindingFlags.bindingCount = static_cast<uint32_t>(reflected.flags.size());
+    bindingFlags.pBindingFlags = reflected.flags.data();
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(reflected.bindings.size());
+    layoutInfo.pBindings = reflected.bindings.data();
+    layoutInfo.pNext = &bindingFlags;
+
+    VkDescriptorSetLayout layout;
+    Adren::Tools::vibeCheck("DESCRIPTOR SET LAYOUT", vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &layout));
+    setLayouts.emplace(std::move(key), layout);
+
+    return layout;
+}
+
+VkPipelineLayout Adren::Reflection::pipelineLayout(VkDescriptorSetLayout set, const Interface& reflected) {
+    Key key = { (uint64_t)set };
+    for (const auto& range : reflected.pushConstants) {
+        key.insert(key.end(), { range.stageFlags, range.offset, range.size });
+    }
+
+    auto found = pipelineLayouts.find(key);
+    if (found != pipelineLayouts.end()) { return found->second; }
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &set;
+    pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(reflected.pushConstants.size());
+    pipelineLayoutInfo.pPushConstantRanges = reflected.pushConstants.data();
+
+    VkPipelineLayout layout;
+    Adren::Tools::vibeCheck("PIPELINE LAYOUT", vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &layout));
+    pipelineLayouts.emplace(std::move(key), layout);
+
+    return layout;
+}
+
+void Adren::Reflection::cleanup() {
+    for (auto& [key, layout] : pipelineLayouts) { vkDestroyPipelineLayout(device, layout, nullptr); }
+    for (auto& [key, layout] : setLayouts) { vkDestroyDescriptorSetLayout(device, layout, nullptr); }
+
+    pipelineLayouts.clear();
+    setLayouts.clear();
+}
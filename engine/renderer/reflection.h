@@ -0,0 +1,44 @@
+/*
+	reflection.h
+	Adrenaline Engine
+
+	This reads the interface of SPIR-V modules so descriptor set layouts and push constant ranges
+	don't have to be written out by hand. Layouts are cached so identical interfaces share them.
+*/
+
+#pragma once
+#include <map>
+#include "devices.h"
+
+namespace Adren {
+class Reflection {
+public:
+	Reflection(Devices& devices) : device(devices.device) {}
+
+	// Only descriptor set 0 is used by the engine, bindings in other sets are ignored.
+	struct Interface {
+		std::vector<VkDescriptorSetLayoutBinding> bindings;
+		std::vector<VkDescriptorBindingFlags> flags;
+		std::vector<VkPushConstantRange> pushConstants;
+
+		void makeDynamic(uint32_t binding);
+	};
+
+	static Interface reflect(const std::vector<char>& code);
+	static void merge(Interface& into, const Interface& other);
+
+	VkDescriptorSetLayout setLayout(const Interface& reflected);
+	VkPipelineLayout pipelineLayout(VkDescriptorSetLayout set, const Interface& reflected);
+	void cleanup();
+
+	// Runtime sized arrays (textures[]) are given this many descriptors at most.
+	static const uint32_t maxVariableCount = 2048;
+private:
+	// Every field of the bindings or push constant ranges the layout was made from, in order.
+	using Key = std::vector<uint64_t>;
+
+	VkDevice& device;
+	std::map<Key, VkDescriptorSetLayout> setLayouts;
+	std::map<Key, VkPipelineLayout> pipelineLayouts;
+};
+}
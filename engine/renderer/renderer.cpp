@@ -9,10 +9,15 @@
 #define VMA_IMPLEMENTATION
 #define VMA_STATIC_VULKAN_FUNCTIONS 0
 #define VMA_DYNAMIC_VULKAN_FUNCTIONS 1
+#define STB_IMAGE_WRITE_IMPLEMENTATION
 
 #include "renderer.h"
 #include "info.h"
 #include "tools.h"
+#include "core/profiler.h"
+#include "core/allocations.h"
+#include "tinygltf/stb_image_write.h"
+#include <algorithm>
 #include <chrono>
 
 
@@ -49,32 +54,46 @@ void Adren::Renderer::createInstance() {
 }
 
 void Adren::Renderer::initVulkan() {
+    ADREN_PROFILE_FUNCTION();
     Adren::Tools::log("Initializing program..");
+    devices.headless = headless;
     createInstance(); Adren::Tools::log("Instance created..");
 
 #ifdef DEBUG
     debugging.setup(); Adren::Tools::log("Debug messenger set up..");
 #endif
 
-    glfwCreateWindowSurface(instance, window, nullptr, &surface); Adren::Tools::log("Surface created..");
-    devices.pickGPU(); Adren::Tools::log("Graphics Processing Unit chosen..");
-    devices.createLogicalDevice(); Adren::Tools::log("Logical device created..");
-    devices.createAllocator(); Adren::Tools::log("Memory allocator created..");
-    swapchain.create(surface); Adren::Tools::log("Swapchain created..");
-    swapchain.createImageViews(images); Adren::Tools::log("Image views created..");
+    // Headless the frames only go into the offscreen target, one slot per frame in flight stands in for the images.
+    if (headless) {
+        surface = VK_NULL_HANDLE;
+        devices.pickGPU(); Adren::Tools::log("Graphics Processing Unit chosen without a surface..");
+        devices.createLogicalDevice(); Adren::Tools::log("Logical device created..");
+        devices.createAllocator(); Adren::Tools::log("Memory allocator created..");
+        swapchain.createHeadless({ static_cast<uint32_t>(camera.width), static_cast<uint32_t>(camera.height) }, maxFramesInFlight); Adren::Tools::log("Headless frame slots created..");
+    } else {
+        glfwCreateWindowSurface(instance, window, nullptr, &surface); Adren::Tools::log("Surface created..");
+        devices.pickGPU(); Adren::Tools::log("Graphics Processing Unit chosen..");
+        devices.createLogicalDevice(); Adren::Tools::log("Logical device created..");
+        devices.createAllocator(); Adren::Tools::log("Memory allocator created..");
+        swapchain.create(surface); Adren::Tools::log("Swapchain created..");
+        swapchain.createImageViews(images); Adren::Tools::log("Image views created..");
+    }
+
     images.createDepthResources(swapchain.extent); Adren::Tools::log("Depth resources created..");
     renderpass.create(images.depth, swapchain.imgFormat, instance); Adren::Tools::log("Main render pass created..");
-    descriptor.createLayout(models); Adren::Tools::log("Descriptor set layout created..");
+    pipeline.loadShaders(); Adren::Tools::log("Shaders loaded and reflected..");
+    descriptor.createLayout(pipeline.reflected); Adren::Tools::log("Descriptor set layout created..");
     pipeline.create(swapchain, descriptor.layout, renderpass.handle); Adren::Tools::log("Graphics pipeline created..");
+    indirect.create(pipeline); Adren::Tools::log("Culling compute passes created..");
+    timing.create(); Adren::Tools::log("GPU timers created..");
     processing.createCommands(surface, instance); Adren::Tools::log("Command pool and buffers created..");
     processing.createSyncObjects(); Adren::Tools::log("Sync objects created..");
-    swapchain.createFramebuffers(images.depth, renderpass.handle); Adren::Tools::log("Main framebuffers created..");
-    images.loadTextures(textures, processing.commandPool); Adren::Tools::log("Model textures created..");
-    buffers.createModelBuffers(models, processing.commandPool); Adren::Tools::log("Index buffers created..");
+    if (!headless) { swapchain.createFramebuffers(images.depth, renderpass.handle); Adren::Tools::log("Main framebuffers created.."); }
+    upload(); Adren::Tools::log("Model textures and geometry uploaded..");
     buffers.createUniformBuffers(swapchain.images, models); Adren::Tools::log("Uniform buffers created..");
-    buffers.updateDynamicUniformBuffer(models);
-    descriptor.createPool(swapchain.images); Adren::Tools::log("Descriptor pool created..");
-    descriptor.createSets(textures, swapchain.images); Adren::Tools::log("Descriptor sets created..");
+    buildScene(); Adren::Tools::log("Scene entities, draws and bounds built..");
+    descriptor.createPool(); Adren::Tools::log("Descriptor pool created..");
+    descriptor.createSets(textures); Adren::Tools::log("Descriptor sets created..");
 
 #ifdef DEBUG
         Adren::Tools::label(instance, devices.device, VK_OBJECT_TYPE_COMMAND_POOL, (uint64_t)processing.commandPool, "PRIMARY COMMAND POOL");
@@ -82,44 +101,379 @@ void Adren::Renderer::initVulkan() {
 #endif
 }
 
+// Flattens the node trees of every placement, uploads every transform and respawns the scene's entities from them.
+// Placements of the same model share its geometry and textures and only get their own node slots. Returns whether
+// the dynamic uniform buffer had to grow, in which case the descriptor sets need writing again.
+bool Adren::Renderer::buildScene() {
+    ADREN_PROFILE_FUNCTION();
+    Allocations::Scope charged(Allocations::Subsystem::Scene);
+    std::vector<Transforms::Placed> placed;
+    std::vector<uint32_t> instances;
+    world.each<Placement, Asset>([&](ECS::Entity, Placement& placement, Asset& asset) {
+        asset.instance = asset.model < models.size() ? static_cast<uint32_t>(placed.size()) : UINT32_MAX;
+        if (asset.model < models.size()) {
+            placed.push_back({ asset.model, placement.matrix() });
+            instances.push_back(asset.model);
+        }
+        placement.moved = false;
+    });
+
+    transforms.build(models, placed);
+
+    bool resized = transforms.world.size() * buffers.dynamicUniform.align > buffers.dynamicRegion;
+    if (resized) {
+        wait();
+        buffers.createDynamicUniformBuffer(static_cast<uint32_t>(transforms.world.size()));
+    }
+
+    buffers.markDynamicUniformBuffer(0, static_cast<uint32_t>(transforms.world.size()));
+    scene.build(world, models, instances, transforms.world, buffers.dynamicUniform.align);
+    matrices = transforms.world;
+    occlusion.build(models, scene);
+    indirect.build(scene, camera.width, camera.height);
+    instancing.build(scene);
+
+    rebuild = false;
+    return resized;
+}
+
+// The main thread's half of a frame: input, placements moved in the editor and the transforms they change. The
+// scene itself is left alone since the render thread may still be drawing the frame before.
 void Adren::Renderer::process(GLFWwindow* window) {
-    if (camera.toggled) { buffers.updateUniformBuffer(camera, swapchain.extent); processInput(window, camera); }
-    processing.render(buffers, pipeline, descriptor, swapchain, renderpass, gui);
+    ADREN_PROFILE_FUNCTION();
+    auto start = std::chrono::steady_clock::now();
+
+    // Whether the camera has the mouse is part of what gets recorded, a replay takes it from the log.
+    if (input.replaying()) { camera.toggled = input.focused(); } else { input.focus(camera.toggled); }
+
+    // Headless runs take exactly one tick a frame so they come out the same every time, replays step by whatever
+    // each frame of the recording did.
+    double now = headless ? 0.0 : glfwGetTime();
+    simulate(input.step(headless ? 1.0 / std::max(settings.tickRate, 1u) : now - clock.last));
+    clock.last = now;
+
+    // Another placement of a model that is already loaded only needs its entities and slots, not a new upload.
+    if (rebuild) {
+        drain();
+        if (buildScene()) { descriptor.createSets(textures); }
+        stats.picked = -1;
+    }
+
+    // Only the subtrees of models moved in the editor are recomputed, the render thread uploads their slots.
+    world.each<Placement, Asset>([&](ECS::Entity, Placement& placement, Asset& asset) {
+        if (placement.moved && asset.instance < transforms.instances()) { transforms.move(asset.instance, placement.matrix()); }
+        placement.moved = false;
+    });
+
+    bool moved = transforms.update();
+    double simulation = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    publish(moved ? transforms.first : 0, moved ? transforms.count : 0, simulation);
+}
+
+// Steps the simulation as many whole ticks as the elapsed time covers, so a slow frame runs more ticks instead of
+// longer ones. A frame longer than a quarter second is cut short rather than catching up on all of it at once.
+// Without a fixed step the simulation takes one step of whatever the frame took, like it used to.
+void Adren::Renderer::simulate(double elapsed) {
+    stats.ticks = 0;
+
+    if (!settings.fixedStep) {
+        if (camera.toggled) { processInput(camera, static_cast<float>(elapsed)); }
+        clock.accumulator = 0.0;
+        clock.previous = camera.pos;
+        clock.alpha = 1.0f;
+        stats.ticks = 1;
+        return;
+    }
+
+    double step = 1.0 / std::max(settings.tickRate, 1u);
+    clock.accumulator += std::min(elapsed, 0.25);
+    while (clock.accumulator >= step) {
+        clock.previous = camera.pos;
+        if (camera.toggled) { processInput(camera, static_cast<float>(step)); }
+        clock.accumulator -= step;
+        stats.ticks++;
+    }
+
+    clock.alpha = static_cast<float>(clock.accumulator / step);
+}
+
+// Waits for the render thread to be done with the older snapshot, takes back its stats and fills it with this
+// frame. With two snapshots the main thread runs at most one frame ahead of what is being drawn.
+void Adren::Renderer::publish(uint32_t first, uint32_t count, double simulation) {
+    std::unique_lock<std::mutex> lock(mutex);
+    {
+        ADREN_PROFILE_SCOPE("Wait for render thread");
+        handoff.wait(lock, [this] { return published - finished < 2; });
+    }
+    Snapshot& snapshot = snapshots[published % 2];
+    lock.unlock();
+
+    // The pick and the tick count belong to the main thread, unless the render thread just picked something.
+    if (snapshot.filled) {
+        uint32_t ticks = stats.ticks;
+        int32_t picked = stats.picked;
+        stats = snapshot.stats;
+        stats.ticks = ticks;
+        if (!snapshot.click.pending) { stats.picked = picked; }
+        if (settings.measureRecording) { measureRecording(snapshot.settings); }
+    }
+
+    // The camera is drawn where it is part way between the last two ticks, not where the last tick left it.
+    snapshot.camera = camera;
+    snapshot.camera.pos = glm::mix(clock.previous, camera.pos, clock.alpha);
+    snapshot.settings = settings;
+    snapshot.click = gui.click;
+    snapshot.moved.assign(transforms.world.begin() + first, transforms.world.begin() + first + count);
+    snapshot.first = first;
+    snapshot.count = count;
+    snapshot.simulation = simulation;
+    snapshot.capture = std::move(screenshot);
+    snapshot.stats = stats;
+    snapshot.filled = true;
+    screenshot.clear();
+    gui.click.pending = false;
+    if (!headless) { gui.capture(snapshot.draws); }
+
+    lock.lock();
+    published++;
+    lock.unlock();
+    handoff.notify_all();
+}
+
+void Adren::Renderer::renderLoop() {
+    ADREN_PROFILE_THREAD("Render");
+    Allocations::charge(Allocations::Subsystem::Renderer);
+    while (true) {
+        std::unique_lock<std::mutex> lock(mutex);
+        handoff.wait(lock, [this] { return stopping || finished < published; });
+        if (finished == published) { return; }
+
+        Snapshot& snapshot = snapshots[finished % 2];
+        lock.unlock();
+
+        draw(snapshot);
+
+        lock.lock();
+        finished++;
+        lock.unlock();
+        handoff.notify_all();
+    }
+}
+
+// The render thread's half of a frame, everything that reads the scene or records and submits GPU work.
+void Adren::Renderer::draw(Snapshot& snapshot) {
+    ADREN_PROFILE_FUNCTION();
+    auto start = std::chrono::steady_clock::now();
+    const Settings& settings = snapshot.settings;
+    RenderStats& stats = snapshot.stats;
+
+    // Counted across every thread from one frame's start to the next, so the main thread's half, the workers and
+    // the last frame's recording are all in it. Once nothing changes from frame to frame this should stay at 0,
+    // anything else is a temporary that belongs in the arena or a pool.
+    uint64_t allocations = Allocations::count();
+    stats.allocations = static_cast<uint32_t>(allocations - allocated);
+    allocated = allocations;
+    rendered = snapshot.camera;
+    processing.begin();
+
+    if (snapshot.count > 0) {
+        ADREN_PROFILE_SCOPE("Upload and refit moved transforms");
+        std::copy(snapshot.moved.begin(), snapshot.moved.end(), matrices.begin() + snapshot.first);
+        buffers.markDynamicUniformBuffer(snapshot.first, snapshot.count);
+        scene.refit(world, workers, matrices, snapshot.first, snapshot.count);
+        indirect.refit(scene, snapshot.first, snapshot.count);
+    }
+
+    // Also catches this frame's copy up on slots that moved while the other frames were drawn.
+    buffers.updateDynamicUniformBuffer(matrices, static_cast<uint32_t>(processing.currentFrame));
+
+    buffers.updateUniformBuffer(rendered, swapchain.extent, static_cast<uint32_t>(processing.currentFrame));
+
+    bool gpu = settings.gpuCulling && indirect.supported;
+    auto culling = std::chrono::steady_clock::now();
+    if (!gpu) {
+        ADREN_PROFILE_SCOPE("Cull and sort");
+        glm::mat4 viewProj = rendered.projection() * rendered.view();
+        scene.cull(viewProj, settings, stats);
+        stats.occluded = 0;
+        if (settings.softwareOcclusion) { occlusion.cull(viewProj, scene, stats); }
+        if (settings.sortDraws) { scene.sort(rendered.pos, rendered.drawDistance * 1000.0f); }
+    }
+
+    double cullMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - culling).count();
+
+    if (snapshot.click.pending) {
+        stats.picked = scene.pick(rendered.projection() * rendered.view(), snapshot.click.x, snapshot.click.y);
+    }
+
+    processing.capture = !snapshot.capture.empty();
+    processing.render(buffers, pipeline, descriptor, swapchain, renderpass, gui, scene, indirect, instancing, settings, &snapshot.draws.data, timing);
+    if (!snapshot.capture.empty()) { save(snapshot.capture); }
+    stats.recorded = processing.counters;
+    stats.recorders = processing.recorders();
+    stats.recording = static_cast<float>(processing.recording);
+
+    // The GPU count is read back a few frames late, which is close enough for the editor.
+    if (gpu) {
+        stats.draws = static_cast<uint32_t>(scene.draws.size());
+        stats.drawn = indirect.drawn;
+        stats.culled = stats.draws - std::min(stats.drawn, stats.draws);
+        stats.occluded = 0;
+        stats.gpu = true;
+    }
+
+    // Simulation is the main thread's half of this frame, the rest all happened on the render thread.
+    timing.cpu("Simulation", snapshot.simulation);
+    timing.cpu("Cull and sort", cullMs);
+    timing.cpu("Recording", processing.recording);
+    timing.cpu("Render thread", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    timing.fill(stats);
+
+    memory.update(stats.gpuMemory);
+    stats.memory = 0;
+    for (const HeapStats& heap : stats.gpuMemory.heaps) { stats.memory += heap.allocated; }
+
+    stats.arena = processing.arena().used();
+}
+
+// Waits on the frame just submitted, which is fine for the occasional dump but not something to do every frame.
+void Adren::Renderer::save(const std::string& path) {
+    ADREN_PROFILE_FUNCTION();
+    std::vector<uint8_t> pixels;
+    if (!processing.readback(pixels)) {
+        Adren::Tools::log("Frames can only be saved when running headless..");
+        return;
+    }
+
+    if (!stbi_write_png(path.c_str(), rendered.width, rendered.height, 4, pixels.data(), rendered.width * 4)) {
+        Adren::Tools::log("Could not write the frame to " + path + "..");
+    }
+}
+
+void Adren::Renderer::record() {
+    // The replay starts from an empty accumulator, so the recording has to as well.
+    input.record(settings.tickRate, settings.fixedStep, camera.state());
+    clock.previous = camera.pos;
+    clock.accumulator = 0.0;
+    Adren::Tools::log("Recording input..");
+}
+
+bool Adren::Renderer::replay(const std::string& path) {
+    if (!input.replay(path)) {
+        Adren::Tools::log("Could not read the input log " + path + "..");
+        return false;
+    }
+
+    camera.restore(input.start());
+    clock.previous = camera.pos;
+    clock.accumulator = 0.0;
+    settings.tickRate = input.tickRate();
+    settings.fixedStep = input.fixedStep();
+    Adren::Tools::log("Replaying " + std::to_string(input.frames()) + " frames of input from " + path + "..");
+    return true;
+}
+
+void Adren::Renderer::drain() {
+    std::unique_lock<std::mutex> lock(mutex);
+    handoff.wait(lock, [this] { return finished == published; });
+}
+
+void Adren::Renderer::stop() {
+    if (!renderThread.joinable()) { return; }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+
+    handoff.notify_all();
+    renderThread.join();
+}
+
+// Logs the average time to record the scene with every thread count, then puts the setting back how it was. The
+// stats come back a frame or two late, so frames recorded with the thread count before are left out.
+void Adren::Renderer::measureRecording(const Settings& recorded) {
+    const uint32_t frames = 120;
+
+    if (sweep.threads == 0) {
+        sweep = { 1, 0, 0.0, settings.recordThreads };
+        settings.recordThreads = 1;
+        return;
+    }
+
+    if (recorded.recordThreads != sweep.threads) { return; }
+
+    sweep.total += stats.recording;
+    if (++sweep.frames < frames) { return; }
+
+    Adren::Tools::log("Recording with " + std::to_string(sweep.threads) + " threads took " + std::to_string(sweep.total / frames) + " ms a frame..");
+
+    if (sweep.threads < processing.recorders()) {
+        sweep = { sweep.threads + 1, 0, 0.0, sweep.restore };
+        settings.recordThreads = sweep.threads;
+    } else {
+        settings.recordThreads = sweep.restore;
+        settings.measureRecording = false;
+        sweep = {};
+    }
 }
 
 void Adren::Renderer::init(GLFWwindow* window) { 
     initVulkan();
-    gui.init(window, surface); 
+    if (headless) { gui.createTargets(surface); } else { gui.init(window, surface); }
+
+    // None of these need the device idle, whatever the GPU may still be using is retired until its frames are done.
+    gui.drain = [this] { drain(); };
+    gui.retire = [this](std::function<void()> destroy) { processing.retire(std::move(destroy)); };
+    indirect.retire = gui.retire;
+    descriptor.retire = gui.retire;
+    processing.recreate = [this] { return recreateSwapchain(); };
+
+    clock.last = headless ? 0.0 : glfwGetTime();
+    clock.previous = camera.pos;
+    renderThread = std::thread(&Renderer::renderLoop, this);
 }
 
 void Adren::Renderer::cleanup() {
+    stop();
+    wait();
+    for (Snapshot& snapshot : snapshots) { gui.release(snapshot.draws); }
+
     buffers.cleanup();
     processing.cleanup();
     swapchain.cleanup();
     descriptor.cleanup();
+    indirect.cleanup();
+    instancing.cleanup();
+    timing.cleanup();
+    pipeline.cleanup();
+    reflection.cleanup();
     gui.cleanup(); 
 
 #ifdef DEBUG 
     debugging.cleanup();
 #endif
 
-    for (auto& m : models) {
-        for (auto& tex : m.textures) {
-            vkDestroyImageView(devices.device, tex.view, nullptr);
-            vmaDestroyImage(devices.allocator, tex.image, tex.memory);
-        }
+    for (auto& tex : textures) {
+        vkDestroyImageView(devices.device, tex.view, nullptr);
+        Memory::destroyImage(devices.allocator, tex.image, tex.memory);
     }
 
     devices.cleanup();
 
-    glfwDestroyWindow(window);
-    vkDestroySurfaceKHR(instance, surface, nullptr);
-    glfwTerminate();
+    if (!headless) {
+        glfwDestroyWindow(window);
+        vkDestroySurfaceKHR(instance, surface, nullptr);
+        glfwTerminate();
+    }
 
     vkDestroyInstance(instance, nullptr);
 }
 
 void Adren::Renderer::reloadScene(std::vector<Model>& models) {
+    ADREN_PROFILE_FUNCTION();
+    drain();
+
     /*
         This function would be the basis of model loading, as buffers and descriptors get updated
         when there is a new model. This is experimental and may be causing lots of performance issues
@@ -127,74 +481,126 @@ void Adren::Renderer::reloadScene(std::vector<Model>& models) {
         What this does is re-render the entire screen when new elements are in. 
     */
     
-    vmaDestroyBuffer(devices.allocator, buffers.index.buffer, buffers.index.memory);
-    vmaDestroyBuffer(devices.allocator, buffers.vertex.buffer, buffers.vertex.memory);
-    vmaDestroyBuffer(devices.allocator, buffers.dynamicUniform.buffer, buffers.dynamicUniform.memory);
+    upload();
 
-    buffers.createModelBuffers(models, processing.commandPool);
+    // Grows the dynamic uniform buffer itself when the placements need more node slots than it has.
+    buildScene();
+    stats.picked = -1;
 
-    VkPhysicalDeviceProperties gpuProperties{};
-    vkGetPhysicalDeviceProperties(devices.gpu, &gpuProperties);
-    VkDeviceSize minUboAlignment = gpuProperties.limits.minUniformBufferOffsetAlignment;
-    buffers.dynamicUniform.align = sizeof(glm::mat4);
-    if (minUboAlignment > 0) {
-        buffers.dynamicUniform.align = (buffers.dynamicUniform.align + minUboAlignment - 1) & ~(minUboAlignment - 1);
-    }
+    descriptor.createSets(textures);
+}
 
-    uint32_t modelSize = 0;
-    for (Model& model : models) {
-        for (Model::Node& node : model.nodes) {
-            model.count(modelSize, node.children);
-            modelSize++;
-        }
+// Models go to the GPU once, after which everything the GPU has its own copy of is released on the CPU.
+void Adren::Renderer::upload() {
+    ADREN_PROFILE_FUNCTION();
+    for (const Model& model : models) {
+        if (!model.resident) { images.loadTextures(model, textures, processing.commandPool); }
     }
 
-    buffers.dynamicUniform.size = buffers.dynamicUniform.align * modelSize;
-    buffers.uboData.model = (glm::mat4*)Adren::Tools::alignedAlloc(buffers.dynamicUniform.size, buffers.dynamicUniform.align);
-    assert(buffers.uboData.model);
+    buffers.createModelBuffers(models, processing.commandPool);
 
-    buffers.createBuffer(devices.allocator, buffers.dynamicUniform.size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, buffers.dynamicUniform, VMA_MEMORY_USAGE_AUTO);
-    vmaMapMemory(devices.allocator, buffers.dynamicUniform.memory, &buffers.dynamicUniform.mapped);
-    memcpy(buffers.dynamicUniform.mapped, buffers.uboData.model, buffers.dynamicUniform.size);
+    for (Model& model : models) {
+        if (model.resident) { continue; }
 
-    descriptor.createSets(textures, swapchain.images);
+        size_t held = model.footprint();
+        model.release();
+        Tools::log("Released " + std::to_string((held - model.footprint()) / (1024.0 * 1024.0)) + " MB of " + model.path + " after upload, "
+            + std::to_string(model.footprint() / (1024.0 * 1024.0)) + " MB kept for occlusion..");
+    }
+}
+
+// Runs on the render thread between frames when the window's surface has changed. The new swapchain is built from
+// the old one, and the old views, framebuffers, depth buffer and handle are retired instead of waited on.
+bool Adren::Renderer::recreateSwapchain() {
+    ADREN_PROFILE_FUNCTION();
+    VkSwapchainKHR old = swapchain.handle;
+    if (!swapchain.create(surface)) { return false; }
+
+    std::vector<VkImageView> views;
+    std::vector<VkFramebuffer> framebuffers;
+    views.swap(swapchain.views);
+    framebuffers.swap(swapchain.framebuffers);
+    Image depth = images.depth;
+
+    swapchain.createImageViews(images);
+    images.createDepthResources(swapchain.extent);
+    swapchain.createFramebuffers(images.depth, renderpass.handle);
+
+    VkDevice device = devices.device;
+    VmaAllocator allocator = devices.allocator;
+    processing.retire([device, allocator, old, views, framebuffers, depth] {
+        for (VkFramebuffer framebuffer : framebuffers) { vkDestroyFramebuffer(device, framebuffer, nullptr); }
+        for (VkImageView view : views) { vkDestroyImageView(device, view, nullptr); }
+        vkDestroyImageView(device, depth.view, nullptr);
+        Memory::destroyImage(allocator, depth.image, depth.memory);
+        vkDestroySwapchainKHR(device, old, nullptr);
+    });
+
+    Tools::log("Swapchain recreated at " + std::to_string(swapchain.extent.width) + "x" + std::to_string(swapchain.extent.height) + "..");
+    return true;
 }
 
-void Adren::Renderer::processInput(GLFWwindow* window, Camera& camera) {
-    float currentFrame = glfwGetTime();
-    float deltaTime = currentFrame - lastFrame;
-    lastFrame = currentFrame;
+void Adren::Renderer::processInput(Camera& camera, float deltaTime) {
     float speed = camera.speed * deltaTime;
 
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
+    if (input.down(GLFW_KEY_W)) {
         camera.pos += speed * camera.front;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
+    if (input.down(GLFW_KEY_S)) {
         camera.pos -= speed * camera.front;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
+    if (input.down(GLFW_KEY_A)) {
         camera.pos -= glm::normalize(glm::cross(camera.front, camera.up)) * speed;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
+    if (input.down(GLFW_KEY_D)) {
         camera.pos += glm::normalize(glm::cross(camera.front, camera.up)) * speed;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS) {
+    if (input.down(GLFW_KEY_SPACE)) {
         camera.pos += speed * camera.up;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS) {
+    if (input.down(GLFW_KEY_LEFT_CONTROL)) {
         camera.pos -= speed * camera.up;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_DELETE) == GLFW_PRESS) {
+    if (input.down(GLFW_KEY_DELETE)) {
         cleanup();
     }
 }
 
+// The model is loaded as an asset and placed at the origin, the next scene reload spawns its entities. A path that
+// is already loaded only gets another placement of the same asset.
 void Adren::Renderer::addModel(std::string& path) {
-    models.push_back(path);
+    drain();
+
+    auto loaded = std::find_if(models.begin(), models.end(), [&path](const Model& model) { return model.path == path; });
+    if (loaded != models.end()) {
+        world.create(Placement{}, Asset{ static_cast<uint32_t>(loaded - models.begin()) });
+        rebuild = true;
+        return;
+    }
+
+    // Loading parses the whole glTF document, keeps what is converted out of it and drops the document again.
+    Allocations::Report before = Allocations::usage();
+    {
+        Allocations::Scope charged(Allocations::Subsystem::Assets);
+        models.push_back(path);
+    }
+
+    world.create(Placement{}, Asset{ static_cast<uint32_t>(models.size() - 1) });
+
+    if (Allocations::tracking()) {
+        Allocations::Report after = Allocations::usage();
+        size_t documents = static_cast<size_t>(Allocations::Subsystem::Documents);
+        size_t assets = static_cast<size_t>(Allocations::Subsystem::Assets);
+        double parsed = (after[documents].allocated - before[documents].allocated) / (1024.0 * 1024.0);
+        double kept = static_cast<int64_t>(after[assets].live - before[assets].live) / (1024.0 * 1024.0);
+
+        Tools::log("Loaded " + path + ", parsed through " + std::to_string(parsed) + " MB as the glTF document and kept "
+            + std::to_string(kept) + " MB converted from it..");
+    }
 }
\ No newline at end of file
@@ -8,12 +8,17 @@
 #pragma once
 #include <iostream>
 #include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include "config.h"
 #include "model.h"
 #include "camera.h"
 #include "debugging.h"
 #include "processing.h" // Has all the other components included
+#include "transforms.h"
+#include "input.h"
 
 namespace Adren {
 class Renderer {
@@ -26,19 +31,105 @@ public:
     void reloadScene(std::vector<Model>& models);
     void wait() { vkDeviceWaitIdle(devices.device); }
     void addModel(std::string& path);
+
+    // Blocks until the render thread has drawn everything handed to it, after which the scene and GPU resources
+    // are safe to change from the main thread.
+    void drain();
+    void stop();
+
+    // Saves the next frame drawn as a PNG. Only headless, where the scene's color target is what would be shown.
+    void capture(const std::string& path) { screenshot = path; }
+
+    // Set before init. No surface, swapchain or ImGui, and the simulation steps one tick per frame so runs repeat.
+    bool headless = false;
+
+    // Records input from the next frame on, saving stops the recording. Replaying puts the camera back where the
+    // recording started and steps the simulation by the times each recorded frame took, at the recorded tick rate
+    // and timestep mode, until the log runs out.
+    void record();
+    bool replay(const std::string& path);
+
+    // Heaps, categories and every allocation by name as JSON. Can be called while the render thread draws.
+    bool saveMemory(const std::string& path) const { return memory.save(path); }
+
     Camera camera;
+    RenderStats stats;
+    Settings settings;
+    Scene scene;
     std::vector<Model> models;
-    GUI gui{devices, buffers, images, swapchain, instance, camera}; 
+    ECS::World world;
+    Input input;
+    GUI gui{devices, buffers, images, swapchain, instance, camera, input}; 
 private:
     void createInstance();
     void initVulkan();
-    void processInput(GLFWwindow* window, Camera& camera);
+    bool buildScene();
+    void upload();
+    bool recreateSwapchain();
+    void simulate(double elapsed);
+    void processInput(Camera& camera, float deltaTime);
+    void measureRecording(const Settings& recorded);
     std::vector<Model::Texture> textures;
+
+    // Everything the render thread needs for one frame, written by the main thread while the render thread draws
+    // from the other one. Stats go back the same way once the frame has been drawn.
+    struct Snapshot {
+        Camera camera;
+        Settings settings;
+        GUI::Click click;
+        GUI::Draws draws;
+        std::vector<glm::mat4> moved;
+        uint32_t first = 0;
+        uint32_t count = 0;
+        double simulation = 0.0;
+        std::string capture;
+        RenderStats stats;
+        bool filled = false;
+    };
+
+    void renderLoop();
+    void draw(Snapshot& snapshot);
+    void publish(uint32_t first, uint32_t count, double simulation);
+    void save(const std::string& path);
+
+    Snapshot snapshots[2];
+    uint64_t published = 0;
+    uint64_t finished = 0;
+    bool stopping = false;
+    std::mutex mutex;
+    std::condition_variable handoff;
+    std::thread renderThread;
+
+    // The render thread's own copies of the camera and the world matrices, the main thread only touches the originals.
+    Camera rendered;
+    std::vector<glm::mat4> matrices;
+
+    // Every thread's allocation count when the last frame started drawing.
+    uint64_t allocated = 0;
     
     VkInstance instance;
     VkSurfaceKHR surface;
     GLFWwindow* window;
-    float lastFrame = 0.0f;
+    bool rebuild = false;
+    std::string screenshot;
+
+    // The simulation runs in ticks of a fixed length, time left over that is less than a tick carries on to the
+    // next frame and decides how far between the last two ticks the frame is drawn.
+    struct Clock {
+        double last = 0.0;
+        double accumulator = 0.0;
+        glm::vec3 previous = glm::vec3(0.0f);
+        float alpha = 1.0f;
+    } clock;
+
+    // Steps the recording threads from 1 up to the most there are, averaging each over a fixed number of frames.
+    struct Sweep {
+        uint32_t threads = 0;
+        uint32_t frames = 0;
+        double total = 0.0;
+        uint32_t restore = 1;
+    } sweep;
+    Workers workers;
 
     Devices devices{instance, surface};
 #ifdef DEBUG
@@ -46,10 +137,17 @@ private:
 #endif
     Buffers buffers{devices};
     Swapchain swapchain{devices, window};
-    Images images{models, devices, buffers};
+    Images images{devices, buffers};
     Renderpass renderpass{devices};
-    Descriptor descriptor{devices, buffers};
-    Pipeline pipeline{devices};
-    Processing processing{devices, camera, models, window};
+    Reflection reflection{devices};
+    Descriptor descriptor{devices, buffers, reflection};
+    Pipeline pipeline{devices, workers, reflection};
+    Indirect indirect{devices, buffers, reflection};
+    Instancing instancing{devices, buffers};
+    Occlusion occlusion{workers};
+    Timing timing{devices};
+    Memory memory{devices};
+    Transforms transforms;
+    Processing processing{devices, rendered, models, window, workers};
 };
 }
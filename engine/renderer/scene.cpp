@@ -0,0 +1,180 @@
+/*
+	scene.cpp
+	Adrenaline Engine
+
+	Definitions for spawning, packing and culling the scene.
+*/
+
+#include "scene.h"
+#include <algorithm>
+#include <numeric>
+
+// Instances lists the model behind each placement in the order Transforms flattened them.
+void Adren::Scene::build(ECS::World& world, std::vector<Model>& models, const std::vector<uint32_t>& instances, const std::vector<glm::mat4>& matrices, VkDeviceSize align) {
+	for (ECS::Entity entity : spawned) { world.destroy(entity); }
+	spawned.clear();
+	base = {};
+
+	// Every model is in the combined buffers once however many times it is placed.
+	std::vector<Base> offsets(models.size());
+	for (uint32_t m = 1; m < models.size(); m++) {
+		offsets[m].index = offsets[m - 1].index + static_cast<uint32_t>(models[m - 1].indices.size());
+		offsets[m].vertex = offsets[m - 1].vertex + static_cast<uint32_t>(models[m - 1].vertexCount);
+		offsets[m].texture = offsets[m - 1].texture + static_cast<uint32_t>(models[m - 1].textures.size());
+	}
+
+	for (uint32_t m : instances) {
+		base.index = offsets[m].index;
+		base.vertex = offsets[m].vertex;
+		base.texture = offsets[m].texture;
+
+		for (Model::Node& node : models[m].nodes) {
+			gather(world, models[m], m, node, matrices);
+		}
+	}
+
+	draws.resize(base.draw);
+	sources.resize(base.draw);
+	entities.resize(base.draw);
+
+	// Pipeline states get small ids in the order they are first met so they fit in the sort keys.
+	std::unordered_map<Pipeline::State, uint64_t, Pipeline::Hash> states;
+
+	world.each<Transform, Mesh, Material>([&](ECS::Entity entity, Transform& transform, Mesh& mesh, Material& material) {
+		uint64_t state = states.emplace(material.state, states.size()).first->second & 0x7FFF;
+		uint64_t texture = material.texture & 0xFFFF;
+		uint64_t key = material.state.blend ? (1ull << 63) | (state << 32) | (texture << 16) : (state << 48) | (texture << 32);
+
+		draws[mesh.draw] = { mesh.indexCount, mesh.firstIndex, mesh.vertexOffset, material.texture, static_cast<uint32_t>(transform.slot * align), material.state, key };
+		sources[mesh.draw] = { mesh.min, mesh.max, transform.world, transform.slot, mesh.model, mesh.localIndex, mesh.localVertex, mesh.occluder };
+		entities[mesh.draw] = entity;
+	});
+
+	bounds.resize(static_cast<uint32_t>(draws.size()));
+	for (uint32_t i = 0; i < sources.size(); i++) {
+		bounds.set(i, sources[i].min, sources[i].max, sources[i].matrix);
+	}
+
+	bvh.build(bounds);
+}
+
+// Picks up the world matrices of the node slots Transforms just rewrote, lights and cameras included. Every entity
+// only writes its own draw's entries so the chunks can run on the workers. The hierarchy keeps its shape and only
+// resizes its boxes.
+void Adren::Scene::refit(ECS::World& world, Workers& workers, const std::vector<glm::mat4>& matrices, uint32_t first, uint32_t count) {
+	world.parallel<Transform>(workers, 1024, [&](ECS::Entity, Transform& transform) {
+		if (transform.slot >= first && transform.slot < first + count) { transform.world = matrices[transform.slot]; }
+	});
+
+	world.parallel<Transform, Mesh>(workers, 1024, [&](ECS::Entity, Transform& transform, Mesh& mesh) {
+		if (transform.slot < first || transform.slot >= first + count) { return; }
+
+		sources[mesh.draw].matrix = transform.world;
+		bounds.set(mesh.draw, mesh.min, mesh.max, transform.world);
+	});
+
+	bvh.refit(bounds);
+}
+
+// Nodes are visited in the same order Transforms flattens them in, so the n-th node visited owns the n-th
+// world matrix and the n-th slot of the dynamic uniform buffer.
+void Adren::Scene::gather(ECS::World& world, Model& model, uint32_t modelIndex, Model::Node& node, const std::vector<glm::mat4>& matrices) {
+	uint32_t slot = base.node++;
+	Transform transform{ matrices[slot], slot };
+
+	for (Model::Primitive& prim : node.mesh.primitives) {
+		if (prim.indexCount == 0) { continue; }
+
+		Model::Material material = prim.materialIndex > -1 ? model.materials[prim.materialIndex] : Model::Material{};
+		int32_t texture = model.textures.empty() ? 0 : model.textures[material.baseColorTextureIndex].index;
+
+		Mesh mesh{};
+		mesh.min = prim.min;
+		mesh.max = prim.max;
+		mesh.draw = base.draw++;
+		mesh.model = modelIndex;
+		mesh.indexCount = prim.indexCount;
+		mesh.firstIndex = base.index + prim.firstIndex;
+		mesh.vertexOffset = static_cast<int32_t>(base.vertex + prim.firstVertex);
+		mesh.localIndex = prim.firstIndex;
+		mesh.localVertex = prim.firstVertex;
+		mesh.occluder = node.occluder;
+
+		spawned.push_back(world.create(transform, mesh, Material{ base.texture + texture, Pipeline::state(material) }));
+	}
+
+	if (node.light > -1 && node.light < static_cast<int32_t>(model.lights.size())) {
+		const tinygltf::Light& source = model.lights[node.light];
+		Light light{};
+		light.color = source.color.size() == 3 ? glm::vec3(source.color[0], source.color[1], source.color[2]) : glm::vec3(1.0f);
+		light.intensity = static_cast<float>(source.intensity);
+		light.range = static_cast<float>(source.range);
+		light.type = source.type == "directional" ? Light::Directional : source.type == "spot" ? Light::Spot : Light::Point;
+		spawned.push_back(world.create(transform, light));
+	}
+
+	if (node.camera > -1 && node.camera < static_cast<int32_t>(model.cameras.size())) {
+		const tinygltf::Camera& source = model.cameras[node.camera];
+		View view{};
+		view.fov = static_cast<float>(source.perspective.yfov);
+		view.aspect = static_cast<float>(source.perspective.aspectRatio);
+		view.nearPlane = static_cast<float>(source.perspective.znear);
+		view.farPlane = static_cast<float>(source.perspective.zfar);
+		spawned.push_back(world.create(transform, view));
+	}
+
+	for (Model::Node& child : node.children) {
+		gather(world, model, modelIndex, child, matrices);
+	}
+}
+
+void Adren::Scene::cull(const glm::mat4& viewProj, const Settings& settings, RenderStats& stats) {
+	if (settings.frustumCulling && settings.hierarchicalCulling) {
+		// The hierarchy hands back whole subtrees at once, sorting puts them back in draw order unless the
+		// sort keys are about to reorder them anyway.
+		bvh.cull(Culling::frustum(viewProj), visible);
+		if (!settings.sortDraws) { std::sort(visible.begin(), visible.end()); }
+	} else if (settings.frustumCulling) {
+		Culling::cull(Culling::frustum(viewProj), bounds, visible);
+	} else {
+		visible.resize(draws.size());
+		std::iota(visible.begin(), visible.end(), 0);
+	}
+
+	stats.draws = static_cast<uint32_t>(draws.size());
+	stats.drawn = static_cast<uint32_t>(visible.size());
+	stats.culled = stats.draws - stats.drawn;
+	stats.gpu = false;
+}
+
+// Orders the visible draws by their sort keys with the camera distance filled in. From the top bit down:
+//   opaque:  0 | state:15 | texture:16 | depth:16 | unused:16
+//   blended: 1 | inverted depth:16 | state:15 | texture:16 | unused:16
+// so opaque draws come first, grouped by pipeline then texture and front to back within those, and blended
+// draws come last from back to front, which they need to look right.
+void Adren::Scene::sort(const glm::vec3& eye, float range) {
+	keys.resize(visible.size());
+	for (size_t v = 0; v < visible.size(); v++) {
+		uint32_t i = visible[v];
+		glm::vec3 center(bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]);
+		uint64_t depth = static_cast<uint64_t>(glm::clamp(glm::length(center - eye) / range, 0.0f, 1.0f) * 65535.0f);
+
+		keys[v] = draws[i].state.blend ? draws[i].key | ((0xFFFF - depth) << 47) : draws[i].key | (depth << 16);
+	}
+
+	Sort::radix(keys, visible, keyScratch, visibleScratch);
+}
+
+// Casts a ray through a point of the viewport, given from 0 to 1 with the origin at the top left,
+// and returns the draw whose box it hits first or -1.
+int32_t Adren::Scene::pick(const glm::mat4& viewProj, float x, float y) const {
+	glm::mat4 inverse = glm::inverse(viewProj);
+	glm::vec4 start = inverse * glm::vec4(x * 2.0f - 1.0f, y * 2.0f - 1.0f, 0.0f, 1.0f);
+	glm::vec4 end = inverse * glm::vec4(x * 2.0f - 1.0f, y * 2.0f - 1.0f, 1.0f, 1.0f);
+
+	glm::vec3 origin = glm::vec3(start) / start.w;
+	glm::vec3 direction = glm::normalize(glm::vec3(end) / end.w - origin);
+
+	float distance;
+	return bvh.pick(origin, direction, distance);
+}
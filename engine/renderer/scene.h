@@ -0,0 +1,79 @@
+/*
+	scene.h
+	Adrenaline Engine
+
+	The scene turns the model node trees into entities, one per drawable primitive, and packs what the renderer
+	needs out of them into flat lists of draws with a world space box each, so culling and drawing never have to
+	walk the trees every frame.
+*/
+
+#pragma once
+#include "model.h"
+#include "pipeline.h"
+#include "culling.h"
+#include "bvh.h"
+#include "components.h"
+#include "core/ecs.h"
+#include "core/sort.h"
+
+namespace Adren {
+class Scene {
+public:
+	struct Draw {
+		uint32_t indexCount;
+		uint32_t firstIndex;
+		int32_t vertexOffset;
+		uint32_t texture;
+		uint32_t dynamicOffset;
+		Pipeline::State state;
+		uint64_t key;
+	};
+
+	// Where a draw came from: its local box, the world matrix and slot of its node and its range in the model's
+	// own arrays. The GPU side copies and the occluder meshes are built from these.
+	struct Source {
+		glm::vec3 min;
+		glm::vec3 max;
+		glm::mat4 matrix;
+		uint32_t node;
+		uint32_t model;
+		uint32_t firstIndex;
+		uint32_t firstVertex;
+		bool occluder;
+	};
+
+	void build(ECS::World& world, std::vector<Model>& models, const std::vector<uint32_t>& instances, const std::vector<glm::mat4>& matrices, VkDeviceSize align);
+	void refit(ECS::World& world, Workers& workers, const std::vector<glm::mat4>& matrices, uint32_t first, uint32_t count);
+	void cull(const glm::mat4& viewProj, const Settings& settings, RenderStats& stats);
+	void sort(const glm::vec3& eye, float range);
+	int32_t pick(const glm::mat4& viewProj, float x, float y) const;
+
+	// Everything below is packed from the components in draw order, entities holds the entity behind each draw.
+	std::vector<Draw> draws;
+	std::vector<Source> sources;
+	std::vector<ECS::Entity> entities;
+	std::vector<uint32_t> visible;
+	Culling::Bounds bounds;
+	BVH bvh;
+private:
+	void gather(ECS::World& world, Model& model, uint32_t modelIndex, Model::Node& node, const std::vector<glm::mat4>& matrices);
+
+	// Where the current model starts in the combined buffers while the entities are being spawned. Every placement
+	// of a model points at the same ranges, only the node slots move on.
+	struct Base {
+		uint32_t node = 0;
+		uint32_t draw = 0;
+		uint32_t index = 0;
+		uint32_t vertex = 0;
+		uint32_t texture = 0;
+	} base;
+
+	// Everything the last build spawned, which the next one destroys first.
+	std::vector<ECS::Entity> spawned;
+
+	// The sort keys of the visible draws and the radix sort's scratch space, kept so sorting never allocates.
+	std::vector<uint64_t> keys;
+	std::vector<uint64_t> keyScratch;
+	std::vector<uint32_t> visibleScratch;
+};
+}
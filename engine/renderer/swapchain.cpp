@@ -36,14 +36,16 @@ VkExtent2D Adren::Swapchain::chooseSwapExtent(const VkSurfaceCapabilitiesKHR& ca
     }
 }
 
-void Adren::Swapchain::create(VkSurfaceKHR& surface) {
+bool Adren::Swapchain::create(VkSurfaceKHR& surface) {
     SwapChainSupportDetails swapChainSupport = Adren::Tools::querySwapChainSupport(gpu, surface);
 
     VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
     VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
     VkExtent2D chosenExtent = chooseSwapExtent(swapChainSupport.capabilities);
+    if (chosenExtent.width == 0 || chosenExtent.height == 0) { return false; }
 
-    imageCount = swapChainSupport.capabilities.minImageCount + 1;
+    // A rebuild asks for at least as many images as before.
+    imageCount = handle != VK_NULL_HANDLE ? std::max(static_cast<uint32_t>(images.size()), swapChainSupport.capabilities.minImageCount) : swapChainSupport.capabilities.minImageCount + 1;
     if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount) {
         imageCount = swapChainSupport.capabilities.maxImageCount;
     }
@@ -76,7 +78,7 @@ void Adren::Swapchain::create(VkSurfaceKHR& surface) {
     createInfo.presentMode = presentMode;
     createInfo.clipped = VK_TRUE;
 
-    createInfo.oldSwapchain = VK_NULL_HANDLE;
+    createInfo.oldSwapchain = handle;
 
     Adren::Tools::vibeCheck("SWAPCHAIN", vkCreateSwapchainKHR(device, &createInfo, nullptr, &handle));
 
@@ -86,6 +88,15 @@ void Adren::Swapchain::create(VkSurfaceKHR& surface) {
 
     imgFormat = surfaceFormat.format;
     extent = chosenExtent;
+    return true;
+}
+
+// The same format a window usually gets, so frames dumped from here match what the editor shows.
+void Adren::Swapchain::createHeadless(VkExtent2D size, uint32_t count) {
+    imgFormat = VK_FORMAT_B8G8R8A8_SRGB;
+    extent = size;
+    imageCount = count;
+    images.assign(count, VK_NULL_HANDLE);
 }
 
 void Adren::Swapchain::createImageViews(Images& image) {
@@ -28,10 +28,16 @@ public:
             vkDestroyImageView(device, imageView, nullptr);
         }
 
-        vkDestroySwapchainKHR(device, handle, nullptr);
+        if (handle != VK_NULL_HANDLE) { vkDestroySwapchainKHR(device, handle, nullptr); }
     }
 
-    void create(VkSurfaceKHR& surface);
+    // Builds from the current handle when there is one so the driver can hand its images over, the old handle is
+    // left to the caller to destroy once nothing presents from it. False while the window has no area.
+    bool create(VkSurfaceKHR& surface);
+
+    // No swapchain at all, only the format, extent and number of image slots everything sized by the swapchain
+    // reads. The images stay null, frames are drawn into the editor's offscreen target instead.
+    void createHeadless(VkExtent2D size, uint32_t count);
     void createFramebuffers(Image& depth, VkRenderPass& renderpass);
     void createImageViews(Images& image);
 
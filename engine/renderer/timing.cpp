@@ -0,0 +1,132 @@
+/*
+	timing.cpp
+	Adrenaline Engine
+
+	Definitions for the GPU and CPU frame timings.
+*/
+
+#include "timing.h"
+#include "tools.h"
+#include <algorithm>
+
+// Timestamps need the graphics queue to have valid bits for them, the period turns ticks into nanoseconds.
+void Adren::Timing::create() {
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(devices.gpu, &properties);
+
+	QueueFamilyIndices indices = Tools::findQueueFamilies(devices.gpu, devices.surface);
+	uint32_t familyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(devices.gpu, &familyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> families(familyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(devices.gpu, &familyCount, families.data());
+
+	uint32_t bits = families[indices.graphicsFamily.value()].timestampValidBits;
+	if (bits == 0 || properties.limits.timestampPeriod <= 0.0f) {
+		Tools::log("The graphics queue has no timestamps, GPU timings are off..");
+		return;
+	}
+
+	period = properties.limits.timestampPeriod;
+	mask = bits >= 64 ? ~0ull : (1ull << bits) - 1;
+
+	VkQueryPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	poolInfo.queryCount = maxPasses * 2;
+	for (uint32_t i = 0; i < maxFramesInFlight; i++) {
+		Tools::vibeCheck("TIMESTAMP QUERY POOL", vkCreateQueryPool(device, &poolInfo, nullptr, &pools[i]));
+	}
+
+	supported = true;
+}
+
+void Adren::Timing::cleanup() {
+	for (VkQueryPool& pool : pools) {
+		if (pool != VK_NULL_HANDLE) { vkDestroyQueryPool(device, pool, nullptr); }
+		pool = VK_NULL_HANDLE;
+	}
+}
+
+// The fence of this slot was just waited on, so whatever it wrote last time is done and reading it cannot stall.
+void Adren::Timing::begin(VkCommandBuffer& commandBuffer, uint32_t frame) {
+	this->frame = frame;
+	if (!supported) { return; }
+
+	std::vector<const char*>& recorded = names[frame];
+	if (!recorded.empty()) {
+		uint64_t results[maxPasses * 2];
+		uint32_t count = static_cast<uint32_t>(recorded.size()) * 2;
+		VkResult result = vkGetQueryPoolResults(device, pools[frame], 0, count, sizeof(uint64_t) * count, results, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+		if (result == VK_SUCCESS) {
+			for (size_t i = 0; i < recorded.size(); i++) {
+				uint64_t ticks = (results[i * 2 + 1] - results[i * 2]) & mask;
+				add(gpu, recorded[i], static_cast<float>(ticks * period / 1e6));
+			}
+		}
+	}
+
+	recorded.clear();
+	vkCmdResetQueryPool(commandBuffer, pools[frame], 0, maxPasses * 2);
+}
+
+uint32_t Adren::Timing::start(VkCommandBuffer& commandBuffer, const char* name) {
+	if (!supported || names[frame].size() >= maxPasses) { return UINT32_MAX; }
+
+	uint32_t pass = static_cast<uint32_t>(names[frame].size());
+	names[frame].push_back(name);
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, pools[frame], pass * 2);
+	return pass;
+}
+
+void Adren::Timing::end(VkCommandBuffer& commandBuffer, uint32_t pass) {
+	if (pass == UINT32_MAX) { return; }
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, pools[frame], pass * 2 + 1);
+}
+
+void Adren::Timing::cpu(const char* name, double milliseconds) {
+	add(stages, name, static_cast<float>(milliseconds));
+}
+
+void Adren::Timing::fill(RenderStats& stats) const {
+	stats.gpuTimings.clear();
+	stats.cpuTimings.clear();
+	for (const Rolling& pass : gpu) { stats.gpuTimings.push_back(pass.summary()); }
+	for (const Rolling& stage : stages) { stats.cpuTimings.push_back(stage.summary()); }
+}
+
+// Only a handful of passes exist, so finding one by name is a short walk.
+void Adren::Timing::add(std::vector<Rolling>& list, const char* name, float milliseconds) {
+	auto found = std::find_if(list.begin(), list.end(), [name](const Rolling& rolling) { return rolling.name == name; });
+	if (found == list.end()) {
+		list.emplace_back();
+		list.back().name = name;
+		found = list.end() - 1;
+	}
+
+	found->add(milliseconds);
+}
+
+void Adren::Timing::Rolling::add(float milliseconds) {
+	samples[next] = milliseconds;
+	next = (next + 1) % size;
+	count = std::min(count + 1, size);
+}
+
+PassTiming Adren::Timing::Rolling::summary() const {
+	PassTiming timing{ name };
+	if (count == 0) { return timing; }
+
+	timing.last = samples[(next + size - 1) % size];
+	timing.min = samples[0];
+	timing.max = samples[0];
+	float total = 0.0f;
+	for (uint32_t i = 0; i < count; i++) {
+		timing.min = std::min(timing.min, samples[i]);
+		timing.max = std::max(timing.max, samples[i]);
+		total += samples[i];
+	}
+
+	timing.avg = total / count;
+	return timing;
+}
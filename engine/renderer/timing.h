@@ -0,0 +1,65 @@
+/*
+	timing.h
+	Adrenaline Engine
+
+	GPU timestamps around every pass of a frame, read back once the same frame slot comes around again so reading
+	them never waits on the GPU. CPU stages are kept the same way so the editor can show both side by side.
+*/
+
+#pragma once
+#include "devices.h"
+#include "types.h"
+#include <string>
+
+namespace Adren {
+class Timing {
+public:
+	Timing(Devices& devices) : devices(devices) {}
+
+	void create();
+	void cleanup();
+
+	// Called right after the frame's fence, before anything else is recorded. Takes the last results of this
+	// slot and resets its queries.
+	void begin(VkCommandBuffer& commandBuffer, uint32_t frame);
+
+	// Names have to outlive the frame, string literals are what every pass uses. Start hands back the id end
+	// takes, so passes can nest.
+	uint32_t start(VkCommandBuffer& commandBuffer, const char* name);
+	void end(VkCommandBuffer& commandBuffer, uint32_t pass);
+
+	void cpu(const char* name, double milliseconds);
+	void fill(RenderStats& stats) const;
+
+	bool supported = false;
+private:
+	// The last frames of one pass or stage, the summary is worked out from these when the stats are filled.
+	struct Rolling {
+		static constexpr uint32_t size = 120;
+
+		std::string name;
+		float samples[size]{};
+		uint32_t count = 0;
+		uint32_t next = 0;
+
+		void add(float milliseconds);
+		PassTiming summary() const;
+	};
+
+	static void add(std::vector<Rolling>& list, const char* name, float milliseconds);
+
+	static constexpr uint32_t maxPasses = 16;
+
+	Devices& devices;
+	VkDevice& device = devices.device;
+
+	VkQueryPool pools[maxFramesInFlight]{};
+	std::vector<const char*> names[maxFramesInFlight];
+	uint32_t frame = 0;
+	double period = 1.0;
+	uint64_t mask = ~0ull;
+
+	std::vector<Rolling> gpu;
+	std::vector<Rolling> stages;
+};
+}
@@ -59,8 +59,13 @@ inline QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device, VkSurfaceKH
             indices.graphicsFamily = i;
         }
 
+        // Without a surface nothing is presented, so the graphics queue stands in for the present queue.
         VkBool32 presentSupport = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+        if (surface == VK_NULL_HANDLE) {
+            presentSupport = indices.graphicsFamily.has_value();
+        } else {
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+        }
 
         if (presentSupport) {
             indices.presentFamily = i;
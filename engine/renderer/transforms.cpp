@@ -0,0 +1,113 @@
+/*
+	transforms.cpp
+	Adrenaline Engine
+
+	Definitions for flattening the node trees and propagating transforms down the dirty subtrees.
+*/
+
+#include "transforms.h"
+#include <algorithm>
+
+// Every placed copy flattens its model's nodes into slots of its own, in the order they are given.
+void Adren::Transforms::build(const std::vector<Model>& models, const std::vector<Placed>& placed) {
+	local.clear();
+	parents.clear();
+	owners.clear();
+	ends.clear();
+	firsts.clear();
+	roots.resize(placed.size());
+
+	std::vector<const Model::Node*> nodes;
+	for (uint32_t p = 0; p < placed.size(); p++) {
+		firsts.push_back(static_cast<uint32_t>(local.size()));
+		roots[p] = placed[p].matrix;
+
+		for (const Model::Node& node : models[placed[p].model].nodes) {
+			flatten(node, none, p, nodes);
+		}
+	}
+
+	firsts.push_back(static_cast<uint32_t>(local.size()));
+
+	// Composes every local matrix in one batch, nodes that came with a whole matrix just get it copied over.
+	Kernels::TRS trs;
+	trs.resize(static_cast<uint32_t>(nodes.size()));
+	for (uint32_t n = 0; n < nodes.size(); n++) {
+		if (!nodes[n]->composed) { trs.set(n, nodes[n]->translation, nodes[n]->rotation, nodes[n]->scale); }
+	}
+
+	Kernels::compose(trs, local.data());
+	for (uint32_t n = 0; n < nodes.size(); n++) {
+		if (nodes[n]->composed) { local[n] = nodes[n]->matrix; }
+	}
+
+	world.resize(local.size());
+	dirty.assign((local.size() + 63) / 64, 0);
+
+	// Everything starts out dirty so the first update fills the whole array.
+	for (uint32_t p = 0; p < placed.size(); p++) { move(p, roots[p]); }
+	update();
+}
+
+// Depth first and parents first, so every subtree is the contiguous range from its root up to ends[root].
+void Adren::Transforms::flatten(const Model::Node& node, uint32_t parent, uint32_t instance, std::vector<const Model::Node*>& nodes) {
+	uint32_t index = static_cast<uint32_t>(local.size());
+	local.push_back(glm::mat4(1.0f));
+	nodes.push_back(&node);
+	parents.push_back(parent);
+	owners.push_back(instance);
+	ends.push_back(0);
+
+	for (const Model::Node& child : node.children) {
+		flatten(child, index, instance, nodes);
+	}
+
+	ends[index] = static_cast<uint32_t>(local.size());
+}
+
+// Places a whole copy of a model, which dirties each of its root nodes.
+void Adren::Transforms::move(uint32_t instance, const glm::mat4& matrix) {
+	roots[instance] = matrix;
+	for (uint32_t node = firsts[instance]; node < firsts[instance + 1]; node = ends[node]) {
+		mark(node);
+	}
+}
+
+// Changes one node relative to its parent.
+void Adren::Transforms::set(uint32_t node, const glm::mat4& matrix) {
+	local[node] = matrix;
+	mark(node);
+}
+
+// Walks the bitset a word at a time. A dirty node recomputes its whole subtree in order, and whatever else was
+// marked inside that subtree is covered by it and skipped.
+bool Adren::Transforms::update() {
+	uint32_t size = static_cast<uint32_t>(local.size());
+	uint32_t lowest = size, highest = 0;
+
+	for (uint32_t i = 0; i < size;) {
+		if (i % 64 == 0 && dirty[i / 64] == 0) {
+			i += 64;
+			continue;
+		}
+
+		if (!(dirty[i / 64] & (1ull << (i % 64)))) {
+			i++;
+			continue;
+		}
+
+		for (uint32_t n = i; n < ends[i]; n++) {
+			Kernels::multiply(parents[n] == none ? roots[owners[n]] : world[parents[n]], local[n], world[n]);
+		}
+
+		lowest = std::min(lowest, i);
+		highest = std::max(highest, ends[i]);
+		i = ends[i];
+	}
+
+	std::fill(dirty.begin(), dirty.end(), 0);
+
+	first = lowest < highest ? lowest : 0;
+	count = lowest < highest ? highest - lowest : 0;
+	return count > 0;
+}
@@ -0,0 +1,49 @@
+/*
+	transforms.h
+	Adrenaline Engine
+
+	World matrices for every node of every placed model, kept in one flat array where a parent always comes before
+	its children. A model placed twice gets its nodes twice. Moving something only marks it dirty and the next
+	update recomputes just the subtrees under what moved.
+*/
+
+#pragma once
+#include "model.h"
+#include "kernels.h"
+
+namespace Adren {
+class Transforms {
+public:
+	// One copy of a model's node tree, placed by its matrix.
+	struct Placed {
+		uint32_t model;
+		glm::mat4 matrix;
+	};
+
+	void build(const std::vector<Model>& models, const std::vector<Placed>& placed);
+	void move(uint32_t instance, const glm::mat4& matrix);
+	void set(uint32_t node, const glm::mat4& matrix);
+	bool update();
+	uint32_t instances() const { return static_cast<uint32_t>(roots.size()); }
+
+	// Node slots in the same order as the dynamic uniform buffer and Scene's dynamic offsets.
+	std::vector<glm::mat4> world;
+
+	// The range of slots the last update rewrote, which is all that needs uploading again.
+	uint32_t first = 0;
+	uint32_t count = 0;
+private:
+	void flatten(const Model::Node& node, uint32_t parent, uint32_t instance, std::vector<const Model::Node*>& nodes);
+	void mark(uint32_t node) { dirty[node / 64] |= 1ull << (node % 64); }
+
+	std::vector<glm::mat4> local;
+	std::vector<glm::mat4> roots;
+	std::vector<uint32_t> parents;
+	std::vector<uint32_t> owners;
+	std::vector<uint32_t> ends;
+	std::vector<uint32_t> firsts;
+	std::vector<uint64_t> dirty;
+
+	static const uint32_t none = UINT32_MAX;
+};
+}
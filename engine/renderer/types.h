@@ -17,6 +17,8 @@
 #include <glm/gtx/hash.hpp>
 
 #include <iostream>
+#include <string>
+#include <vector>
 #include <unordered_map>
 #include <optional>
 #include <array>
@@ -66,6 +68,40 @@ struct Vertex {
     }
 };
 
+// Per draw data for pipelines that read the model matrix as a vertex attribute instead of from the dynamic uniform buffer.
+struct Instance {
+    glm::mat4 model;
+    uint32_t texture;
+    uint32_t padding[3];
+
+    static VkVertexInputBindingDescription getBindingDescription() {
+        VkVertexInputBindingDescription bindingDescription{};
+        bindingDescription.binding = 1;
+        bindingDescription.stride = sizeof(Instance);
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+        return bindingDescription;
+    }
+
+    // A mat4 attribute takes up four locations, one per column.
+    static std::array<VkVertexInputAttributeDescription, 5> getAttributeDescriptions() {
+        std::array<VkVertexInputAttributeDescription, 5> attributeDescriptions{};
+        for (uint32_t i = 0; i < 4; i++) {
+            attributeDescriptions[i].binding = 1;
+            attributeDescriptions[i].location = 3 + i;
+            attributeDescriptions[i].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+            attributeDescriptions[i].offset = offsetof(Instance, model) + sizeof(glm::vec4) * i;
+        }
+
+        attributeDescriptions[4].binding = 1;
+        attributeDescriptions[4].location = 7;
+        attributeDescriptions[4].format = VK_FORMAT_R32_UINT;
+        attributeDescriptions[4].offset = offsetof(Instance, texture);
+
+        return attributeDescriptions;
+    }
+};
+
 namespace std {
     template<> struct hash<Vertex> {
         size_t operator()(Vertex const& vertex) const {
@@ -99,29 +135,99 @@ struct UboData {
     glm::mat4 *model = nullptr;
 };
 
+const int maxFramesInFlight = 3;
+
+// The secondary buffers record the scene on several threads at once, each from a pool nothing else touches.
 struct Frame {
     VkCommandPool commandPool;
     VkCommandBuffer commandBuffer;
     VkFence fence;
     VkSemaphore iSemaphore;
     VkSemaphore rSemaphore;
+    std::vector<VkCommandPool> recordPools;
+    std::vector<VkCommandBuffer> secondaries;
 };
 
-struct Offset {
-    uint32_t index = 0;
-    uint32_t vertex = 0;
-    uint32_t texture = 0;
-    uint32_t dynamic = 0;
-    uint32_t model = 0;
-    VkDeviceSize align = 0;
+// What the draw loop recorded last frame, fewer binds and pushes per call means sorting is doing its job.
+struct DrawCounters {
+    uint32_t calls = 0;
+    uint32_t pipelines = 0;
+    uint32_t sets = 0;
+    uint32_t pushes = 0;
+};
+
+// One pass or stage over the last couple of seconds of frames, in milliseconds.
+struct PassTiming {
+    std::string name;
+    float last = 0.0f;
+    float min = 0.0f;
+    float avg = 0.0f;
+    float max = 0.0f;
+};
+
+// What an allocation holds, kept in its VMA user data so reports can break memory down by it.
+enum class MemoryCategory : uint8_t { Geometry, Textures, Uniforms, Targets, Staging, Other, Count };
+
+// One memory heap. Usage and budget cover the whole process when the driver has VK_EXT_memory_budget, without it
+// they are VMA's own estimate of just this allocator.
+struct HeapStats {
+    bool deviceLocal = false;
+    uint64_t size = 0;
+    uint64_t usage = 0;
+    uint64_t budget = 0;
+    uint64_t blocks = 0;      // Bytes in VkDeviceMemory blocks.
+    uint64_t allocated = 0;   // Bytes of those blocks handed out to allocations.
+    uint32_t allocations = 0;
+    uint64_t largestFree = 0; // Largest unused range in the blocks, from the last full statistics pass.
+};
+
+struct MemoryStats {
+    std::vector<HeapStats> heaps;
+    std::array<uint64_t, static_cast<size_t>(MemoryCategory::Count)> bytes{};
+    std::array<uint32_t, static_cast<size_t>(MemoryCategory::Count)> counts{};
+    bool nearBudget = false; // Some heap is past the warning fraction of its budget.
+};
+
+struct RenderStats {
+    uint32_t draws = 0;
+    uint32_t drawn = 0;
+    uint32_t culled = 0;
+    uint32_t occluded = 0;
+    int32_t picked = -1;
+    DrawCounters recorded;
+    uint32_t recorders = 1;
+    float recording = 0.0f;
+    bool gpu = false;
+    uint32_t ticks = 0;
+    uint64_t memory = 0; // Bytes in live GPU allocations across every heap.
+    MemoryStats gpuMemory;
+    uint32_t allocations = 0; // Heap allocations any thread made since the frame before started.
+    uint64_t arena = 0;       // Bytes of the frame's arena in use by the end of it.
+    std::vector<PassTiming> gpuTimings;
+    std::vector<PassTiming> cpuTimings;
+};
+
+// Renderer switches that can be flipped at runtime from the editor.
+struct Settings {
+    bool frustumCulling = true;
+    bool hierarchicalCulling = true;
+    bool gpuCulling = false;
+    bool occlusionCulling = false;
+    bool softwareOcclusion = false;
+    bool instancing = true;
+    bool sortDraws = true;
+    uint32_t recordThreads = 1;
+    bool measureRecording = false;
+    bool fixedStep = true;
+    uint32_t tickRate = 60;
 };
 
 struct Buffer {
-    VkBuffer buffer;
-    VmaAllocation memory;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VmaAllocation memory = VK_NULL_HANDLE;
     VkDeviceSize size = 0;
     VkDeviceSize align = 0;
-    void* mapped;
+    void* mapped = nullptr;
 };
 
 struct Image {
@@ -0,0 +1,27 @@
+#version 450 core
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : enable
+
+layout(binding = 2) uniform sampler texSampler; 
+layout(binding = 3) uniform texture2D textures[];
+
+// These are filled in per material when the pipeline variant is compiled.
+layout(constant_id = 0) const int ALPHA_MASK = 0;
+layout(constant_id = 1) const int UNLIT = 0;
+layout(constant_id = 2) const float ALPHA_CUTOFF = 0.5;
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) flat in uint fragTexture;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    vec4 color = texture(sampler2D(textures[nonuniformEXT(fragTexture)], texSampler), fragTexCoord);
+
+    if (ALPHA_MASK != 0 && color.a < ALPHA_CUTOFF) {
+        discard;
+    }
+
+    outColor = UNLIT != 0 ? color : color * vec4(fragColor, 1.0);
+}
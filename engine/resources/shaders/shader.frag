@@ -5,6 +5,11 @@
 layout(binding = 2) uniform sampler texSampler; 
 layout(binding = 3) uniform texture2D textures[];
 
+// These are filled in per material when the pipeline variant is compiled.
+layout(constant_id = 0) const int ALPHA_MASK = 0;
+layout(constant_id = 1) const int UNLIT = 0;
+layout(constant_id = 2) const float ALPHA_CUTOFF = 0.5;
+
 layout(push_constant) uniform PER_OBJECT {
 	int imageIndex;
 } pushConstant;
@@ -15,5 +20,11 @@ layout(location = 1) in vec2 fragTexCoord;
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    outColor = texture(sampler2D(textures[pushConstant.imageIndex], texSampler), fragTexCoord);
+    vec4 color = texture(sampler2D(textures[pushConstant.imageIndex], texSampler), fragTexCoord);
+
+    if (ALPHA_MASK != 0 && color.a < ALPHA_CUTOFF) {
+        discard;
+    }
+
+    outColor = UNLIT != 0 ? color : color * vec4(fragColor, 1.0);
 }
@@ -1,5 +1,13 @@
 del /f vert.spv
 del /f frag.spv
+del /f indirectvert.spv
+del /f indirectfrag.spv
+del /f cull.spv
+del /f hiz.spv
 C:\VulkanSDK\1.2.189.0\Bin32\glslc.exe shader.vert -o vert.spv
 C:\VulkanSDK\1.2.189.0\Bin32\glslc.exe shader.frag -o frag.spv
+C:\VulkanSDK\1.2.189.0\Bin32\glslc.exe indirect.vert -o indirectvert.spv
+C:\VulkanSDK\1.2.189.0\Bin32\glslc.exe indirect.frag -o indirectfrag.spv
+C:\VulkanSDK\1.2.189.0\Bin32\glslc.exe cull.comp -o cull.spv
+C:\VulkanSDK\1.2.189.0\Bin32\glslc.exe hiz.comp -o hiz.spv
 pause
\ No newline at end of file
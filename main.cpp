@@ -6,10 +6,92 @@
 */
 
 #include "engine/adrenaline.h"
+#include "engine/benchmark.h"
 #define DEBUG
 
-int main() {
+int main(int argc, char** argv) {
     Config config{};
+
+    // Runs the scene hierarchy benchmarks instead of the engine.
+    if (argc > 1 && std::string(argv[1]) == "--bench-bvh") {
+        for (uint32_t count : { 10000u, 100000u, 1000000u }) {
+            Adren::BVH::benchmark(count);
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    // Compares the batched matrix kernels against plain glm, fails when their results don't match it.
+    if (argc > 1 && std::string(argv[1]) == "--bench-math") {
+        bool passed = true;
+        for (uint32_t count : { 10000u, 100000u, 1000000u }) {
+            passed = Adren::Kernels::benchmark(count) && passed;
+        }
+
+        return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Culls a fixed scene in software from fixed camera poses, fails when any pose hides the wrong boxes.
+    if (argc > 1 && std::string(argv[1]) == "--test-occlusion") {
+        return Adren::Occlusion::test() ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Stress tests the job system and measures what scheduling a job costs.
+    if (argc > 1 && std::string(argv[1]) == "--bench-jobs") {
+        Adren::Workers::benchmark();
+        return EXIT_SUCCESS;
+    }
+
+    // Runs a benchmark suite headless and fails when it got slower than the baseline.
+    // --bench <suite.json> [--out results.json] [--baseline results.json] [--threshold 0.1]
+    if (argc > 2 && std::string(argv[1]) == "--bench") {
+        Adren::Benchmark::Options options;
+        options.suite = argv[2];
+        for (int i = 3; i + 1 < argc; i += 2) {
+            std::string option = argv[i];
+            if (option == "--out") { options.output = argv[i + 1]; }
+            else if (option == "--baseline") { options.baseline = argv[i + 1]; }
+            else if (option == "--threshold") { options.threshold = std::stod(argv[i + 1]); }
+        }
+
+        try {
+            return Adren::Benchmark::run(options) ? EXIT_SUCCESS : EXIT_FAILURE;
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Replays a recorded input log headless against a model, for as many frames as were recorded.
+    // --replay <input.bin> <model.gltf> [dump directory] [save every nth frame]
+    if (argc > 3 && std::string(argv[1]) == "--replay") {
+        Adren::Engine engine;
+
+        try {
+            engine.runHeadless(argv[3], 0, 1280, 720, argc > 4 ? argv[4] : "", argc > 5 ? static_cast<uint32_t>(std::stoul(argv[5])) : 0, argv[2]);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    // Renders without a window, for benchmarks and image comparisons on machines without a display.
+    // --headless <model.gltf> <frames> [dump directory] [save every nth frame]
+    if (argc > 3 && std::string(argv[1]) == "--headless") {
+        Adren::Engine engine;
+
+        try {
+            engine.runHeadless(argv[2], static_cast<uint32_t>(std::stoul(argv[3])), 1280, 720,
+                argc > 4 ? argv[4] : "", argc > 5 ? static_cast<uint32_t>(std::stoul(argv[5])) : 0);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+    }
     
     /*Model sponza("../engine/resources/models/sponza/Sponza.gltf");
 